@@ -0,0 +1,164 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * allocations.cpp
+ *
+ * Design Overview:
+ *
+ * Allocation check harness: fails, with exit status 1, if a hot path
+ * allocates per bar. It checks that
+ *
+ *   - Engine::run over a FrameSource makes no allocation in steady state
+ *     (run under alloccount::Forbid, so the first allocation fails),
+ *   - a CSV load allocates O(chunks), not O(rows): the same count for a
+ *     file ten times as long, within a small slack,
+ *   - a native load allocates O(1).
+ *
+ * Links lib/alloccount.cpp, so it must stay out of the library:
+ *
+ *     g++ -std=c++11 -O2 -I. harness/allocations.cpp lib/alloccount.cpp lib/csv.cpp \
+ *         lib/native.cpp lib/dataframe.cpp lib/dynframe.cpp lib/datapoint.cpp \
+ *         lib/calendar.cpp lib/footprint.cpp lib/timeseries.cpp lib/sweep.cpp \
+ *         lib/numa.cpp lib/profile.cpp -lpthread -lboost_date_time -o allocations
+ *     ./allocations [rows]
+ *
+ */
+
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../lib/alloccount.hpp"
+#include "../lib/engine.hpp"
+#include "../lib/csv.hpp"
+#include "../lib/native.hpp"
+#include "../strategies/breakout.hpp"
+
+using namespace datapoint;
+namespace ac = alloccount;
+
+namespace {
+    
+    const uint64_t LOAD_SLACK = 64;         // allocations a 10x longer file may add
+    const uint64_t NATIVE_MAX = 32;         // allocations of a native load, any size
+    
+    void fail_exit( size_t bytes ){
+        char msg[96];
+        const int n = std::snprintf(msg, sizeof(msg), "FAIL: allocation of %lu bytes in steady state\n",
+                                    static_cast<unsigned long>(bytes));
+        if( n > 0 && ::write(2, msg, static_cast<size_t>(n)) < 0 ) {}
+        ::_exit(1);
+    }
+    
+    // random walk bars, written as CSV
+    void write_bars( const std::string& path, size_t rows ){
+        FILE* f = std::fopen(path.c_str(), "w");
+        ALLOC_EXPECT( f != NULL );
+        std::fprintf(f, "date_time,open,high,low,close\n");
+        
+        double px = 100;
+        for( size_t i = 0; i < rows; ++i ){
+            char ts[20];
+            utilities::format_datetime( static_cast<time_t>(1262304000 + 60*i), ts );
+            const double o = px;
+            px += ( (i * 7919) % 200 - 99.5 ) / 100.0;
+            std::fprintf(f, "%.19s,%.2f,%.2f,%.2f,%.2f\n", ts, o, std::max(o, px) + 0.25, std::min(o, px) - 0.25, px);
+        }
+        std::fclose(f);
+    }
+    
+    // allocations of all threads, since loaders run in parallel
+    template<typename F> uint64_t allocations( F f ){
+        const uint64_t before = ac::global_counts().allocations;
+        f();
+        return ac::global_counts().allocations - before;
+    }
+}
+
+
+int main( int argc, const char* argv[] )
+{
+    const size_t rows = argc > 1 ? static_cast<size_t>( std::atol(argv[1]) ) : 100000;
+    const std::string dir = "/tmp/tsdb-allocations-" + std::to_string(getpid());
+    const std::string small = dir + ".small.csv", large = dir + ".large.csv", nat = dir + ".tsn";
+    
+    write_bars( small, rows );
+    write_bars( large, rows * 10 );
+    
+    // CSV LOAD: O(chunks)
+    
+    csv::Options opts;
+    opts.threads = 4;
+    df::DataFrame<OHLC> frame;
+    
+    const uint64_t a_small = allocations( [&](){ frame = csv::read_frame<OHLC>(small, opts); } );
+    const uint64_t a_large = allocations( [&](){ frame = csv::read_frame<OHLC>(large, opts); } );
+    std::printf("csv load: %lu allocations for %lu rows, %lu for %lu rows\n",
+                (unsigned long)a_small, (unsigned long)rows, (unsigned long)a_large, (unsigned long)(rows * 10));
+    ALLOC_EXPECT( frame.size() == rows * 10 );
+    ALLOC_EXPECT( a_large <= a_small + LOAD_SLACK );
+    
+    // NATIVE LOAD: O(1)
+    
+    native::write( nat, frame );
+    const uint64_t a_native = allocations( [&](){ frame = native::read<OHLC>(nat); } );
+    std::printf("native load: %lu allocations for %lu rows\n", (unsigned long)a_native, (unsigned long)frame.size());
+    ALLOC_EXPECT( a_native <= NATIVE_MAX );
+    
+    // ENGINE: no allocation per bar
+    
+    engine::Engine<OHLC> eng;
+    std::vector< strategies::Breakout<OHLC> > pool;
+    for( unsigned lookback = 5; lookback <= 40; lookback += 5 )
+        pool.push_back( strategies::Breakout<OHLC>(lookback, 10) );
+    
+    {
+        engine::FrameSource<OHLC> warmup(frame);    // first touches happen here
+        eng.run(warmup, pool);
+    }
+    
+    ac::set_failure_handler( &fail_exit );
+    engine::FrameSource<OHLC> src(frame);
+    ac::Scope scope;
+    size_t bars = 0;
+    {
+        ac::Forbid forbid;
+        bars = eng.run(src, pool);
+    }
+    ALLOC_EXPECT( scope.counts().allocations == 0 );
+    ALLOC_EXPECT( bars == frame.size() );
+    std::printf("engine run: %lu bars x %lu strategies, 0 allocations\n",
+                (unsigned long)bars, (unsigned long)pool.size());
+    
+    std::remove( small.c_str() );
+    std::remove( large.c_str() );
+    std::remove( nat.c_str() );
+    std::printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * features.cpp
+ *
+ * Design Overview:
+ *
+ * Numerical check harness for the rolling feature kernels: fails, with
+ * exit status 1, if rolling_mean or rolling_std of a long series at a
+ * high price level drifts from a naive two-pass computation over each
+ * window, or if the row-major and column-major layouts disagree. The
+ * series is a random walk in cents around 5000, where a running sum of
+ * squares loses nearly every significant digit (quarter ticks would not
+ * do: their sums are exact in binary).
+ *
+ *     g++ -std=c++11 -O2 -I. harness/features.cpp lib/dataframe.cpp lib/datapoint.cpp \
+ *         lib/calendar.cpp lib/footprint.cpp lib/timeseries.cpp lib/profile.cpp \
+ *         -lpthread -lboost_date_time -o features
+ *     ./features [rows]
+ *
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../lib/features.hpp"
+
+using namespace datapoint;
+
+#define FEATURES_EXPECT(c) do {                                                     \
+    if (!(c)) { std::fprintf(stderr, "FAIL: %s at %s:%d\n", #c, __FILE__, __LINE__); \
+                std::exit(1); }                                                     \
+} while(0)
+
+namespace {
+    
+    const double LEVEL = 5000;              // price level of the series
+    const double TOLERANCE = 1e-9;          // error relative to the price level
+    
+    // a stable update leaves a few ulps of the inputs in M2, and the std of a flat
+    // window is the square root of that residue, so errors are scaled by the level
+    double error( double got, double want ){
+        if( std::isnan(got) || std::isnan(want) )
+            return std::isnan(got) == std::isnan(want) ? 0.0 : 1.0;
+        return std::fabs(got - want) / std::max( LEVEL, std::fabs(want) );
+    }
+    
+    // mean and sample standard deviation of x[i-w+1..i], two passes
+    void two_pass( const double* x, size_t i, size_t w, double& mean, double& sd ){
+        double sum = 0;
+        for( size_t k = i+1-w; k <= i; ++k )
+            sum += x[k];
+        mean = sum / w;
+        double m2 = 0;
+        for( size_t k = i+1-w; k <= i; ++k )
+            m2 += (x[k] - mean) * (x[k] - mean);
+        sd = w > 1 ? std::sqrt( m2 / (w-1) ) : std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+
+int main( int argc, const char* argv[] )
+{
+    const size_t rows = argc > 1 ? static_cast<size_t>( std::atol(argv[1]) ) : 2000000;
+    const unsigned windows[] = { 2, 10, 390 };
+    const size_t nw = sizeof(windows) / sizeof(windows[0]);
+    
+    // random walk in cents around 5000
+    std::vector<time_t> idx( rows );
+    std::vector<double> close( rows );
+    double px = LEVEL;
+    std::srand(17);
+    for( size_t i = 0; i < rows; ++i ){
+        idx[i] = static_cast<time_t>( 1262304000 + 60*i );
+        px += 0.01 * ( std::rand() % 51 - 25 );
+        close[i] = px;
+    }
+    const std::vector<const double*> cols( 4, &close[0] );
+    const df::DataFrame<OHLC> frame = df::DataFrame<OHLC>::adopt( rows, std::shared_ptr<void>(), &idx[0], cols );
+    
+    features::FeatureMatrix<OHLC> fm;
+    for( size_t k = 0; k < nw; ++k )
+        fm.rolling_mean("close", windows[k]).rolling_std("close", windows[k]);
+    const size_t nc = fm.ncols();
+    
+    std::vector<double> col( rows * nc ), row( rows * nc );
+    fm.build( frame, &col[0], rows, features::COL_MAJOR, 4 );
+    fm.build( frame, &row[0], nc, features::ROW_MAJOR, 4 );
+    
+    for( size_t k = 0; k < nw; ++k ){
+        const size_t w = windows[k];
+        double worst = 0, apart = 0;
+        for( size_t i = 0; i < rows; ++i ){
+            double mean = std::numeric_limits<double>::quiet_NaN(), sd = mean;
+            if( i + 1 >= w )
+                two_pass( &close[0], i, w, mean, sd );
+            for( size_t j = 2*k; j < 2*k + 2; ++j ){
+                const double want = j == 2*k ? mean : sd;
+                const double c = col[j*rows + i], r = row[i*nc + j];
+                worst = std::max( worst, std::max( error(c, want), error(r, want) ) );
+                apart = std::max( apart, error(c, r) );
+            }
+        }
+        std::printf("window %lu: max error %.3g vs two-pass, %.3g between layouts\n",
+                    (unsigned long)w, worst, apart);
+        FEATURES_EXPECT( worst <= TOLERANCE );
+        FEATURES_EXPECT( apart <= TOLERANCE );
+    }
+    
+    std::printf("OK\n");
+    return 0;
+}
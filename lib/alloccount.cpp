@@ -0,0 +1,193 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+// Replaces the global allocation functions; link only into harness executables.
+
+#include <unistd.h>
+#include <atomic>
+#include <new>
+#include <cerrno>
+#include <cstring>
+
+#include "alloccount.hpp"
+
+using namespace alloccount;
+
+namespace {
+    
+    // plain TLS so counting works before and during thread startup
+    __thread uint64_t t_allocs = 0;
+    __thread uint64_t t_frees = 0;
+    __thread uint64_t t_bytes = 0;
+    __thread int t_forbid = 0;
+    
+    std::atomic<uint64_t> g_allocs(0);
+    std::atomic<uint64_t> g_frees(0);
+    std::atomic<uint64_t> g_bytes(0);
+    
+    void default_failure( size_t bytes ){
+        char msg[96];
+        const int n = std::snprintf(msg, sizeof(msg), "alloccount: allocation of %lu bytes inside Forbid\n",
+                                    static_cast<unsigned long>(bytes));
+        if( n > 0 && ::write(2, msg, static_cast<size_t>(n)) < 0 ) {}
+        std::abort();
+    }
+    
+    std::atomic<FailureHandler> g_handler( &default_failure );
+    
+    inline void count_alloc( size_t bytes ){
+        ++t_allocs;
+        t_bytes += bytes;
+        g_allocs.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        if( t_forbid ){
+            const int depth = t_forbid;
+            t_forbid = 0;               // the handler may allocate
+            g_handler.load()(bytes);
+            t_forbid = depth;
+        }
+    }
+    
+    inline void count_free( void* p ){
+        if( p ){
+            ++t_frees;
+            g_frees.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+Counts alloccount::thread_counts()
+{
+    Counts c = { t_allocs, t_frees, t_bytes };
+    return c;
+}
+
+Counts alloccount::global_counts()
+{
+    Counts c = { g_allocs.load(), g_frees.load(), g_bytes.load() };
+    return c;
+}
+
+void alloccount::set_failure_handler( FailureHandler handler )
+{
+    g_handler.store( handler ? handler : &default_failure );
+}
+
+void alloccount::forbid_enter() { ++t_forbid; }
+void alloccount::forbid_leave() { --t_forbid; }
+
+
+#ifdef __GLIBC__
+
+// glibc: wrap the malloc family, which also covers operator new and C code
+
+extern "C" {
+    
+    void* __libc_malloc( size_t );
+    void* __libc_calloc( size_t, size_t );
+    void* __libc_realloc( void*, size_t );
+    void* __libc_memalign( size_t, size_t );
+    void __libc_free( void* );
+    
+    void* malloc( size_t n ){
+        count_alloc(n);
+        return __libc_malloc(n);
+    }
+    
+    void* calloc( size_t k, size_t n ){
+        count_alloc(k * n);
+        return __libc_calloc(k, n);
+    }
+    
+    void* realloc( void* p, size_t n ){
+        count_alloc(n);
+        count_free(p);
+        return __libc_realloc(p, n);
+    }
+    
+    void* memalign( size_t align, size_t n ){
+        count_alloc(n);
+        return __libc_memalign(align, n);
+    }
+    
+    void* aligned_alloc( size_t align, size_t n ){
+        count_alloc(n);
+        return __libc_memalign(align, n);
+    }
+    
+    int posix_memalign( void** out, size_t align, size_t n ){
+        if( align < sizeof(void*) || (align & (align - 1)) )
+            return EINVAL;
+        count_alloc(n);
+        void* p = __libc_memalign(align, n);
+        if( !p )
+            return ENOMEM;
+        *out = p;
+        return 0;
+    }
+    
+    void free( void* p ){
+        count_free(p);
+        __libc_free(p);
+    }
+}
+
+#else
+
+// elsewhere: replace operator new/delete only
+
+void* operator new( size_t n ){
+    count_alloc(n);
+    if( void* p = std::malloc(n ? n : 1) )
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[]( size_t n ){
+    return operator new(n);
+}
+
+void* operator new( size_t n, const std::nothrow_t& ) throw() {
+    count_alloc(n);
+    return std::malloc(n ? n : 1);
+}
+
+void* operator new[]( size_t n, const std::nothrow_t& t ) throw() {
+    return operator new(n, t);
+}
+
+void operator delete( void* p ) throw() {
+    count_free(p);
+    std::free(p);
+}
+
+void operator delete[]( void* p ) throw() {
+    operator delete(p);
+}
+
+#endif
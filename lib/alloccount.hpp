@@ -0,0 +1,125 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * alloccount.hpp
+ *
+ * Design Overview:
+ *
+ * Allocation counting for benchmark and check harnesses. alloccount.cpp
+ * replaces the global allocation functions (malloc and friends on glibc,
+ * operator new/delete elsewhere) with versions that count calls and
+ * bytes per thread, so it must only be linked into harness executables,
+ * never into the library itself.
+ *
+ *     alloccount::Scope s;                     // count from here on
+ *     engine.run(src, strategy);
+ *     ALLOC_EXPECT( s.counts().allocations == 0 );
+ *
+ *     {
+ *         alloccount::Forbid f;                // any allocation on this thread fails
+ *         engine.run(src, strategy);
+ *     }
+ *
+ * Counts are per thread: a Scope sees only what its own thread allocated,
+ * which keeps unrelated threads (loggers, the profiler) out of the
+ * numbers. global_counts() sums over all threads.
+ *
+ */
+
+
+#ifndef backtester_alloccount_hpp
+#define backtester_alloccount_hpp
+
+//STL
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+
+namespace alloccount {
+    
+    struct Counts {
+        uint64_t allocations;
+        uint64_t deallocations;
+        uint64_t bytes;             // requested bytes, not including allocator overhead
+    };
+    
+    Counts thread_counts();         // calling thread, since it started
+    Counts global_counts();         // all threads, since the process started
+    
+    // called on an allocation inside a Forbid; the default prints and aborts
+    typedef void (*FailureHandler)( size_t bytes );
+    void set_failure_handler( FailureHandler handler );
+    
+    void forbid_enter();
+    void forbid_leave();
+    
+    
+    // counts allocations of the calling thread during its lifetime
+    class Scope {
+        
+    public:
+        Scope(): _start( thread_counts() ) {};
+        
+        Counts counts() const {
+            const Counts now = thread_counts();
+            Counts c = { now.allocations - _start.allocations,
+                         now.deallocations - _start.deallocations,
+                         now.bytes - _start.bytes };
+            return c;
+        }
+        
+        void reset() {
+            _start = thread_counts();
+        }
+        
+    private:
+        Counts _start;
+    };
+    
+    // makes any allocation by the calling thread a failure while alive; nests
+    class Forbid {
+        
+    public:
+        Forbid() { forbid_enter(); }
+        ~Forbid() { forbid_leave(); }
+        
+    private:
+        Forbid( const Forbid& );
+        Forbid& operator=( const Forbid& );
+    };
+    
+} // namespace alloccount
+
+
+// harness assertion, independent of DEBUG
+#define ALLOC_EXPECT(c) do {                                                        \
+if (!(c)) { std::fprintf(stderr, "ALLOC_EXPECT failure: %s at %s:%d\n", #c, __FILE__, __LINE__); \
+std::exit(1); }} while(0)
+
+
+#endif
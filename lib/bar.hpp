@@ -0,0 +1,158 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * bar.hpp
+ *
+ * Design Overview:
+ *
+ * Generic datapoint type for tables of any shape. A Bar is declared by
+ * listing field tags, and its layout, column names and field descriptors
+ * (see datapoint.hpp) all follow from that list at compile time:
+ *
+ *     typedef dp::Bar< tags::open, tags::high, tags::low, tags::close,
+ *                      tags::volume, tags::vwap, tags::trades > Bar7;
+ *
+ *     ts::TimeSeries<Bar7> series;
+ *     db.load(series, "es_1min");              // selects the seven columns by name
+ *     double v = bar.get<tags::vwap>();
+ *
+ * Each tag becomes a base class holding one member, so every field is a
+ * plain data member with a member pointer, and the loader, containers,
+ * CSV/native I/O and feature kernels handle a Bar exactly like the hand-
+ * written types, with no per-type code. New tags are declared with DP_TAG
+ * inside namespace datapoint::tags; the tag name is the column name.
+ *
+ */
+
+
+#ifndef backtester_bar_hpp
+#define backtester_bar_hpp
+
+//STL
+#include <vector>
+#include <cstddef>
+
+#include "datapoint.hpp"
+
+namespace datapoint {
+    
+    // FIELD TAGS
+    
+    namespace tags {
+        
+        #define DP_TAG(tag, T)                                                      \
+        struct tag {                                                                \
+            typedef T value_type;                                                   \
+            static constexpr const char* name() { return #tag; }                    \
+        };
+        
+        DP_TAG(open, double)
+        DP_TAG(high, double)
+        DP_TAG(low, double)
+        DP_TAG(close, double)
+        DP_TAG(volume, long long)
+        DP_TAG(vwap, double)
+        DP_TAG(trades, long long)
+        DP_TAG(open_interest, double)
+        DP_TAG(bid, double)
+        DP_TAG(ask, double)
+        
+    } // namespace tags
+    
+    
+    namespace detail {
+        
+        // storage of one field; Bar derives from one slot per tag
+        template<typename Tag> struct Slot {
+            Slot( typename Tag::value_type v = typename Tag::value_type() ): value(v) {};
+            typename Tag::value_type value;
+        };
+        
+        template<size_t I, typename Head, typename... Tail> struct nth {
+            typedef typename nth<I-1, Tail...>::type type;
+        };
+        
+        template<typename Head, typename... Tail> struct nth<0, Head, Tail...> {
+            typedef Head type;
+        };
+    }
+    
+    
+    // -----------------------------------------------------------------
+    // BAR TEMPLATE CLASS
+    // -----------------------------------------------------------------
+    
+    template<typename... Tags> struct Bar: public DataPoint, public detail::Slot<Tags>... {
+        
+        Bar( typename Tags::value_type... v ): detail::Slot<Tags>(v)... {};
+        
+        explicit Bar( const double* init ) // unchecked, tag ordering
+        :   Bar( dp_make< Bar >(init) )
+        {};
+        
+        Bar( const std::vector<double>& init ) // throws if too short
+        :   Bar( init.size() >= sizeof...(Tags) ? init.data() : throw DataPointException(1000) )
+        {};
+        
+        Bar( const Bar& ) = default;
+        Bar& operator=( Bar&& ) = default;
+        Bar& operator=( const Bar& ) = default;
+        
+        template<typename Tag> typename Tag::value_type& get() {
+            return static_cast< detail::Slot<Tag>& >(*this).value;
+        }
+        
+        template<typename Tag> const typename Tag::value_type& get() const {
+            return static_cast< const detail::Slot<Tag>& >(*this).value;
+        }
+    };
+    
+    
+    // DESCRIPTORS
+    
+    template<typename... Tags> struct field_count< Bar<Tags...> > {
+        static const size_t value = sizeof...(Tags);
+    };
+    
+    template<typename... Tags, size_t I> struct field< Bar<Tags...>, I > {
+        typedef typename detail::nth<I, Tags...>::type tag;
+        typedef typename tag::value_type type;
+        static constexpr const char* name() { return tag::name(); }
+        static constexpr type Bar<Tags...>::* member() { return &detail::Slot<tag>::value; }
+        static constexpr FieldType kind() { return field_type<type>::value; }
+    };
+    
+    
+    // COMMON SHAPES
+    
+    typedef Bar< tags::open, tags::high, tags::low, tags::close, tags::volume, tags::vwap, tags::trades > TradeBar;
+    typedef Bar< tags::open, tags::high, tags::low, tags::close, tags::volume, tags::open_interest > FuturesBar;
+    
+} // namespace datapoint
+
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <algorithm>
+
+#include "calendar.hpp"
+
+namespace {
+    
+    const size_t BLOCK = 256;
+    
+    // days since 0000-03-01, keeps every intermediate unsigned for years >= 0
+    const int64_t SHIFT = 719468;
+    
+    // splits a block of timestamps into days and seconds of day, branch free
+    void split_block( const time_t* __restrict t, size_t n, uint32_t* __restrict z, uint32_t* __restrict sod )
+    {
+        for( size_t i = 0; i < n; ++i ){
+            const int64_t x = static_cast<int64_t>(t[i]);
+            int64_t d = static_cast<int64_t>( static_cast<double>(x) * (1.0 / 86400.0) );   // truncates towards zero
+            int64_t s = x - d * 86400;
+            d -= ( s < 0 );                     // floor for negative timestamps and rounding below
+            s += ( s < 0 ) * 86400;
+            d += ( s >= 86400 );                // rounding above
+            s -= ( s >= 86400 ) * 86400;
+            z[i] = static_cast<uint32_t>( d + SHIFT );
+            sod[i] = static_cast<uint32_t>( s );
+        }
+    }
+}
+
+
+void calendar::decompose( const time_t* t, size_t n,
+                          int16_t* year, uint8_t* month, uint8_t* day,
+                          uint8_t* weekday, uint16_t* minute_of_day )
+{
+    uint32_t z[BLOCK], sod[BLOCK], y[BLOCK], m[BLOCK], d[BLOCK];
+    
+    for( size_t b = 0; b < n; b += BLOCK ){
+        
+        const size_t len = std::min(BLOCK, n - b);
+        split_block(t + b, len, z, sod);
+        
+        // civil_from_days, see utilities.hpp, on unsigned 32-bit lanes
+        for( size_t i = 0; i < len; ++i ){
+            const uint32_t era = z[i] / 146097;
+            const uint32_t doe = z[i] - era * 146097;
+            const uint32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+            const uint32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+            const uint32_t mp = (5*doy + 2) / 153;
+            d[i] = doy - (153*mp + 2)/5 + 1;
+            m[i] = mp < 10 ? mp + 3 : mp - 9;
+            y[i] = yoe + era * 400 + ( m[i] <= 2 );
+        }
+        
+        if( year )
+            for( size_t i = 0; i < len; ++i ) year[b+i] = static_cast<int16_t>(y[i]);
+        if( month )
+            for( size_t i = 0; i < len; ++i ) month[b+i] = static_cast<uint8_t>(m[i]);
+        if( day )
+            for( size_t i = 0; i < len; ++i ) day[b+i] = static_cast<uint8_t>(d[i]);
+        if( weekday )   // 0000-03-01 was a Wednesday
+            for( size_t i = 0; i < len; ++i ) weekday[b+i] = static_cast<uint8_t>( (z[i] + 3) % 7 );
+        if( minute_of_day )
+            for( size_t i = 0; i < len; ++i ) minute_of_day[b+i] = static_cast<uint16_t>( sod[i] / 60 );
+    }
+}
+
+
+calendar::Columns calendar::decompose( const time_t* t, size_t n )
+{
+    Columns c;
+    c.year.resize(n);
+    c.month.resize(n);
+    c.day.resize(n);
+    c.weekday.resize(n);
+    c.minute_of_day.resize(n);
+    
+    if( n )
+        decompose(t, n, &c.year[0], &c.month[0], &c.day[0], &c.weekday[0], &c.minute_of_day[0]);
+    return c;
+}
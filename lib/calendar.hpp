@@ -0,0 +1,114 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * calendar.hpp
+ *
+ * Design Overview:
+ *
+ * Bulk decomposition of a unix timestamp column into calendar fields
+ * (year, month, day, weekday, minute of day), for strategies and feature
+ * builders that would otherwise call bpt::from_time_t once per bar.
+ *
+ * The kernel works on blocks of timestamps with 32-bit, branch-free
+ * integer civil-from-days arithmetic (divisions by constants only), which
+ * the compiler turns into SIMD code. DataFrame<T> and TimeSeries<T> keep
+ * the result as lazily materialized calendar columns, see calendar().
+ *
+ * Supported range is years 0 to 9999; fields are computed in UTC.
+ *
+ */
+
+
+#ifndef backtester_calendar_hpp
+#define backtester_calendar_hpp
+
+//STL
+#include <vector>
+#include <ctime>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+namespace calendar {
+    
+    // CALENDAR COLUMNS
+    
+    struct Columns {
+        
+        std::vector<int16_t> year;
+        std::vector<uint8_t> month;             // [1,12]
+        std::vector<uint8_t> day;               // [1,31]
+        std::vector<uint8_t> weekday;           // 0 = Sunday
+        std::vector<uint16_t> minute_of_day;    // [0,1439]
+        
+        size_t size() const {
+            return year.size();
+        }
+        
+        size_t memory() const {                 // payload bytes
+            return size() * ( sizeof(int16_t) + 3*sizeof(uint8_t) + sizeof(uint16_t) );
+        }
+    };
+    
+    
+    // columns computed on first use, once however many threads ask; shared by
+    // copies of a container, replaced (not cleared) when its timestamps change
+    struct Cache {
+        
+        Cache(): once(), columns(), filled(false) {};
+        
+        template<typename F> const Columns& get( F compute ){
+            std::call_once( once, [&](){
+                columns = compute();
+                filled.store(true, std::memory_order_release);
+            });
+            return columns;
+        }
+        
+        size_t memory() const {                 // 0 until computed
+            return filled.load(std::memory_order_acquire) ? columns.memory() : 0;
+        }
+        
+        std::once_flag once;
+        Columns columns;
+        std::atomic<bool> filled;
+    };
+    
+    
+    // KERNELS
+    
+    // decomposes t[0..n) into the given output columns; null outputs are skipped
+    void decompose( const time_t* t, size_t n,
+                    int16_t* year, uint8_t* month, uint8_t* day,
+                    uint8_t* weekday, uint16_t* minute_of_day );
+    
+    Columns decompose( const time_t* t, size_t n );
+    
+} // namespace calendar
+
+
+#endif
@@ -0,0 +1,376 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * capi.cpp
+ *
+ */
+
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "capi.h"
+#include "dynframe.hpp"
+#include "native.hpp"
+#include "ipc.hpp"
+#include "csv.hpp"
+#include "tsdb.hpp"
+#include "registry.hpp"
+#include "sweep.hpp"
+#include "../strategies/breakout.hpp"
+
+namespace df = dataframe;
+
+struct tsdb_frame {
+    df::DynFrame frame;
+};
+
+
+namespace {
+    
+    static_assert( sizeof(tsdb_metrics) == sizeof(sweep::Metrics), "tsdb_metrics must mirror sweep::Metrics" );
+    static_assert( offsetof(tsdb_metrics, count) == offsetof(sweep::Metrics, count) &&
+                   offsetof(tsdb_metrics, wins) == offsetof(sweep::Metrics, wins) &&
+                   offsetof(tsdb_metrics, sum) == offsetof(sweep::Metrics, sum) &&
+                   offsetof(tsdb_metrics, sumsq) == offsetof(sweep::Metrics, sumsq) &&
+                   offsetof(tsdb_metrics, min) == offsetof(sweep::Metrics, min) &&
+                   offsetof(tsdb_metrics, max) == offsetof(sweep::Metrics, max),
+                   "tsdb_metrics must mirror sweep::Metrics field by field" );
+    static_assert( std::is_trivially_copyable<sweep::Metrics>::value, "metrics are copied with memcpy" );
+    static_assert( int(TSDB_INT32) == df::INT32 && int(TSDB_INT64) == df::INT64 &&
+                   int(TSDB_FLOAT64) == df::FLOAT64 && int(TSDB_STRING) == df::STRING,
+                   "tsdb_type must mirror dataframe::ColumnType" );
+    
+    thread_local std::string last_error;
+    
+    // an error with the status to return
+    struct Failure {
+        tsdb_status status;
+        std::string message;
+    };
+    
+    void fail( tsdb_status status, const std::string& message ){
+        Failure f = { status, message };
+        throw f;
+    }
+    
+    // runs f, turning any exception into a status and the thread's last error
+    template<typename F> int guarded( F f ){
+        try {
+            f();
+            last_error.clear();
+            return TSDB_OK;
+        }
+        catch( const Failure& e ){
+            last_error = e.message;
+            return e.status;
+        }
+        catch( const native::NativeException& e ){ last_error = e.what(); }
+        catch( const ipc::IpcException& e ){ last_error = e.what(); }
+        catch( const csv::CsvException& e ){ last_error = e.what(); }
+        catch( const tsdb::TSDBInterfaceException& e ){ last_error = e.what(); }
+        catch( const std::exception& e ){
+            last_error = e.what();
+            return TSDB_ERR_FAILED;
+        }
+        catch( ... ){
+            last_error = "Unknown exception.";
+            return TSDB_ERR_FAILED;
+        }
+        return TSDB_ERR_IO;
+    }
+    
+    // a whole number from least to UINT_MAX, so it converts to unsigned exactly
+    void count( double v, const char* what, unsigned least ){
+        if( !( std::isfinite(v) && v == std::floor(v) && v >= least && v <= double(UINT_MAX) ) ){
+            std::ostringstream msg;
+            msg << what << " must be a whole number from " << least << " to " << UINT_MAX << ", got " << v << ".";
+            fail( TSDB_ERR_ARGUMENT, msg.str() );
+        }
+    }
+    
+    void builtins(){
+        static std::once_flag once;
+        std::call_once( once, [](){
+            const registry::Runner breakout = registry::pool_runner< datapoint::OHLC, strategies::Breakout<datapoint::OHLC> >(
+                []( const sweep::Params& p ){
+                    return strategies::Breakout<datapoint::OHLC>( unsigned(p[0]), unsigned(p[1]) );
+                } );
+            
+            // every vector is checked before any strategy is built
+            registry::add( "breakout", 2, "Breakout-pullback long entry on OHLC bars; params: lookback >= 1, hold",
+                [breakout]( const df::DynFrame& frame, const std::vector<sweep::Params>& grid ){
+                    for( size_t k = 0; k < grid.size(); ++k ){
+                        count( grid[k][0], "lookback", 1 );
+                        count( grid[k][1], "hold", 0 );
+                    }
+                    return breakout( frame, grid );
+                } );
+        });
+    }
+    
+    tsdb_format detect( const std::string& path ){
+        char magic[8] = {};
+        FILE* f = std::fopen( path.c_str(), "rb" );
+        if( !f )
+            fail( TSDB_ERR_IO, "Could not open "+path+"." );
+        const size_t n = std::fread( magic, 1, sizeof(magic), f );
+        std::fclose(f);
+        
+        uint64_t word = 0;
+        std::memcpy( &word, magic, n );
+        if( n == 8 && word == native::MAGIC )
+            return TSDB_FORMAT_NATIVE;
+        if( ( n >= 6 && std::memcmp( magic, "ARROW1", 6 ) == 0 ) || ( n >= 4 && std::memcmp( magic, "\xff\xff\xff\xff", 4 ) == 0 ) )
+            return TSDB_FORMAT_ARROW;
+        return TSDB_FORMAT_CSV;
+    }
+    
+    void describe( const df::Column& c, size_t rows, tsdb_column* out ){
+        out->name = c.name.c_str();
+        out->type = c.type;
+        out->data = c.data;
+        out->offsets = c.offsets;
+        out->length = rows;
+        out->stride = c.type == df::INT32 ? 4 : c.type == df::STRING ? 0 : 8;
+    }
+    
+    void check( const void* p, const char* what ){
+        if( !p )
+            fail( TSDB_ERR_ARGUMENT, std::string(what)+" is NULL." );
+    }
+}
+
+
+uint32_t tsdb_abi_version( void )
+{
+    return TSDB_ABI_VERSION;
+}
+
+const char* tsdb_last_error( void )
+{
+    return last_error.c_str();
+}
+
+
+// DATASETS
+
+int tsdb_open( const char* path, int32_t format, tsdb_frame** out )
+{
+    return guarded( [&](){
+        check( path, "path" );
+        check( out, "out" );
+        *out = NULL;
+        
+        if( format == TSDB_FORMAT_AUTO )
+            format = detect(path);
+        
+        std::unique_ptr<tsdb_frame> f( new tsdb_frame() );
+        switch( format ){
+            case TSDB_FORMAT_NATIVE:    f->frame = native::read(path); break;
+            case TSDB_FORMAT_ARROW:     f->frame = ipc::read(path); break;
+            case TSDB_FORMAT_CSV:       f->frame = csv::read_frame(path); break;
+            default:                    fail( TSDB_ERR_ARGUMENT, "Unknown format." );
+        }
+        *out = f.release();
+    });
+}
+
+int tsdb_load( const char* user, const char* password, const char* table,
+               const char* start, const char* end, tsdb_frame** out )
+{
+    return guarded( [&](){
+        check( user, "user" );
+        check( password, "password" );
+        check( table, "table" );
+        check( out, "out" );
+        *out = NULL;
+        
+        const bpt::ptime from = start ? bpt::time_from_string(start) : bpt::ptime();
+        const bpt::ptime to = end ? bpt::time_from_string(end) : bpt::ptime();
+        
+        std::unique_ptr<tsdb_frame> f( new tsdb_frame() );
+        tsdb::Interface db( user, password );
+        db.load( f->frame, table, from, to );
+        *out = f.release();
+    });
+}
+
+void tsdb_frame_free( tsdb_frame* frame )
+{
+    delete frame;
+}
+
+uint64_t tsdb_frame_rows( const tsdb_frame* frame )
+{
+    return frame ? frame->frame.size() : 0;
+}
+
+uint64_t tsdb_frame_ncols( const tsdb_frame* frame )
+{
+    return frame ? frame->frame.ncols() : 0;
+}
+
+const char* tsdb_frame_meta( const tsdb_frame* frame )
+{
+    return frame ? frame->frame.meta().c_str() : "";
+}
+
+int tsdb_frame_index( const tsdb_frame* frame, tsdb_column* out )
+{
+    return guarded( [&](){
+        check( frame, "frame" );
+        check( out, "out" );
+        out->name = "date_time";
+        out->type = TSDB_INT64;
+        out->data = frame->frame.index();
+        out->offsets = NULL;
+        out->length = frame->frame.size();
+        out->stride = sizeof(time_t);
+    });
+}
+
+int tsdb_frame_column( const tsdb_frame* frame, uint64_t i, tsdb_column* out )
+{
+    return guarded( [&](){
+        check( frame, "frame" );
+        check( out, "out" );
+        if( i >= frame->frame.ncols() )
+            fail( TSDB_ERR_NOT_FOUND, "Column index out of range." );
+        describe( frame->frame.column(i), frame->frame.size(), out );
+    });
+}
+
+int tsdb_frame_find( const tsdb_frame* frame, const char* name, tsdb_column* out )
+{
+    return guarded( [&](){
+        check( frame, "frame" );
+        check( name, "name" );
+        check( out, "out" );
+        const df::Column* c = frame->frame.find_column(name);
+        if( !c )
+            fail( TSDB_ERR_NOT_FOUND, std::string("No column ")+name+"." );
+        describe( *c, frame->frame.size(), out );
+    });
+}
+
+
+// STRATEGIES
+
+uint64_t tsdb_strategy_count( void )
+{
+    builtins();
+    return registry::count();
+}
+
+const char* tsdb_strategy_name( uint64_t i )
+{
+    builtins();
+    const registry::Entry* e = registry::at(i);
+    return e ? e->name.c_str() : NULL;
+}
+
+const char* tsdb_strategy_description( const char* name )
+{
+    builtins();
+    const registry::Entry* e = name ? registry::find(name) : NULL;
+    return e ? e->description.c_str() : NULL;
+}
+
+int64_t tsdb_strategy_nparams( const char* name )
+{
+    builtins();
+    const registry::Entry* e = name ? registry::find(name) : NULL;
+    return e ? int64_t(e->nparams) : int64_t(TSDB_ERR_NOT_FOUND);
+}
+
+int tsdb_run( const tsdb_frame* frame, const char* strategy,
+              const double* params, uint64_t nparams, uint64_t npoints,
+              tsdb_metrics* out )
+{
+    return guarded( [&](){
+        builtins();
+        check( frame, "frame" );
+        check( strategy, "strategy" );
+        if( npoints && ( !out || ( nparams && !params ) ) )
+            fail( TSDB_ERR_ARGUMENT, "params or out is NULL." );
+        
+        const registry::Entry* e = registry::find(strategy);
+        if( !e )
+            fail( TSDB_ERR_NOT_FOUND, std::string("Unknown strategy ")+strategy+"." );
+        if( nparams != e->nparams )
+            fail( TSDB_ERR_ARGUMENT, "Strategy "+e->name+" takes "+std::to_string(e->nparams)+" parameters." );
+        
+        std::vector<sweep::Params> grid( npoints );
+        for( size_t k = 0; k < npoints; ++k )
+            grid[k].assign( params + k*nparams, params + (k+1)*nparams );
+        
+        const std::vector<sweep::Metrics> result = e->run( frame->frame, grid );
+        if( result.size() != npoints )
+            fail( TSDB_ERR_FAILED, "Strategy "+e->name+" returned the wrong number of results." );
+        if( npoints )
+            std::memcpy( out, &result[0], npoints * sizeof(tsdb_metrics) );
+    });
+}
+
+
+// METRICS
+
+namespace {
+    
+    // a copy rather than a cast: the two types only share a layout, so
+    // reading one through the other would break strict aliasing
+    sweep::Metrics metrics( const tsdb_metrics* m ){
+        sweep::Metrics r;
+        std::memcpy( static_cast<void*>(&r), m, sizeof(r) );
+        return r;
+    }
+}
+
+void tsdb_metrics_init( tsdb_metrics* m )
+{
+    const sweep::Metrics empty;
+    std::memcpy( m, &empty, sizeof(*m) );
+}
+
+void tsdb_metrics_merge( tsdb_metrics* into, const tsdb_metrics* m )
+{
+    sweep::Metrics acc = metrics(into);
+    acc.merge( metrics(m) );
+    std::memcpy( into, &acc, sizeof(*into) );
+}
+
+double tsdb_metrics_mean( const tsdb_metrics* m )       { return metrics(m).mean(); }
+double tsdb_metrics_stdev( const tsdb_metrics* m )      { return metrics(m).stdev(); }
+double tsdb_metrics_sharpe( const tsdb_metrics* m )     { return metrics(m).sharpe(); }
+double tsdb_metrics_hit_rate( const tsdb_metrics* m )   { return metrics(m).hit_rate(); }
@@ -0,0 +1,166 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * capi.h
+ *
+ * Design Overview:
+ *
+ * Stable C interface for embedding the backtester in other runtimes
+ * (Python via ctypes/cffi, Julia, R, job schedulers) in-process. Only
+ * plain C types cross the boundary; frames are opaque handles.
+ *
+ * Datasets are opened from native, Arrow IPC or CSV files, or loaded
+ * from the TSDB, into a frame. Column accessors hand out the frame's own
+ * buffers: a data pointer, the number of values and the stride in bytes
+ * between consecutive values, so callers can wrap them (e.g. as numpy
+ * arrays) without copying. The pointers stay valid until the frame is
+ * freed; the data is read-only.
+ *
+ * Strategies registered in the registry (see registry.hpp; "breakout" is
+ * built in) run by name over a frame, for one or many parameter vectors,
+ * and return one metrics accumulator per parameter vector. Accumulators
+ * can be merged across runs.
+ *
+ * Functions returning int return TSDB_OK or a negative tsdb_status; the
+ * message of the calling thread's last error is tsdb_last_error().
+ * No exception crosses the interface.
+ *
+ * The layout of every struct below is part of the ABI: fields are only
+ * ever appended, and TSDB_ABI_VERSION is bumped when that happens.
+ *
+ */
+
+
+#ifndef backtester_capi_h
+#define backtester_capi_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TSDB_ABI_VERSION 1
+
+typedef enum {
+    TSDB_OK = 0,
+    TSDB_ERR_ARGUMENT = -1,     /* NULL handle or output, bad parameter count or value */
+    TSDB_ERR_NOT_FOUND = -2,    /* unknown column or strategy */
+    TSDB_ERR_IO = -3,           /* file or database could not be read */
+    TSDB_ERR_FAILED = -4        /* anything else, see tsdb_last_error() */
+} tsdb_status;
+
+typedef enum {                  /* same values as dataframe::ColumnType */
+    TSDB_INT32 = 0,
+    TSDB_INT64 = 1,
+    TSDB_FLOAT64 = 2,
+    TSDB_STRING = 3
+} tsdb_type;
+
+typedef enum {
+    TSDB_FORMAT_AUTO = 0,       /* from the file's magic bytes, else CSV */
+    TSDB_FORMAT_NATIVE = 1,
+    TSDB_FORMAT_ARROW = 2,      /* IPC file or stream */
+    TSDB_FORMAT_CSV = 3         /* with a header line; columns as float64 */
+} tsdb_format;
+
+typedef struct tsdb_frame tsdb_frame;
+
+typedef struct {
+    const char* name;           /* owned by the frame */
+    int32_t type;               /* tsdb_type */
+    const void* data;           /* values; characters for TSDB_STRING */
+    const int32_t* offsets;     /* TSDB_STRING: length+1 offsets into data, else NULL */
+    uint64_t length;            /* number of values */
+    uint64_t stride;            /* bytes between consecutive values; 0 for TSDB_STRING */
+} tsdb_column;
+
+typedef struct {                /* same layout as sweep::Metrics */
+    uint64_t count;
+    uint64_t wins;
+    double sum, sumsq, min, max;
+} tsdb_metrics;
+
+
+uint32_t tsdb_abi_version( void );
+
+/* message of the last failed call on this thread, "" if none; valid until the next call */
+const char* tsdb_last_error( void );
+
+
+/* DATASETS */
+
+int tsdb_open( const char* path, int32_t format, tsdb_frame** out );
+
+/* every column of a TSDB table; start and end as "YYYY-MM-DD HH:MM:SS", or NULL for unbounded */
+int tsdb_load( const char* user, const char* password, const char* table,
+               const char* start, const char* end, tsdb_frame** out );
+
+void tsdb_frame_free( tsdb_frame* frame );     /* NULL is ignored */
+
+uint64_t tsdb_frame_rows( const tsdb_frame* frame );
+uint64_t tsdb_frame_ncols( const tsdb_frame* frame );
+const char* tsdb_frame_meta( const tsdb_frame* frame );
+
+/* unix seconds, one per row */
+int tsdb_frame_index( const tsdb_frame* frame, tsdb_column* out );
+
+int tsdb_frame_column( const tsdb_frame* frame, uint64_t i, tsdb_column* out );
+int tsdb_frame_find( const tsdb_frame* frame, const char* name, tsdb_column* out );
+
+
+/* STRATEGIES */
+
+uint64_t tsdb_strategy_count( void );
+const char* tsdb_strategy_name( uint64_t i );          /* NULL if out of range */
+const char* tsdb_strategy_description( const char* name );
+int64_t tsdb_strategy_nparams( const char* name );     /* or a negative tsdb_status */
+
+/* runs strategy over frame for npoints parameter vectors of nparams values each,
+ * stored one after the other in params; writes npoints accumulators to out.
+ * Returns TSDB_ERR_ARGUMENT, before running anything, if a parameter is out
+ * of the strategy's range (for "breakout", whole numbers with lookback >= 1) */
+int tsdb_run( const tsdb_frame* frame, const char* strategy,
+              const double* params, uint64_t nparams, uint64_t npoints,
+              tsdb_metrics* out );
+
+
+/* METRICS */
+
+void tsdb_metrics_init( tsdb_metrics* m );
+void tsdb_metrics_merge( tsdb_metrics* into, const tsdb_metrics* m );
+double tsdb_metrics_mean( const tsdb_metrics* m );
+double tsdb_metrics_stdev( const tsdb_metrics* m );
+double tsdb_metrics_sharpe( const tsdb_metrics* m );   /* per period, not annualized */
+double tsdb_metrics_hit_rate( const tsdb_metrics* m );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,520 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "csv.hpp"
+#include "macros.hpp"
+
+using namespace csv;
+
+// EXCEPTIONS
+
+CsvException::CsvException(const std::string& message):_msg(_spec + message){};
+CsvException::~CsvException() throw(){};
+
+const char* CsvException::what() const throw() {return _msg.c_str(); }
+const std::string CsvException::_spec = "CSV Exception: ";
+
+
+// FILE MAPPING
+
+MappedFile::MappedFile( const std::string& path )
+:   _data(NULL),
+    _size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if( fd < 0 )
+        throw CsvException("Could not open "+path+".");
+    
+    struct stat st;
+    if( fstat(fd, &st) != 0 ){
+        close(fd);
+        throw CsvException("Could not stat "+path+".");
+    }
+    
+    _size = static_cast<size_t>(st.st_size);
+    
+    if( _size ){
+        void* p = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if( p == MAP_FAILED ){
+            close(fd);
+            throw CsvException("Could not map "+path+".");
+        }
+        madvise(p, _size, MADV_SEQUENTIAL);
+        df::advise_hugepages(p, _size);
+        _data = static_cast<const char*>(p);
+    }
+    close(fd);
+}
+
+
+MappedFile::~MappedFile()
+{
+    if( _data )
+        munmap( const_cast<char*>(_data), _size );
+}
+
+
+// SCANNING
+
+const char* csv::find_field_end( const char* p, const char* end, char delim )
+{
+#ifdef __SSE2__
+    const __m128i d = _mm_set1_epi8(delim);
+    const __m128i nl = _mm_set1_epi8('\n');
+    
+    for( ; p + 16 <= end; p += 16 ){
+        const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p) );
+        const int m = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8(v, d), _mm_cmpeq_epi8(v, nl) ) );
+        if( m )
+            return p + __builtin_ctz(m);
+    }
+#endif
+    while( p < end && *p != delim && *p != '\n' )
+        ++p;
+    return p;
+}
+
+
+size_t csv::count_lines( const char* p, const char* end )
+{
+    size_t n = 0;
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    
+    for( ; p + 16 <= end; p += 16 ){
+        const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p) );
+        n += __builtin_popcount( _mm_movemask_epi8( _mm_cmpeq_epi8(v, nl) ) );
+    }
+#endif
+    for( ; p < end; ++p )
+        n += ( *p == '\n' );
+    return n;
+}
+
+
+// NUMBER PARSING
+
+namespace {
+    
+    const double POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    
+    bool is_digit( char c ){
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+    
+    bool parse_slow( const char* p, const char* end, double& out ){
+        char buf[128];
+        const size_t len = static_cast<size_t>(end - p);
+        if( len >= sizeof(buf) )
+            return false;
+        std::memcpy(buf, p, len);
+        buf[len] = 0;
+        char* stop = NULL;
+        out = std::strtod(buf, &stop);
+        return stop == buf + len;
+    }
+}
+
+
+bool csv::parse_double( const char* p, const char* end, double& out )
+{
+    if( p == end ){
+        out = std::numeric_limits<double>::quiet_NaN();   // empty field
+        return true;
+    }
+    
+    const char* s = p;
+    const bool neg = ( *s == '-' );
+    if( *s == '-' || *s == '+' )
+        ++s;
+    
+    uint64_t m = 0;
+    int digits = 0, exp10 = 0;
+    bool any = false, truncated = false;
+    
+    for( ; s < end && is_digit(*s); ++s, any = true ){
+        if( digits < 19 ){
+            m = m*10 + static_cast<unsigned>(*s - '0');
+            digits += ( m != 0 );
+        }
+        else {
+            ++exp10;
+            truncated |= ( *s != '0' );
+        }
+    }
+    
+    if( s < end && *s == '.' ){
+        for( ++s; s < end && is_digit(*s); ++s, any = true ){
+            if( digits < 19 ){
+                m = m*10 + static_cast<unsigned>(*s - '0');
+                digits += ( m != 0 );
+                --exp10;
+            }
+            else
+                truncated |= ( *s != '0' );
+        }
+    }
+    
+    if( any && s < end && ( *s == 'e' || *s == 'E' ) ){
+        ++s;
+        const bool eneg = ( s < end && *s == '-' );
+        if( s < end && ( *s == '-' || *s == '+' ) )
+            ++s;
+        int e = 0;
+        bool edigits = false;
+        for( ; s < end && is_digit(*s); ++s, edigits = true )
+            e = std::min(e*10 + (*s - '0'), 100000);
+        if( !edigits )
+            return false;
+        exp10 += eneg ? -e : e;
+    }
+    
+    // exact when the mantissa and the power of ten are both representable
+    if( any && s == end && !truncated && m <= (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22 ){
+        double v = static_cast<double>(m);
+        v = exp10 < 0 ? v / POW10[-exp10] : v * POW10[exp10];
+        out = neg ? -v : v;
+        return true;
+    }
+    
+    return parse_slow(p, end, out);
+}
+
+
+bool csv::parse_timestamp( const char* p, const char* end, time_t& out )
+{
+    const char* s = ( p < end && *p == '-' ) ? p+1 : p;
+    
+    if( s < end && std::all_of(s, end, is_digit) ){  // unix seconds
+        long long v = 0;
+        for( ; s < end; ++s )
+            v = v*10 + (*s - '0');
+        out = static_cast<time_t>( *p == '-' ? -v : v );
+        return true;
+    }
+    
+    if( utilities::parse_datetime(p, static_cast<size_t>(end - p), out) )
+        return true;
+    
+    try {
+        out = utilities::str_to_time_t( std::string(p, end) );
+        return true;
+    }
+    catch( std::exception& e ){
+        return false;
+    }
+}
+
+
+// FILE PARSING
+
+namespace {
+    
+    const int SKIP = -1;
+    const int TIME = -2;
+    
+    const char* trim_cr( const char* p, const char* q ){
+        return ( q > p && q[-1] == '\r' ) ? q-1 : q;
+    }
+    
+    std::string unquote( std::string s ){
+        s.erase(0, s.find_first_not_of(" \t\"\r"));
+        s.erase(s.find_last_not_of(" \t\"\r") + 1);
+        return s;
+    }
+    
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        size_t offset;          // first output row
+        size_t rows;            // rows actually parsed
+        std::string error;
+    };
+    
+    void parse_chunk( Chunk& c, char delim, const std::vector<int>& target, size_t needed,
+                      time_t* idx, const std::vector<double*>& cols )
+    {
+        const char* p = c.begin;
+        size_t row = c.offset;
+        
+        while( p < c.end ){
+            
+            // blank line
+            if( *p == '\n' || ( *p == '\r' && p+1 < c.end && p[1] == '\n' ) ){
+                p += ( *p == '\r' ) ? 2 : 1;
+                continue;
+            }
+            
+            size_t field = 0, found = 0;
+            
+            while( true ){
+                const char* q = find_field_end(p, c.end, delim);
+                const char* fe = trim_cr(p, q);
+                
+                const int t = field < target.size() ? target[field] : SKIP;
+                bool ok = true;
+                
+                if( t == TIME )
+                    ok = parse_timestamp(p, fe, idx[row]);
+                else if( t >= 0 )
+                    ok = parse_double(p, fe, cols[t][row]);
+                
+                if( !ok ){
+                    c.error = "Malformed field \"" + std::string(p, fe) + "\".";
+                    return;
+                }
+                
+                found += ( t != SKIP );
+                ++field;
+                p = q + 1;
+                
+                if( q == c.end || *q == '\n' )
+                    break;
+            }
+            
+            if( found != needed ){
+                c.error = "Row with missing fields.";
+                return;
+            }
+            ++row;
+        }
+        
+        c.rows = row - c.offset;
+    }
+    
+    template<typename F> void parallel( size_t n, F f ){
+        std::vector<std::thread> pool;
+        for( size_t i = 1; i < n; ++i )
+            pool.push_back( std::thread(f, i) );
+        f(0);
+        for( size_t i = 0; i < pool.size(); ++i )
+            pool[i].join();
+    }
+}
+
+
+size_t csv::parse_file( const MappedFile& file, const Options& opts, const std::vector<std::string>& columns,
+                        std::shared_ptr<void>* block, const time_t** index, std::vector<const double*>& cols )
+{
+    PROFILE_SCOPE("csv.parse_file");
+    
+    const char* p = file.data();
+    const char* end = p + file.size();
+    const size_t ncols = columns.size();
+    
+    // map CSV fields to columns
+    std::vector<int> target;
+    
+    if( opts.header ){
+        
+        const char* eol = p ? static_cast<const char*>( std::memchr(p, '\n', file.size()) ) : NULL;
+        if( !eol )
+            eol = end;
+        
+        bool has_time = false;
+        for( const char* f = p; f && f <= eol; ){
+            const char* q = find_field_end(f, eol, opts.delimiter);
+            const std::string name = unquote( std::string(f, q) );
+            const std::vector<std::string>::const_iterator it = std::find(columns.begin(), columns.end(), name);
+            
+            if( name == opts.time_column ){
+                target.push_back(TIME);
+                has_time = true;
+            }
+            else
+                target.push_back( it == columns.end() ? SKIP : static_cast<int>(it - columns.begin()) );
+            
+            f = q + 1;
+        }
+        
+        if( !has_time ){
+            if( target.empty() || target[0] != SKIP )
+                throw CsvException("No timestamp column.");
+            target[0] = TIME;
+        }
+        
+        for( size_t j = 0; j < ncols; ++j )
+            if( std::find(target.begin(), target.end(), static_cast<int>(j)) == target.end() )
+                throw CsvException("Missing column "+columns[j]+".");
+        
+        p = ( eol < end ) ? eol + 1 : end;
+    }
+    else {
+        target.push_back(TIME);
+        for( size_t j = 0; j < ncols; ++j )
+            target.push_back( static_cast<int>(j) );
+    }
+    
+    // split the body into line-aligned chunks and size them
+    const size_t body = static_cast<size_t>(end - p);
+    const size_t nthreads = std::max<size_t>(1, std::min<size_t>( opts.threads ? opts.threads : std::thread::hardware_concurrency(),
+                                                                  body / (1 << 20) + 1 ));
+    std::vector<Chunk> chunks(nthreads);
+    
+    for( size_t k = 0; k < nthreads; ++k ){
+        const char* b = ( k == 0 ) ? p : chunks[k-1].end;
+        const char* e = ( k+1 == nthreads ) ? end : std::max(b, p + body * (k+1) / nthreads);
+        if( e < end ){
+            const char* nl = static_cast<const char*>( std::memchr(e, '\n', static_cast<size_t>(end - e)) );
+            e = nl ? nl + 1 : end;
+        }
+        chunks[k].begin = b;
+        chunks[k].end = e;
+        chunks[k].rows = 0;
+    }
+    
+    std::vector<size_t> lines(nthreads);
+    parallel( nthreads, [&]( size_t k ){
+        PROFILE_SCOPE("csv.count_lines");
+        lines[k] = count_lines(chunks[k].begin, chunks[k].end);
+        if( chunks[k].end > chunks[k].begin && chunks[k].end[-1] != '\n' )
+            ++lines[k];
+    });
+    
+    size_t capacity = 0;
+    for( size_t k = 0; k < nthreads; ++k ){
+        chunks[k].offset = capacity;
+        capacity += lines[k];
+    }
+    
+    // parse every chunk straight into its rows of the final block
+    const size_t stride = df::padded_stride(capacity);
+    *block = df::allocate_block( df::block_size(capacity, ncols) );
+    time_t* idx = static_cast<time_t*>( block->get() );
+    std::vector<double*> out;
+    for( size_t j = 0; j < ncols; ++j )
+        out.push_back( reinterpret_cast<double*>(idx + stride) + j*stride );
+    
+    parallel( nthreads, [&]( size_t k ){
+        PROFILE_SCOPE("csv.parse_chunk");
+        parse_chunk(chunks[k], opts.delimiter, target, ncols + 1, idx, out);
+    });
+    
+    // close gaps left by blank lines, in order
+    size_t rows = 0;
+    for( size_t k = 0; k < nthreads; ++k ){
+        if( !chunks[k].error.empty() )
+            throw CsvException(chunks[k].error);
+        if( rows != chunks[k].offset ){
+            std::memmove(idx + rows, idx + chunks[k].offset, chunks[k].rows * sizeof(time_t));
+            for( size_t j = 0; j < ncols; ++j )
+                std::memmove(out[j] + rows, out[j] + chunks[k].offset, chunks[k].rows * sizeof(double));
+        }
+        rows += chunks[k].rows;
+    }
+    
+    // order by timestamp if the file is not sorted already
+    if( !std::is_sorted(idx, idx + rows) ){
+        
+        PROFILE_SCOPE("csv.sort");
+        std::vector<size_t> perm(rows);
+        std::iota(perm.begin(), perm.end(), 0);
+        std::stable_sort(perm.begin(), perm.end(), [idx]( size_t a, size_t b ){ return idx[a] < idx[b]; });
+        
+        std::shared_ptr<void> sorted = df::allocate_block( df::block_size(rows, ncols) );
+        const size_t s2 = df::padded_stride(rows);
+        time_t* idx2 = static_cast<time_t*>( sorted.get() );
+        double* cols2 = reinterpret_cast<double*>(idx2 + s2);
+        
+        parallel( std::min<size_t>(nthreads, ncols + 1), [&]( size_t k ){
+            for( size_t j = k; j <= ncols; j += std::min<size_t>(nthreads, ncols + 1) ){
+                if( j == ncols )
+                    for( size_t i = 0; i < rows; ++i ) idx2[i] = idx[perm[i]];
+                else
+                    for( size_t i = 0; i < rows; ++i ) cols2[j*s2 + i] = out[j][perm[i]];
+            }
+        });
+        
+        *block = sorted;
+        idx = idx2;
+        for( size_t j = 0; j < ncols; ++j )
+            out[j] = cols2 + j*s2;
+    }
+    
+    PROFILE_COUNT("csv.rows", rows);
+    
+    *index = idx;
+    cols.assign(out.begin(), out.end());
+    return rows;
+}
+
+
+df::DynFrame csv::read_frame( const std::string& path, const Options& opts )
+{
+    if( !opts.header )
+        throw CsvException("Reading "+path+" without a type needs a header line.");
+    
+    MappedFile file(path);
+    const char* p = file.data();
+    const char* end = p + file.size();
+    const char* eol = p ? static_cast<const char*>( std::memchr(p, '\n', file.size()) ) : NULL;
+    if( !eol )
+        eol = end;
+    
+    // every field but the time column, which is the named one or else the first
+    std::vector<std::string> fields;
+    for( const char* f = p; f && f <= eol; ){
+        const char* q = find_field_end(f, eol, opts.delimiter);
+        fields.push_back( unquote( std::string(f, q) ) );
+        f = q + 1;
+    }
+    std::vector<std::string>::iterator time = std::find(fields.begin(), fields.end(), opts.time_column);
+    if( time == fields.end() && !fields.empty() )
+        time = fields.begin();
+    if( time != fields.end() )
+        fields.erase(time);
+    
+    std::shared_ptr<void> block;
+    const time_t* index = NULL;
+    std::vector<const double*> cols;
+    const size_t rows = parse_file(file, opts, fields, &block, &index, cols);
+    
+    std::vector<df::Column> columns;
+    for( size_t j = 0; j < fields.size(); ++j ){
+        df::Column c = { fields[j], df::FLOAT64, cols[j], NULL };
+        columns.push_back(c);
+    }
+    return df::DynFrame::adopt(rows, block, index, columns, path);
+}
@@ -0,0 +1,176 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * csv.hpp
+ *
+ * Design Overview:
+ *
+ * High-throughput CSV reader for vendor files, loading straight into
+ * DataFrame<T> or TimeSeries<T> without going through the TSDB.
+ *
+ * The file is memory mapped and split into one chunk per thread at line
+ * boundaries. A first pass counts lines per chunk (SIMD newline scan) so
+ * that the DataFrame block can be allocated once; the second pass parses
+ * every chunk in parallel straight into its final rows. Field boundaries
+ * are found 16 bytes at a time with SSE2 where available, and numbers are
+ * parsed with an exact fast path (Clinger) that falls back to strtod only
+ * for long mantissas or large exponents.
+ *
+ * The first column (or the column named by Options::time_column) holds
+ * timestamps, either as date-time strings or as integer unix seconds.
+ * With a header line, value columns are matched to dp_names<T>() by name,
+ * otherwise they are assumed to follow the time column in that order.
+ * Rows are sorted by timestamp if the file is not already ordered.
+ * Timestamps in the standard format are decoded by utilities::parse_datetime
+ * without allocating; anything else falls back to boost.
+ *
+ */
+
+
+#ifndef backtester_csv_hpp
+#define backtester_csv_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "dynframe.hpp"
+#include "utilities.hpp"
+
+namespace dp = datapoint;
+namespace ts = timeseries;
+namespace df = dataframe;
+
+namespace csv {
+    
+    // EXCEPTIONS
+    
+    class CsvException: public std::exception {
+        
+    public:
+        CsvException(const std::string& message);
+        ~CsvException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    struct Options {
+        
+        Options()
+        :   delimiter(','),
+            header(true),
+            threads(0),
+            time_column("date_time")
+        {};
+        
+        char delimiter;
+        bool header;                // first line holds column names
+        unsigned threads;           // 0 = one per core
+        std::string time_column;    // name of the timestamp column; first column if not found
+    };
+    
+    
+    // READ-ONLY FILE MAPPING
+    
+    class MappedFile: private utilities::Uncopyable {
+        
+    public:
+        explicit MappedFile( const std::string& path );    // throws
+        ~MappedFile();
+        
+        const char* data() const { return _data; }
+        size_t size() const { return _size; }
+        
+    private:
+        const char* _data;
+        size_t _size;
+    };
+    
+    
+    // SCANNING AND NUMBER PARSING PRIMITIVES
+    
+    // first occurrence of delim or '\n' in [p,end), end if none
+    const char* find_field_end( const char* p, const char* end, char delim );
+    
+    // number of '\n' in [p,end)
+    size_t count_lines( const char* p, const char* end );
+    
+    // parses a decimal floating point number spanning exactly [p,end); false if malformed
+    bool parse_double( const char* p, const char* end, double& out );
+    
+    // parses a timestamp field spanning exactly [p,end); false if malformed
+    bool parse_timestamp( const char* p, const char* end, time_t& out );
+    
+    
+    // parses the whole file into preallocated columns; field_target maps each CSV
+    // field to -1 (skip), -2 (timestamp) or a value column; returns the row count
+    // and sets *block to the storage backing index and cols
+    size_t parse_file( const MappedFile& file, const Options& opts, const std::vector<std::string>& columns,
+                       std::shared_ptr<void>* block, const time_t** index, std::vector<const double*>& cols );
+    
+    
+    // -----------------------------------------------------------------
+    // LOADERS
+    // -----------------------------------------------------------------
+    
+    template<typename T> df::DataFrame<T> read_frame( const std::string& path, const Options& opts = Options() )
+    {
+        BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
+        
+        MappedFile file(path);
+        std::shared_ptr<void> block;
+        const time_t* index = NULL;
+        std::vector<const double*> cols;
+        
+        const size_t rows = parse_file(file, opts, dp::dp_names<T>(), &block, &index, cols);
+        return df::DataFrame<T>::adopt(rows, block, index, cols, path);
+    }
+    
+    // every column of a file with a header line, each as FLOAT64
+    df::DynFrame read_frame( const std::string& path, const Options& opts = Options() );
+    
+    // inserts all rows of the file into series; rows with existing timestamps are skipped
+    template<typename T> void read( ts::TimeSeries<T>& series, const std::string& path, const Options& opts = Options() )
+    {
+        df::DataFrame<T> frame = read_frame<T>(path, opts);
+        for( size_t i = 0; i < frame.size(); ++i )
+            series.insert( std::make_pair(frame.timestamp(i), frame.row(i)) );
+    }
+    
+} // namespace csv
+
+
+#endif
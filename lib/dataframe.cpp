@@ -0,0 +1,169 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <sys/mman.h>
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <new>
+
+#include "dataframe.hpp"
+
+using namespace dataframe;
+
+// EXCEPTIONS
+
+DataFrameException::DataFrameException(const std::string& message):_msg(_spec + message){};
+DataFrameException::~DataFrameException() throw(){};
+
+const char* DataFrameException::what() const throw() {return _msg.c_str(); }
+const std::string DataFrameException::_spec = "Data Frame Exception: ";
+
+
+// STORAGE
+
+namespace {
+    
+    const size_t HUGE_PAGE = 2 << 20;
+    
+    std::atomic<size_t> threshold( 64 << 20 );
+    
+    // deleter recording how a block was obtained
+    struct BlockDeleter {
+        AllocPath path;
+        size_t mapped;      // mapping length for THP/HUGETLB
+        
+        void operator()( void* p ) const {
+            if( path == HEAP )
+                std::free(p);
+            else
+                munmap(p, mapped);
+        }
+    };
+    
+    size_t round_up( size_t n, size_t to ){
+        return ( n + to - 1 ) / to * to;
+    }
+    
+    // anonymous mapping aligned to a 2MB boundary so THP can back it completely
+    void* map_aligned( size_t bytes ){
+        
+        const size_t len = bytes + HUGE_PAGE;
+        char* p = static_cast<char*>( mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) );
+        if( p == MAP_FAILED )
+            return NULL;
+        
+        char* aligned = reinterpret_cast<char*>( round_up(reinterpret_cast<uintptr_t>(p), HUGE_PAGE) );
+        if( aligned > p )
+            munmap(p, static_cast<size_t>(aligned - p));
+        const size_t tail = static_cast<size_t>( (p + len) - (aligned + bytes) );
+        if( tail )
+            munmap(aligned + bytes, tail);
+        return aligned;
+    }
+}
+
+
+std::shared_ptr<void> dataframe::allocate_block(size_t bytes)
+{
+    if( bytes >= hugepage_threshold() ){
+        
+        const size_t len = round_up(bytes, HUGE_PAGE);
+        
+#ifdef MAP_HUGETLB
+        void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if( p != MAP_FAILED ){
+            BlockDeleter d = { HUGETLB, len };
+            return std::shared_ptr<void>(p, d);
+        }
+#endif
+        
+        void* q = map_aligned(len);
+        if( q ){
+#ifdef MADV_HUGEPAGE
+            madvise(q, len, MADV_HUGEPAGE);
+#endif
+            BlockDeleter d = { THP, len };
+            return std::shared_ptr<void>(q, d);
+        }
+    }
+    
+    void* p = NULL;
+    
+    if( posix_memalign(&p, ALIGNMENT, bytes ? bytes : ALIGNMENT) )
+        throw std::bad_alloc();
+    
+    std::memset(p, 0, bytes);
+    BlockDeleter d = { HEAP, 0 };
+    return std::shared_ptr<void>(p, d);
+}
+
+
+AllocPath dataframe::alloc_path(const std::shared_ptr<void>& block)
+{
+    const BlockDeleter* d = std::get_deleter<BlockDeleter>(block);
+    return d ? d->path : EXTERNAL;
+}
+
+
+const char* dataframe::alloc_path_name(AllocPath path)
+{
+    switch( path ){
+        case HEAP:      return "heap";
+        case THP:       return "transparent huge pages";
+        case HUGETLB:   return "hugetlbfs";
+        default:        return "external";
+    }
+}
+
+
+size_t dataframe::hugepage_threshold()
+{
+    return threshold.load();
+}
+
+
+void dataframe::set_hugepage_threshold(size_t bytes)
+{
+    threshold.store(bytes);
+}
+
+
+void dataframe::advise_hugepages(void* addr, size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+    if( bytes < hugepage_threshold() )
+        return;
+    
+    // only whole 2MB pages inside the range can be collapsed
+    const uintptr_t b = round_up(reinterpret_cast<uintptr_t>(addr), HUGE_PAGE);
+    const uintptr_t e = ( reinterpret_cast<uintptr_t>(addr) + bytes ) / HUGE_PAGE * HUGE_PAGE;
+    if( e > b )
+        madvise(reinterpret_cast<void*>(b), e - b, MADV_HUGEPAGE);
+#endif
+}
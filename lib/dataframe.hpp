@@ -23,11 +23,412 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  *
+ * ------------------------------------------------------------------------------
+ *
+ * dataframe.hpp
+ *
+ * Design Overview:
+ *
+ * Template class implementation of a flat, column-oriented time series
+ * container, the sister class of TimeSeries<T>. Timestamps and every
+ * DataPoint field are stored in separate contiguous arrays of a single
+ * 64-byte aligned block, so columns can be handed to vectorized kernels
+ * or external code as plain pointers.
+ *
+ * Storage is immutable once built. Copies share the underlying block
+ * through a reference counted holder, which also allows a DataFrame to
+ * be a view on memory owned by someone else (see DataFrame::adopt).
+ *
+ * Column ordering follows dp::dp_names<T>().
+ *
  */
 
+
 #ifndef backtester_dataframe_hpp
 #define backtester_dataframe_hpp
 
+//STL
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <mutex>
+
+//BOOST
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/type_traits/is_base_of.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/optional.hpp>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "calendar.hpp"
+#include "footprint.hpp"
+#include "macros.hpp"
+
+namespace bpt = boost::posix_time;
+namespace dp  = datapoint;
+namespace ts  = timeseries;
+
+namespace dataframe {
+    
+    // EXCEPTIONS
+    
+    class DataFrameException: public std::exception {
+        
+    public:
+        DataFrameException(const std::string& message);
+        ~DataFrameException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;         // full message incl. prefix, what() must not return a temporary
+        static const std::string _spec;
+    };
+    
+    
+    // STORAGE HELPERS
+    
+    const size_t ALIGNMENT = 64;    // cache line
+    
+    // number of elements per column including padding to the next cache line
+    inline size_t padded_stride(size_t rows){
+        const size_t per_line = ALIGNMENT / sizeof(double);
+        return (rows + per_line - 1) / per_line * per_line;
+    }
+    
+    // bytes needed for an index column plus ncols value columns of given row count
+    inline size_t block_size(size_t rows, size_t ncols){
+        return padded_stride(rows) * (sizeof(time_t) + ncols * sizeof(double));
+    }
+    
+    // returns a zero-initialized, ALIGNMENT aligned block; throws std::bad_alloc
+    // blocks of at least hugepage_threshold() bytes are backed by 2MB pages when
+    // the system allows it, trying hugetlbfs first, then transparent huge pages
+    std::shared_ptr<void> allocate_block(size_t bytes);
+    
+    enum AllocPath { HEAP, THP, HUGETLB, EXTERNAL };
+    
+    AllocPath alloc_path(const std::shared_ptr<void>& block);  // EXTERNAL if not from allocate_block
+    const char* alloc_path_name(AllocPath path);
+    
+    size_t hugepage_threshold();
+    void set_hugepage_threshold(size_t bytes);
+    
+    // asks for transparent huge pages on an existing mapping; no-op below the threshold
+    void advise_hugepages(void* addr, size_t bytes);
+    
+    
+    // -----------------------------------------------------------------
+    // DATA FRAME TEMPLATE CLASS
+    // -----------------------------------------------------------------
+    
+    template <typename T> class DataFrame: public footprint::Tracked {
+        
+        BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
+        
+    public:
+        
+        // CONSTRUCTION
+        
+        DataFrame( const std::string& meta = "" )
+        :   _meta(meta),
+            _block(),
+            _index(NULL),
+            _columns(dp::field_count<T>::value, static_cast<const double*>(NULL)),
+            _rows(0),
+            _calendar(new ::calendar::Cache())
+        {
+            track();
+        };
+        
+        explicit DataFrame( const ts::TimeSeries<T>& series ) // flattens a series
+        :   _meta( series.meta() ),
+            _block(),
+            _index(NULL),
+            _columns(dp::field_count<T>::value, static_cast<const double*>(NULL)),
+            _rows(0),
+            _calendar(new ::calendar::Cache())
+        {
+            PROFILE_SCOPE("df.from_series");
+            
+            const size_t rows = series.size();
+            const size_t ncols = _columns.size();
+            const size_t stride = padded_stride(rows);
+            
+            std::shared_ptr<void> block = allocate_block( block_size(rows, ncols) );
+            time_t* idx = static_cast<time_t*>(block.get());
+            double* cols = reinterpret_cast<double*>(idx + stride);
+            
+            double fields[dp::field_count<T>::value];
+            size_t i = 0;
+            
+            for( typename ts::TimeSeries<T>::const_iterator it = series.cbegin(); it != series.cend(); ++it, ++i ){
+                idx[i] = it->first;
+                dp::dp_values<T>(it->second, fields);
+                for( size_t j = 0; j < ncols; ++j )
+                    cols[j*stride + i] = fields[j];
+            }
+            
+            _attach(rows, block, idx, cols, stride);
+            track();
+        };
+        
+        // wraps externally owned column memory without copying; holder keeps it alive
+        static DataFrame adopt( size_t rows,
+                                std::shared_ptr<void> holder,
+                                const time_t* index,
+                                const std::vector<const double*>& columns,
+                                const std::string& meta = "" )
+        {
+            DataFrame df(meta);
+            
+            if( columns.size() != df._columns.size() )
+                throw DataFrameException("Column count does not match datapoint type.");
+            
+            df._block = holder;
+            df._index = index;
+            df._columns = columns;
+            df._rows = rows;
+            return df;
+        }
+        
+        DataFrame( const DataFrame& df )
+        :   footprint::Tracked( df ),
+            _meta( df._meta ),
+            _block( df._block ),
+            _index( df._index ),
+            _columns( df._columns ),
+            _rows( df._rows ),
+            _calendar( df._calendar )
+        {
+            track();
+        };
+        
+        DataFrame& operator=( const DataFrame& ) = default;
+        
+        DataFrame( DataFrame&& df )
+        :   _meta( std::move(df._meta) ),
+            _block( std::move(df._block) ),
+            _index( df._index ),
+            _columns( std::move(df._columns) ),
+            _rows( df._rows ),
+            _calendar( std::move(df._calendar) )
+        {
+            df._index = NULL;
+            df._rows = 0;
+            track();
+        };
+        
+        DataFrame& operator=( DataFrame&& rhs ){
+            if( this != &rhs ){
+                _meta = std::move(rhs._meta);
+                _block = std::move(rhs._block);
+                _index = rhs._index;
+                _columns = std::move(rhs._columns);
+                _rows = rhs._rows;
+                _calendar = std::move(rhs._calendar);
+                rhs._index = NULL;
+                rhs._rows = 0;
+            }
+            return *this;
+        };
+        
+        ~DataFrame(){
+            untrack();
+        };
+        
+        
+        // ACCESSORS
+        
+        const time_t* index() const {
+            return _index;
+        }
+        
+        const double* column( size_t i ) const { //throws
+            if( i >= _columns.size() )
+                throw DataFrameException("Column index out of range.");
+            return _columns[i];
+        }
+        
+        const double* column( const std::string& name ) const { //throws
+            return column( column_index(name) );
+        }
+        
+        const double* find_column( const std::string& name ) const { // NULL if no such column
+            const std::vector<std::string>& cols = column_names();
+            std::vector<std::string>::const_iterator it = std::find(cols.begin(), cols.end(), name);
+            return it == cols.end() ? NULL : _columns[it - cols.begin()];
+        }
+        
+        // row with timestamp exactly t, empty if none
+        boost::optional<size_t> find( time_t t ) const {
+            const size_t i = lower_bound(t);
+            return ( i < _rows && _index[i] == t ) ? boost::optional<size_t>(i) : boost::none;
+        }
+        
+        size_t column_index( const std::string& name ) const { //throws
+            const std::vector<std::string>& cols = column_names();
+            std::vector<std::string>::const_iterator it = std::find(cols.begin(), cols.end(), name);
+            if( it == cols.end() )
+                throw DataFrameException("Unknown column name "+name+".");
+            return static_cast<size_t>(it - cols.begin());
+        }
+        
+        time_t timestamp( size_t i ) const {
+            return _index[i];
+        }
+        
+        T row( size_t i ) const { // materializes the datapoint at position i
+            double fields[dp::field_count<T>::value];
+            for( size_t j = 0; j < _columns.size(); ++j )
+                fields[j] = _columns[j][i];
+            return dp::dp_make<T>(fields);
+        }
+        
+        // calendar fields of the index, computed on first use; copies share the cache
+        const ::calendar::Columns& calendar() const {
+            static const ::calendar::Columns none;
+            if( !_calendar )            // moved from, and so empty
+                return none;
+            return _calendar->get( [this](){ return ::calendar::decompose(_index, _rows); } );
+        }
+        
+        // position of the first row with timestamp >= t, size() if none
+        size_t lower_bound( time_t t ) const {
+            return static_cast<size_t>( std::lower_bound(_index, _index + _rows, t) - _index );
+        }
+        
+        bpt::ptime first() const {
+            return bpt::from_time_t( _rows ? _index[0] : 0 );
+        }
+        
+        bpt::ptime last() const {
+            return bpt::from_time_t( _rows ? _index[_rows-1] : 0 );
+        }
+        
+        // deep copy into a block obtained from alloc, e.g. to control page placement
+        DataFrame clone( std::function< std::shared_ptr<void>(size_t) > alloc = allocate_block ) const {
+            
+            const size_t stride = padded_stride(_rows);
+            std::shared_ptr<void> block = alloc( block_size(_rows, _columns.size()) );
+            time_t* idx = static_cast<time_t*>(block.get());
+            double* cols = reinterpret_cast<double*>(idx + stride);
+            
+            std::copy( _index, _index + _rows, idx );
+            for( size_t j = 0; j < _columns.size(); ++j )
+                std::copy( _columns[j], _columns[j] + _rows, cols + j*stride );
+            
+            DataFrame df(_meta);
+            df._attach(_rows, block, idx, cols, stride);
+            return df;
+        }
+        
+        ts::TimeSeries<T> to_series() const {
+            ts::TimeSeries<T> series(_meta);
+            for( size_t i = 0; i < _rows; ++i )
+                series.insert( std::make_pair(_index[i], row(i)) );
+            return series;
+        }
+        
+        
+        // STATE RELATED
+        
+        bool isEmpty() const {
+            return _rows == 0;
+        }
+        
+        size_t size() const {
+            return _rows;
+        }
+        
+        size_t ncols() const {
+            return _columns.size();
+        }
+        
+        AllocPath alloc_path() const {
+            return dataframe::alloc_path(_block);
+        }
+        
+        
+        // META AND COLUMN INFORMATION
+        
+        const std::vector<std::string>& column_names() const {
+            return dp::dp_names<T>();
+        }
+        
+        std::string meta() const {
+            return _meta;
+        }
+        
+        void set_meta( const std::string& meta ) {
+            _meta.assign(meta);
+        }
+        
+        void print_meta() const {
+            
+            std::vector<std::string> cols = column_names();
+            std::cout << std::endl;
+            std::cout << "Meta/Name: "<<_meta<<std::endl;
+            std::cout << "Dimensions: "<< size() <<" rows, "<< cols.size()+1 <<" columns"<< std::endl;
+            std::cout << "Columns: ";
+            std::copy( cols.begin(),cols.end(),std::ostream_iterator<std::string>(std::cout," "));
+            std::cout << std::endl;
+            std::cout << "First timestamp: " << first() << std::endl;
+            std::cout << "Last timestamp: " << last() << std::endl;
+            std::cout << "Storage: " << alloc_path_name( alloc_path() ) << std::endl;
+            std::cout << "Memory: " << footprint::describe( memory() ) << std::endl;
+        }
+        
+        // bytes held by the frame; copies report the same shared storage
+        footprint::Usage memory() const {
+            
+            const size_t stride = padded_stride(_rows);
+            
+            footprint::Usage u;
+            u.payload = _rows * _columns.size() * sizeof(double);
+            u.index = _rows * sizeof(time_t);
+            u.overhead = (stride - _rows) * (1 + _columns.size()) * sizeof(double)
+                       + sizeof(*this) + _columns.capacity() * sizeof(const double*) + _meta.capacity();
+            u.caches = _calendar ? _calendar->memory() : 0;
+            u.shared = _block.get();
+            return u;
+        }
+        
+        std::string memory_label() const {
+            return "DataFrame " + _meta;
+        }
+        
+        
+    private:
+        
+        void _attach( size_t rows, std::shared_ptr<void> block, const time_t* idx, const double* cols, size_t stride ){
+            _block = block;
+            _index = idx;
+            for( size_t j = 0; j < _columns.size(); ++j )
+                _columns[j] = cols + j*stride;
+            _rows = rows;
+        }
+        
+
+        
+    // DATA MEMBERS
+        
+        std::string _meta;                      // string with meta information
+        std::shared_ptr<void> _block;           // owner of the column memory
+        const time_t* _index;                   // timestamp column
+        std::vector<const double*> _columns;    // value columns, dp_names<T>() ordering
+        size_t _rows;                           // number of rows
+        std::shared_ptr< ::calendar::Cache > _calendar;   // lazily materialized calendar columns
+        
+    }; // DataFrame class
+    
+} // namespace dataframe
 
 
 #endif
@@ -32,7 +32,7 @@ using namespace datapoint;
 const std::string DataPointException::base_msg = "DataPoint Exception: ";
 
 const std::map<int,std::string> DataPointException::messages {
-    {1000, "Vector initialization failed. Index out of range."},
+    {1000, "Vector initialization failed. Too few values."},
     {0, "Unknown DataPoint Exception."}};
 
 DataPoint::~DataPoint(){};
@@ -43,12 +43,12 @@ OHLC::OHLC(double o, double h, double l, double c)
 { };
 
 OHLC::OHLC( const std::vector<double>& init ) //fixed arg ordering assumed
-try:
-    open(init.at(0)), high(init.at(1)), low(init.at(2)), close(init.at(3))
-{ }
-catch( std::out_of_range& e){
-    throw DataPointException(1000);
-};
+:   OHLC( init.size() >= 4 ? init.data() : throw DataPointException(1000) )
+{ };
+
+OHLC::OHLC( const double* init )
+:   open(init[0]), high(init[1]), low(init[2]), close(init[3])
+{ };
 
 
 
@@ -57,12 +57,12 @@ OHLCV::OHLCV(double o, double h, double l, double c, int v)
 { };
 
 OHLCV::OHLCV( const std::vector<double>& init ) //fixed arg ordering assumed
-try:
-open(init.at(0)), high(init.at(1)), low(init.at(2)), close(init.at(3)), volume(init.at(4))
-{ }
-catch( std::out_of_range& e){
-    throw DataPointException(1000);
-};
+:   OHLCV( init.size() >= 5 ? init.data() : throw DataPointException(1000) )
+{ };
+
+OHLCV::OHLCV( const double* init )
+:   open(init[0]), high(init[1]), low(init[2]), close(init[3]), volume(static_cast<int>(init[4]))
+{ };
 
 
 
@@ -71,12 +71,12 @@ BidAsk::BidAsk(double b, double a)
 { };
 
 BidAsk::BidAsk( const std::vector<double>& init ) //fixed arg ordering assumed
-try:
-bid(init.at(0)), ask(init.at(1))
-{ }
-catch( std::out_of_range& e){
-    throw DataPointException(1000);
-};
+:   BidAsk( init.size() >= 2 ? init.data() : throw DataPointException(1000) )
+{ };
+
+BidAsk::BidAsk( const double* init )
+:   bid(init[0]), ask(init[1])
+{ };
 
 
 
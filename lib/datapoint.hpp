@@ -49,6 +49,9 @@
 
 #include <exception>
 #include <vector>
+#include <map>
+#include <string>
+#include <cstddef>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/type_traits/is_base_of.hpp>
@@ -63,20 +66,19 @@ namespace datapoint {
     class DataPointException: public std::exception {
         
     public:
-        DataPointException(unsigned short code):error_code(code){};
+        DataPointException(unsigned short code)
+        :   error_code(code),
+            _msg( base_msg + ( messages.count(code) ? messages.at(code) : messages.at(0) ) )
+        {};
         ~DataPointException() throw(){};
             
         virtual const char* what() const throw() {
-            try {
-                return (base_msg + messages.at(error_code)).c_str();
-            }
-            catch( std::out_of_range& e ){
-                return (base_msg + messages.at(0)).c_str();
-            }
+            return _msg.c_str();
         }
         
     private:
         unsigned short error_code;
+        const std::string _msg;
         static const std::string base_msg;
         static const std::map<int,std::string> messages;
     };
@@ -95,7 +97,8 @@ namespace datapoint {
     struct OHLC: public DataPoint {
         
         OHLC(double o, double h, double l, double c);
-        OHLC(const std::vector<double>& init);
+        OHLC(const std::vector<double>& init);     // throws if too short
+        explicit OHLC(const double* init);          // unchecked, dp_names<T>() ordering
 
         OHLC( const OHLC& ) = default;
         OHLC& operator=( OHLC&& ) = default;
@@ -108,7 +111,8 @@ namespace datapoint {
     struct OHLCV: public DataPoint {
         
         OHLCV(double o, double h, double l, double c, int v);
-        OHLCV(const std::vector<double>& init);
+        OHLCV(const std::vector<double>& init);     // throws if too short
+        explicit OHLCV(const double* init);          // unchecked, dp_names<T>() ordering
         
         OHLCV( const OHLCV& ) = default;
         OHLCV& operator=( OHLCV&& ) = default;
@@ -122,7 +126,8 @@ namespace datapoint {
     struct BidAsk: public DataPoint {
         
         BidAsk(double b, double a);
-        BidAsk(const std::vector<double>& init);
+        BidAsk(const std::vector<double>& init);     // throws if too short
+        explicit BidAsk(const double* init);          // unchecked, dp_names<T>() ordering
         
         BidAsk( const BidAsk& ) = default;
         BidAsk& operator=( BidAsk&& ) = default;
@@ -132,31 +137,118 @@ namespace datapoint {
     };
     
 
-    // HELPERS
+    // FIELD DESCRIPTORS
+    // compile-time reflection: field<T,I> describes the I-th field of T by name,
+    // member pointer and type, field_count<T> gives the number of fields; the
+    // ordering is the column ordering used everywhere (tables, frames, files)
     
-    // emulate reflection via templates
-    template<typename T> std::vector<std::string> dp_names(){
+    enum FieldType { INT32, INT64, FLOAT64 };
+    
+    template<typename M> struct field_type;
+    template<> struct field_type<int> { static const FieldType value = INT32; };
+    template<> struct field_type<long long> { static const FieldType value = INT64; };
+    template<> struct field_type<double> { static const FieldType value = FLOAT64; };
+    
+    template<typename T, size_t I> struct field;
+    template<typename T> struct field_count;
+    
+    #define DP_FIELD_COUNT(T, N)                                                    \
+    template<> struct field_count<T> { static const size_t value = N; };
+    
+    #define DP_FIELD(T, I, m)                                                       \
+    template<> struct field<T, I> {                                                 \
+        typedef decltype(T::m) type;                                                \
+        static constexpr const char* name() { return #m; }                          \
+        static constexpr type T::* member() { return &T::m; }                       \
+        static constexpr FieldType kind() { return field_type<type>::value; }       \
+    };
+    
+    DP_FIELD_COUNT(OHLC, 4)
+    DP_FIELD(OHLC, 0, open)
+    DP_FIELD(OHLC, 1, high)
+    DP_FIELD(OHLC, 2, low)
+    DP_FIELD(OHLC, 3, close)
+    
+    DP_FIELD_COUNT(OHLCV, 5)
+    DP_FIELD(OHLCV, 0, open)
+    DP_FIELD(OHLCV, 1, high)
+    DP_FIELD(OHLCV, 2, low)
+    DP_FIELD(OHLCV, 3, close)
+    DP_FIELD(OHLCV, 4, volume)
+    
+    DP_FIELD_COUNT(BidAsk, 2)
+    DP_FIELD(BidAsk, 0, bid)
+    DP_FIELD(BidAsk, 1, ask)
+    
+    
+    // GENERIC FIELD ACCESS
+    // everything below is derived from the descriptors, no per-type code
+    
+    namespace detail {
         
-        BOOST_STATIC_ASSERT((boost::is_base_of< DataPoint, T>::value));
+        template<size_t... I> struct indices {};
+        template<size_t N, size_t... I> struct make_indices: make_indices<N-1, N-1, I...> {};
+        template<size_t... I> struct make_indices<0, I...> { typedef indices<I...> type; };
         
-        const char* res[] = { "" };
-        return std::vector<std::string>(res,res+1);
-    };
-
-    template<> std::vector<std::string> inline dp_names<OHLC>(){
-        const char* res[] = { "open", "high", "low", "close" };
-        return std::vector<std::string>(res,res+4);
-    };
-
-    template<> std::vector<std::string> inline dp_names<OHLCV>(){
-        const char* res[] = { "open", "high", "low", "close", "volume" };
-        return std::vector<std::string>(res,res+5);
-    };
+        // evaluates a pack expansion left to right for its side effects
+        struct expand {
+            template<typename... A> expand( A&&... ) {}
+        };
+        
+        template<typename T> struct all {
+            typedef typename make_indices< field_count<T>::value >::type type;
+        };
+        
+        template<typename T, size_t... I> void values( const T& p, double* out, indices<I...> ){
+            expand{ ( out[I] = static_cast<double>( p.*field<T,I>::member() ), 0 )... };
+        }
+        
+        template<typename T, size_t... I> T make( const double* in, indices<I...> ){
+            return T( static_cast<typename field<T,I>::type>( in[I] )... );
+        }
+        
+        template<typename T, size_t... I> std::vector<std::string> names( indices<I...> ){
+            const char* n[] = { field<T,I>::name()... };
+            return std::vector<std::string>( n, n + sizeof...(I) );
+        }
+        
+        template<typename T, typename F, size_t... I> void for_each( F& f, indices<I...> ){
+            expand{ ( f( field<T,I>(), I ), 0 )... };
+        }
+    }
     
-    template<> std::vector<std::string> inline dp_names<BidAsk>(){
-        const char* res[] = { "bid","ask" };
-        return std::vector<std::string>(res,res+2);
-    };
+    // column names, built once per type
+    template<typename T> const std::vector<std::string>& dp_names(){
+        BOOST_STATIC_ASSERT((boost::is_base_of< DataPoint, T>::value));
+        static const std::vector<std::string> names = detail::names<T>( typename detail::all<T>::type() );
+        return names;
+    }
+    
+    // comma separated column names, e.g. for SQL select lists
+    template<typename T> const std::string& dp_columns(){
+        static const std::string cols = [](){
+            std::string s;
+            for( size_t j = 0; j < field_count<T>::value; ++j )
+                s += ( j ? ", " : "" ) + dp_names<T>()[j];
+            return s;
+        }();
+        return cols;
+    }
+    
+    // writes the fields of a datapoint into out[0..field_count<T>)
+    template<typename T> void dp_values( const T& p, double* out ){
+        detail::values( p, out, typename detail::all<T>::type() );
+    }
+    
+    // constructs a datapoint from in[0..field_count<T>), no bounds checking
+    template<typename T> T dp_make( const double* in ){
+        return detail::make<T>( in, typename detail::all<T>::type() );
+    }
+    
+    // calls f(field<T,I>(), I) for every field in order
+    template<typename T, typename F> void for_each_field( F f ){
+        detail::for_each<T>( f, typename detail::all<T>::type() );
+    }
     
 } //namespace datapoint
 
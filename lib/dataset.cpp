@@ -0,0 +1,467 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * dataset.cpp
+ *
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include "dataset.hpp"
+#include "native.hpp"
+
+using namespace dataset;
+
+// EXCEPTIONS
+
+DatasetException::DatasetException(const std::string& message):_msg(_spec + message){};
+DatasetException::~DatasetException() throw(){};
+
+const char* DatasetException::what() const throw() {return _msg.c_str(); }
+const std::string DatasetException::_spec = "Dataset Exception: ";
+
+
+namespace {
+    
+    const char* const MANIFEST = "manifest";
+    const char* const HEADER = "tsdb-dataset 1";
+    
+    std::string manifest_path( const std::string& dir ){
+        return dir + "/" + MANIFEST;
+    }
+    
+    // first timestamp of the partition after the one holding t
+    time_t next_boundary( time_t t, Granularity g ){
+        const long days = utilities::days_from_time_t(t);
+        if( g == DAY )
+            return static_cast<time_t>(days + 1) * 86400;
+        
+        const utilities::CivilDate d = utilities::civil_from_days(days);
+        const long next = d.month == 12 ? utilities::days_from_civil(d.year + 1, 1, 1)
+                                        : utilities::days_from_civil(d.year, d.month + 1, 1);
+        return static_cast<time_t>(next) * 86400;
+    }
+    
+    // mkdir -p
+    void make_dirs( const std::string& dir ){
+        for( size_t pos = 1; pos <= dir.size(); ++pos ){
+            if( pos < dir.size() && dir[pos] != '/' )
+                continue;
+            const std::string sub = dir.substr(0, pos);
+            if( ::mkdir( sub.c_str(), 0755 ) != 0 && errno != EEXIST )
+                throw DatasetException("Could not create directory "+sub+".");
+        }
+    }
+    
+    std::string join( const std::vector<std::string>& names ){
+        std::string s;
+        for( size_t j = 0; j < names.size(); ++j )
+            s += (j ? "," : "") + names[j];
+        return s;
+    }
+    
+    std::vector<std::string> split( const std::string& s ){
+        std::vector<std::string> names;
+        std::istringstream in(s);
+        std::string name;
+        while( std::getline(in, name, ',') )
+            names.push_back(name);
+        return names;
+    }
+    
+    // replaces the manifest atomically, so readers see the old or the new one
+    void write_manifest( const std::string& dir, const Manifest& m ){
+        
+        const std::string path = manifest_path(dir);
+        const std::string tmp = path + ".tmp";
+        {
+            std::ofstream out( tmp.c_str(), std::ios::trunc );
+            out << HEADER << "\n"
+                << "partition " << (m.granularity == DAY ? "day" : "month") << "\n"
+                << "columns " << join(m.columns) << "\n"
+                << "meta " << m.meta << "\n";
+            for( size_t k = 0; k < m.partitions.size(); ++k ){
+                const Partition& p = m.partitions[k];
+                out << p.key << " " << static_cast<long long>(p.first) << " "
+                    << static_cast<long long>(p.last) << " " << p.rows << "\n";
+            }
+            out.flush();
+            if( !out ){
+                ::unlink( tmp.c_str() );
+                throw DatasetException("Could not write "+tmp+".");
+            }
+        }
+        if( ::rename( tmp.c_str(), path.c_str() ) != 0 ){
+            ::unlink( tmp.c_str() );
+            throw DatasetException("Could not write "+path+".");
+        }
+    }
+    
+    // runs f(k) for k in [0, n) on up to threads threads; rethrows the first exception
+    template<typename F> void parallel_for( size_t n, unsigned threads, F f ){
+        
+        const size_t nthreads = std::max<size_t>(1, std::min<size_t>( n,
+                                    threads ? threads : std::thread::hardware_concurrency() ));
+        std::vector<std::exception_ptr> errors(nthreads);
+        
+        auto work = [&]( size_t w ){
+            try {
+                for( size_t k = w; k < n; k += nthreads )
+                    f(k);
+            }
+            catch( ... ){
+                errors[w] = std::current_exception();
+            }
+        };
+        
+        std::vector<std::thread> pool;
+        for( size_t w = 1; w < nthreads; ++w )
+            pool.push_back( std::thread(work, w) );
+        work(0);
+        for( size_t w = 0; w < pool.size(); ++w )
+            pool[w].join();
+        
+        for( size_t w = 0; w < nthreads; ++w )
+            if( errors[w] )
+                std::rethrow_exception( errors[w] );
+    }
+}
+
+
+size_t Manifest::rows() const
+{
+    size_t n = 0;
+    for( size_t k = 0; k < partitions.size(); ++k )
+        n += partitions[k].rows;
+    return n;
+}
+
+
+std::string dataset::symbol_dir( const std::string& root, const std::string& symbol )
+{
+    if( symbol.empty() || symbol.find('/') != std::string::npos || symbol == "." || symbol == ".." )
+        throw DatasetException("Invalid symbol "+symbol+".");
+    return root + "/" + symbol;
+}
+
+
+std::string dataset::partition_key( time_t t, Granularity g )
+{
+    const utilities::CivilDate d = utilities::civil_from_days( utilities::days_from_time_t(t) );
+    char buf[16];
+    if( g == DAY )
+        std::snprintf( buf, sizeof(buf), "%04d-%02u-%02u", d.year, d.month, d.day );
+    else
+        std::snprintf( buf, sizeof(buf), "%04d-%02u", d.year, d.month );
+    return buf;
+}
+
+
+std::string dataset::partition_path( const std::string& dir, const std::string& key )
+{
+    return dir + "/" + key + ".tsn";
+}
+
+
+bool dataset::exists( const std::string& dir )
+{
+    struct stat st;
+    return ::stat( manifest_path(dir).c_str(), &st ) == 0;
+}
+
+
+Manifest dataset::read_manifest( const std::string& dir )
+{
+    const std::string path = manifest_path(dir);
+    std::ifstream in( path.c_str() );
+    if( !in )
+        throw DatasetException("Could not open "+path+".");
+    
+    Manifest m;
+    std::string line, granularity, columns;
+    
+    if( !std::getline(in, line) || line != HEADER )
+        throw DatasetException(path+" is not a dataset manifest.");
+    
+    if( !std::getline(in, line) || line.compare(0, 10, "partition ") != 0 )
+        throw DatasetException(path+" is corrupt.");
+    granularity = line.substr(10);
+    if( granularity != "day" && granularity != "month" )
+        throw DatasetException(path+" has unknown partitioning "+granularity+".");
+    m.granularity = granularity == "day" ? DAY : MONTH;
+    
+    if( !std::getline(in, line) || line.compare(0, 8, "columns ") != 0 )
+        throw DatasetException(path+" is corrupt.");
+    m.columns = split( line.substr(8) );
+    
+    if( !std::getline(in, line) || line.compare(0, 5, "meta ") != 0 )
+        throw DatasetException(path+" is corrupt.");
+    m.meta = line.substr(5);
+    
+    while( std::getline(in, line) ){
+        if( line.empty() )
+            continue;
+        std::istringstream fields(line);
+        Partition p;
+        long long first, last;
+        if( !(fields >> p.key >> first >> last >> p.rows) || first > last || !p.rows )
+            throw DatasetException(path+" has a corrupt partition entry: "+line);
+        p.first = static_cast<time_t>(first);
+        p.last = static_cast<time_t>(last);
+        if( !m.partitions.empty() && m.partitions.back().last >= p.first )
+            throw DatasetException(path+" has overlapping partitions.");
+        m.partitions.push_back(p);
+    }
+    
+    return m;
+}
+
+
+namespace {
+    
+    // appends, or with replace first drops the stored rows at or after index[0]
+    void store( const std::string& dir, size_t rows, const time_t* index,
+                const std::vector<const double*>& columns,
+                const std::vector<std::string>& names, const std::string& meta,
+                Granularity g, bool replace )
+    {
+        if( names.size() != columns.size() )
+            throw DatasetException("Column names do not match columns.");
+        for( size_t i = 1; i < rows; ++i )
+            if( index[i] <= index[i-1] )
+                throw DatasetException("Appended index is not strictly increasing.");
+        
+        Manifest m;
+        if( exists(dir) ){
+            m = read_manifest(dir);
+            if( m.columns != names )
+                throw DatasetException("Columns do not match the dataset in "+dir+".");
+        }
+        else {
+            make_dirs(dir);
+            m.granularity = g;
+            m.columns = names;
+            m.meta = meta.substr( 0, meta.find('\n') );
+        }
+        
+        // partitions emptied by a replace; only the manifest changes for a shortened one,
+        // its surplus rows are ignored like those of an interrupted append
+        std::vector<std::string> dropped;
+        if( replace && rows ){
+            while( !m.partitions.empty() && m.partitions.back().first >= index[0] ){
+                dropped.push_back( m.partitions.back().key );
+                m.partitions.pop_back();
+            }
+            if( !m.partitions.empty() && m.partitions.back().last >= index[0] ){
+                Partition& p = m.partitions.back();
+                std::shared_ptr<native::Mapping> old = native::map_file( partition_path(dir, p.key) );
+                if( old->header->rows < p.rows )
+                    throw DatasetException(partition_path(dir, p.key)+" does not match the manifest.");
+                p.rows = std::lower_bound( old->index, old->index + p.rows, index[0] ) - old->index;
+                p.last = old->index[p.rows - 1];
+            }
+        }
+        
+        if( rows && !m.partitions.empty() && index[0] <= m.partitions.back().last )
+            throw DatasetException("Appended rows must come after the last stored timestamp.");
+        
+        for( size_t i = 0; i < rows; ){
+            
+            const std::string key = partition_key( index[i], m.granularity );
+            const size_t j = std::lower_bound( index + i, index + rows,
+                                               next_boundary(index[i], m.granularity) ) - index;
+            const size_t n = j - i;
+            
+            if( !m.partitions.empty() && m.partitions.back().key == key ){
+                
+                // the newest partition continues: rewrite it with the new rows behind the old
+                Partition& p = m.partitions.back();
+                const std::string path = partition_path(dir, key);
+                std::shared_ptr<native::Mapping> old = native::map_file(path);
+                if( old->names != names || old->header->rows < p.rows )
+                    throw DatasetException(path+" does not match the manifest.");
+                
+                std::vector<time_t> idx( old->index, old->index + p.rows );
+                idx.insert( idx.end(), index + i, index + j );
+                
+                std::vector< std::vector<double> > values( columns.size() );
+                std::vector<const double*> ptrs;
+                for( size_t c = 0; c < columns.size(); ++c ){
+                    values[c].reserve( p.rows + n );
+                    values[c].assign( old->columns[c], old->columns[c] + p.rows );
+                    values[c].insert( values[c].end(), columns[c] + i, columns[c] + j );
+                    ptrs.push_back( &values[c][0] );
+                }
+                
+                native::write_columns( path, p.rows + n, &idx[0], ptrs, names, m.meta );
+                p.last = index[j-1];
+                p.rows += n;
+            }
+            else {
+                std::vector<const double*> ptrs;
+                for( size_t c = 0; c < columns.size(); ++c )
+                    ptrs.push_back( columns[c] + i );
+                
+                native::write_columns( partition_path(dir, key), n, index + i, ptrs, names, m.meta );
+                
+                Partition p = { key, index[i], index[j-1], n };
+                m.partitions.push_back(p);
+            }
+            
+            i = j;
+        }
+        
+        // last, so a crash before this leaves the previous dataset intact
+        write_manifest(dir, m);
+        
+        for( size_t k = 0; k < dropped.size(); ++k ){
+            bool rewritten = false;
+            for( size_t i = 0; i < m.partitions.size(); ++i )
+                rewritten |= ( m.partitions[i].key == dropped[k] );
+            if( !rewritten )
+                ::unlink( partition_path(dir, dropped[k]).c_str() );
+        }
+    }
+}
+
+
+void dataset::append_columns( const std::string& dir, size_t rows, const time_t* index,
+                              const std::vector<const double*>& columns,
+                              const std::vector<std::string>& names, const std::string& meta,
+                              Granularity g )
+{
+    store( dir, rows, index, columns, names, meta, g, false );
+}
+
+
+void dataset::replace_columns( const std::string& dir, size_t rows, const time_t* index,
+                               const std::vector<const double*>& columns,
+                               const std::vector<std::string>& names, const std::string& meta,
+                               Granularity g )
+{
+    store( dir, rows, index, columns, names, meta, g, true );
+}
+
+
+void dataset::remove( const std::string& dir )
+{
+    if( !exists(dir) )
+        return;
+    
+    const Manifest m = read_manifest(dir);
+    if( ::unlink( manifest_path(dir).c_str() ) != 0 )
+        throw DatasetException("Could not remove "+manifest_path(dir)+".");
+    for( size_t k = 0; k < m.partitions.size(); ++k )
+        ::unlink( partition_path(dir, m.partitions[k].key).c_str() );
+    ::rmdir( dir.c_str() );     // fails harmlessly if anything else is left
+}
+
+
+df::DynFrame dataset::load_columns( const std::string& dir, time_t start, time_t end, unsigned threads )
+{
+    if( start > end )
+        throw DatasetException("Start of range is after its end.");
+    
+    const Manifest m = read_manifest(dir);
+    
+    // prune by the manifest, without touching the files
+    std::vector<const Partition*> parts;
+    for( size_t k = 0; k < m.partitions.size(); ++k )
+        if( m.partitions[k].last >= start && m.partitions[k].first <= end )
+            parts.push_back( &m.partitions[k] );
+    
+    std::vector< std::shared_ptr<native::Mapping> > maps( parts.size() );
+    std::vector<size_t> lo( parts.size() ), hi( parts.size() );
+    
+    parallel_for( parts.size(), threads, [&]( size_t k ){
+        const std::string path = partition_path(dir, parts[k]->key);
+        maps[k] = native::map_file(path);
+        if( maps[k]->names != m.columns || maps[k]->header->rows < parts[k]->rows )
+            throw DatasetException(path+" does not match the manifest.");
+        
+        // rows beyond the manifest's count are from an interrupted append
+        const time_t* idx = maps[k]->index;
+        lo[k] = std::lower_bound( idx, idx + parts[k]->rows, start ) - idx;
+        hi[k] = std::upper_bound( idx, idx + parts[k]->rows, end ) - idx;
+    });
+    
+    std::vector<size_t> offset( parts.size() + 1, 0 );
+    size_t nonempty = 0, single = 0;
+    for( size_t k = 0; k < parts.size(); ++k ){
+        offset[k+1] = offset[k] + (hi[k] - lo[k]);
+        if( hi[k] > lo[k] ){
+            ++nonempty;
+            single = k;
+        }
+    }
+    const size_t rows = offset.back();
+    const size_t ncols = m.columns.size();
+    
+    std::vector<df::Column> columns;
+    for( size_t c = 0; c < ncols; ++c ){
+        df::Column col = { m.columns[c], df::FLOAT64, NULL, NULL };
+        columns.push_back(col);
+    }
+    
+    if( nonempty == 0 )
+        return df::DynFrame::adopt( 0, std::shared_ptr<void>(), NULL, columns, m.meta );
+    
+    // one partition: a view on its mapping
+    if( nonempty == 1 ){
+        const std::shared_ptr<native::Mapping>& map = maps[single];
+        for( size_t c = 0; c < ncols; ++c )
+            columns[c].data = map->columns[c] + lo[single];
+        return df::DynFrame::adopt( rows, map, map->index + lo[single], columns, m.meta );
+    }
+    
+    // several: copy the row ranges into one block, a partition per task
+    const size_t stride = df::padded_stride(rows);
+    std::shared_ptr<void> block = df::allocate_block( df::block_size(rows, ncols) );
+    time_t* idx = static_cast<time_t*>( block.get() );
+    double* cols = reinterpret_cast<double*>( idx + stride );
+    
+    parallel_for( parts.size(), threads, [&]( size_t k ){
+        const size_t n = hi[k] - lo[k];
+        std::copy( maps[k]->index + lo[k], maps[k]->index + lo[k] + n, idx + offset[k] );
+        for( size_t c = 0; c < ncols; ++c )
+            std::copy( maps[k]->columns[c] + lo[k], maps[k]->columns[c] + lo[k] + n,
+                       cols + c*stride + offset[k] );
+        maps[k].reset();
+    });
+    
+    for( size_t c = 0; c < ncols; ++c )
+        columns[c].data = cols + c*stride;
+    return df::DynFrame::adopt( rows, block, idx, columns, m.meta );
+}
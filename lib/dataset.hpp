@@ -0,0 +1,184 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * dataset.hpp
+ *
+ * Design Overview:
+ *
+ * Partitioned on-disk dataset for long histories. Each symbol is a
+ * directory holding one native file (see native.hpp) per day or per month
+ * and a small text manifest listing the partitions with their first and
+ * last timestamp and row count:
+ *
+ *   <root>/<symbol>/manifest
+ *   <root>/<symbol>/2013-01-02.tsn     (DAY)   or   2013-01.tsn   (MONTH)
+ *
+ * A range load reads only the manifest, prunes every partition that does
+ * not intersect the range, and maps the rest in parallel. A range inside
+ * one partition is a zero-copy view on its mapping; otherwise the row
+ * ranges are copied in parallel into one DataFrame block.
+ *
+ * Appends must come after the last stored timestamp, so they only ever
+ * touch the newest partition (rewritten with the new rows) and create new
+ * ones; older files are never opened. Files are written to a temporary
+ * and renamed, and the manifest is replaced last, so a reader sees either
+ * the old or the new dataset. There is one writer per symbol.
+ *
+ */
+
+
+#ifndef backtester_dataset_hpp
+#define backtester_dataset_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <limits>
+#include <ctime>
+
+//BOOST
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "dynframe.hpp"
+#include "utilities.hpp"
+
+namespace bpt = boost::posix_time;
+namespace dp = datapoint;
+namespace ts = timeseries;
+namespace df = dataframe;
+
+namespace dataset {
+    
+    // EXCEPTIONS
+    
+    class DatasetException: public std::exception {
+        
+    public:
+        DatasetException(const std::string& message);
+        ~DatasetException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    enum Granularity { DAY, MONTH };
+    
+    const time_t MIN_TIME = std::numeric_limits<time_t>::min();
+    const time_t MAX_TIME = std::numeric_limits<time_t>::max();
+    
+    struct Partition {
+        std::string key;            // "YYYY-MM-DD" or "YYYY-MM", also the file name
+        time_t first;
+        time_t last;
+        size_t rows;
+    };
+    
+    struct Manifest {
+        Granularity granularity;
+        std::vector<std::string> columns;
+        std::string meta;
+        std::vector<Partition> partitions;      // ascending, non-overlapping
+        
+        size_t rows() const;
+    };
+    
+    std::string symbol_dir( const std::string& root, const std::string& symbol );
+    std::string partition_key( time_t t, Granularity g );
+    std::string partition_path( const std::string& dir, const std::string& key );
+    
+    bool exists( const std::string& dir );                      // has a manifest
+    Manifest read_manifest( const std::string& dir );           // throws
+    
+    // appends rows of index and columns to the dataset in dir, creating it with
+    // granularity g if it does not exist; index must be strictly increasing and
+    // after the last stored timestamp, the columns those of the dataset; throws
+    void append_columns( const std::string& dir, size_t rows, const time_t* index,
+                         const std::vector<const double*>& columns,
+                         const std::vector<std::string>& names, const std::string& meta,
+                         Granularity g = DAY );
+    
+    // as append_columns, but stored rows at or after index[0] are replaced first;
+    // for derived data whose last rows are revised, like open bars
+    void replace_columns( const std::string& dir, size_t rows, const time_t* index,
+                          const std::vector<const double*>& columns,
+                          const std::vector<std::string>& names, const std::string& meta,
+                          Granularity g = DAY );
+    
+    // deletes the manifest and partitions of the dataset in dir, if any
+    void remove( const std::string& dir );
+    
+    // rows with start <= t <= end; threads = 0 uses one per core, up to one per partition
+    df::DynFrame load_columns( const std::string& dir, time_t start = MIN_TIME, time_t end = MAX_TIME,
+                               unsigned threads = 0 );
+    
+    
+    // -----------------------------------------------------------------
+    // TYPED INTERFACE
+    // -----------------------------------------------------------------
+    
+    template<typename T> void append( const std::string& dir, const df::DataFrame<T>& frame,
+                                      Granularity g = DAY ){
+        std::vector<const double*> columns;
+        for( size_t j = 0; j < frame.ncols(); ++j )
+            columns.push_back( frame.column(j) );
+        append_columns( dir, frame.size(), frame.index(), columns, frame.column_names(), frame.meta(), g );
+    }
+    
+    template<typename T> void append( const std::string& dir, const ts::TimeSeries<T>& series,
+                                      Granularity g = DAY ){
+        append( dir, df::DataFrame<T>(series), g );
+    }
+    
+    // same range convention as tsdb::Interface::load: inclusive, an unset bound is open
+    template<typename T> df::DataFrame<T> load( const std::string& dir,
+                                                bpt::ptime start = bpt::ptime(),
+                                                bpt::ptime end = bpt::ptime(),
+                                                unsigned threads = 0 ){
+        if( read_manifest(dir).columns != dp::dp_names<T>() )
+            throw DatasetException("Columns of "+dir+" do not match datapoint type.");
+        
+        const time_t from = start.is_not_a_date_time() ? MIN_TIME : utilities::bpt_to_time_t(start);
+        const time_t to = end.is_not_a_date_time() ? MAX_TIME : utilities::bpt_to_time_t(end);
+        return load_columns( dir, from, to, threads ).as<T>();
+    }
+    
+    template<typename T> void load( ts::TimeSeries<T>& series, const std::string& dir,
+                                    bpt::ptime start = bpt::ptime(), bpt::ptime end = bpt::ptime() ){
+        series = load<T>(dir, start, end).to_series();
+    }
+    
+} // namespace dataset
+
+
+#endif
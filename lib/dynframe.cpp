@@ -0,0 +1,234 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <limits>
+#include <iterator>
+#include <algorithm>
+
+#include "dynframe.hpp"
+
+using namespace dataframe;
+
+
+const char* dataframe::type_name( ColumnType type )
+{
+    switch( type ){
+        case INT32:     return "int32";
+        case INT64:     return "int64";
+        case FLOAT64:   return "float64";
+        case STRING:    return "string";
+    }
+    return "unknown";
+}
+
+
+// COLUMN
+
+std::string Column::str( size_t i ) const
+{
+    if( type != STRING )
+        throw DataFrameException("Column "+name+" is not a string column.");
+    const char* chars = static_cast<const char*>(data);
+    return std::string( chars + offsets[i], chars + offsets[i+1] );
+}
+
+double Column::number( size_t i ) const
+{
+    switch( type ){
+        case INT32:     return static_cast<const int32_t*>(data)[i];
+        case INT64:     return static_cast<double>( static_cast<const int64_t*>(data)[i] );
+        case FLOAT64:   return static_cast<const double*>(data)[i];
+        case STRING:    break;
+    }
+    throw DataFrameException("Column "+name+" is not numeric.");
+}
+
+
+// DYNFRAME
+
+const Column& DynFrame::column( size_t i ) const
+{
+    if( i >= _columns.size() )
+        throw DataFrameException("Column index out of range.");
+    return _columns[i];
+}
+
+const Column& DynFrame::column( const std::string& name ) const
+{
+    const Column* c = find_column(name);
+    if( !c )
+        throw DataFrameException("Unknown column name "+name+".");
+    return *c;
+}
+
+const Column* DynFrame::find_column( const std::string& name ) const
+{
+    for( size_t j = 0; j < _columns.size(); ++j )
+        if( _columns[j].name == name )
+            return &_columns[j];
+    return NULL;
+}
+
+std::vector<std::string> DynFrame::column_names() const
+{
+    std::vector<std::string> names;
+    for( size_t j = 0; j < _columns.size(); ++j )
+        names.push_back( _columns[j].name );
+    return names;
+}
+
+void DynFrame::print_meta() const
+{
+    std::cout << std::endl;
+    std::cout << "Meta/Name: "<<_meta<<std::endl;
+    std::cout << "Dimensions: "<< _rows <<" rows, "<< _columns.size()+1 <<" columns"<< std::endl;
+    std::cout << "Columns: ";
+    for( size_t j = 0; j < _columns.size(); ++j )
+        std::cout << _columns[j].name << "(" << type_name(_columns[j].type) << ") ";
+    std::cout << std::endl;
+    std::cout << "First timestamp: " << bpt::from_time_t( _rows ? _index[0] : 0 ) << std::endl;
+    std::cout << "Last timestamp: " << bpt::from_time_t( _rows ? _index[_rows-1] : 0 ) << std::endl;
+}
+
+
+// BUILDER
+
+DynFrame::Builder::Builder( const std::vector<std::string>& names, const std::vector<ColumnType>& types,
+                            const std::string& meta )
+:   _meta(meta),
+    _names(names),
+    _storage( new Storage() )
+{
+    if( names.size() != types.size() )
+        throw DataFrameException("Column names do not match column types.");
+    
+    _storage->buffers.resize( types.size() );
+    for( size_t j = 0; j < types.size(); ++j ){
+        _storage->buffers[j].type = types[j];
+        if( types[j] == STRING )
+            _storage->buffers[j].offsets.push_back(0);
+    }
+}
+
+void DynFrame::Builder::reserve( size_t rows )
+{
+    _storage->index.reserve(rows);
+    for( size_t j = 0; j < _storage->buffers.size(); ++j ){
+        Buffer& b = _storage->buffers[j];
+        switch( b.type ){
+            case INT32:     b.i32.reserve(rows); break;
+            case INT64:     b.i64.reserve(rows); break;
+            case FLOAT64:   b.f64.reserve(rows); break;
+            case STRING:    b.offsets.reserve(rows + 1); break;
+        }
+    }
+}
+
+void DynFrame::Builder::add_row( time_t t )
+{
+    _storage->index.push_back(t);
+    for( size_t j = 0; j < _storage->buffers.size(); ++j ){
+        Buffer& b = _storage->buffers[j];
+        switch( b.type ){
+            case INT32:     b.i32.push_back(0); break;
+            case INT64:     b.i64.push_back(0); break;
+            case FLOAT64:   b.f64.push_back(0); break;
+            case STRING:    b.offsets.push_back( b.offsets.back() ); break;
+        }
+    }
+}
+
+void DynFrame::Builder::set( size_t col, double v )
+{
+    Buffer& b = _storage->buffers.at(col);
+    switch( b.type ){
+        case INT32:     b.i32.back() = static_cast<int32_t>(v); break;
+        case INT64:     b.i64.back() = static_cast<int64_t>(v); break;
+        case FLOAT64:   b.f64.back() = v; break;
+        case STRING:    throw DataFrameException("Column "+_names[col]+" is a string column.");
+    }
+}
+
+void DynFrame::Builder::set( size_t col, int64_t v )
+{
+    Buffer& b = _storage->buffers.at(col);
+    switch( b.type ){
+        case INT32:     b.i32.back() = static_cast<int32_t>(v); break;
+        case INT64:     b.i64.back() = v; break;
+        case FLOAT64:   b.f64.back() = static_cast<double>(v); break;
+        case STRING:    throw DataFrameException("Column "+_names[col]+" is a string column.");
+    }
+}
+
+void DynFrame::Builder::set( size_t col, const std::string& v )
+{
+    Buffer& b = _storage->buffers.at(col);
+    if( b.type != STRING )
+        throw DataFrameException("Column "+_names[col]+" is not a string column.");
+    
+    // replaces the value of the current row, which is the last one
+    b.chars.resize( static_cast<size_t>( b.offsets[b.offsets.size()-2] ) );
+    b.chars.insert( b.chars.end(), v.begin(), v.end() );
+    if( b.chars.size() > static_cast<size_t>( std::numeric_limits<int32_t>::max() ) )
+        throw DataFrameException("String column "+_names[col]+" exceeds 2GB.");
+    b.offsets.back() = static_cast<int32_t>( b.chars.size() );
+}
+
+size_t DynFrame::Builder::size() const
+{
+    return _storage->index.size();
+}
+
+DynFrame DynFrame::Builder::finish()
+{
+    DynFrame d(_meta);
+    Storage& s = *_storage;
+    
+    d._owner = _storage;
+    d._rows = s.index.size();
+    d._index = s.index.empty() ? NULL : &s.index[0];
+    
+    for( size_t j = 0; j < s.buffers.size(); ++j ){
+        const Buffer& b = s.buffers[j];
+        Column c = { _names[j], b.type, NULL, NULL };
+        switch( b.type ){
+            case INT32:     c.data = b.i32.data(); break;
+            case INT64:     c.data = b.i64.data(); break;
+            case FLOAT64:   c.data = b.f64.data(); break;
+            case STRING:    c.data = b.chars.data(); c.offsets = b.offsets.data(); break;
+        }
+        d._columns.push_back(c);
+    }
+    
+    // start over with the same schema
+    std::vector<ColumnType> types;
+    for( size_t j = 0; j < s.buffers.size(); ++j )
+        types.push_back( s.buffers[j].type );
+    *this = Builder(_names, types, _meta);
+    
+    return d;
+}
@@ -0,0 +1,264 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * dynframe.hpp
+ *
+ * Design Overview:
+ *
+ * Dynamically typed columnar frame for exploratory work on tables whose
+ * shape is not known at compile time. The schema (column names and
+ * types) is discovered at load time, see tsdb::Interface::load(DynFrame&).
+ * Each column is one contiguous typed buffer: int32, int64 or double
+ * values, or strings stored as one character buffer plus offsets.
+ *
+ * DynFrames are immutable and copies share storage. as<T>() bridges to a
+ * typed DataFrame<T>: when the fields of T exist as double columns, the
+ * DataFrame is a zero-copy view on the DynFrame's buffers, otherwise the
+ * numeric columns are converted into a new block. from() goes the other
+ * way, again without copying.
+ *
+ * Build a DynFrame row by row with DynFrame::Builder.
+ *
+ */
+
+
+#ifndef backtester_dynframe_hpp
+#define backtester_dynframe_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <stdint.h>
+
+#include "datapoint.hpp"
+#include "dataframe.hpp"
+
+namespace dp = datapoint;
+
+namespace dataframe {
+    
+    enum ColumnType { INT32, INT64, FLOAT64, STRING };
+    
+    const char* type_name( ColumnType type );
+    
+    
+    struct Column {
+        
+        std::string name;
+        ColumnType type;
+        const void* data;           // int32_t, int64_t or double values; chars for STRING
+        const int32_t* offsets;     // STRING only: rows+1 offsets into data
+        
+        template<typename V> const V* values() const {
+            return static_cast<const V*>(data);
+        }
+        
+        std::string str( size_t i ) const;      // STRING columns
+        double number( size_t i ) const;        // numeric columns as double
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // DYNAMIC FRAME
+    // -----------------------------------------------------------------
+    
+    class DynFrame {
+        
+    public:
+        
+        class Builder;
+        
+        DynFrame( const std::string& meta = "" )
+        :   _meta(meta),
+            _owner(),
+            _index(NULL),
+            _columns(),
+            _rows(0)
+        {};
+        
+        // wraps externally owned buffers without copying; holder keeps them alive
+        static DynFrame adopt( size_t rows,
+                               std::shared_ptr<void> holder,
+                               const time_t* index,
+                               const std::vector<Column>& columns,
+                               const std::string& meta = "" )
+        {
+            DynFrame d(meta);
+            d._owner = holder;
+            d._index = index;
+            d._columns = columns;
+            d._rows = rows;
+            return d;
+        }
+        
+        // ACCESSORS
+        
+        size_t size() const { return _rows; }
+        size_t ncols() const { return _columns.size(); }
+        bool isEmpty() const { return _rows == 0; }
+        const time_t* index() const { return _index; }
+        const std::string& meta() const { return _meta; }
+        
+        const Column& column( size_t i ) const;                 // throws
+        const Column& column( const std::string& name ) const;  // throws
+        const Column* find_column( const std::string& name ) const; // NULL if absent
+        std::vector<std::string> column_names() const;
+        
+        template<typename V> const V* values( const std::string& name, ColumnType type ) const {
+            const Column& c = column(name);
+            if( c.type != type )
+                throw DataFrameException("Column "+name+" is "+type_name(c.type)+", not "+type_name(type)+".");
+            return c.values<V>();
+        }
+        
+        void print_meta() const;
+        
+        
+        // TYPED BRIDGE
+        
+        // true if every field of T exists as a numeric column
+        template<typename T> bool matches() const {
+            const std::vector<std::string>& names = dp::dp_names<T>();
+            for( size_t j = 0; j < names.size(); ++j ){
+                const Column* c = find_column(names[j]);
+                if( !c || c->type == STRING )
+                    return false;
+            }
+            return true;
+        }
+        
+        // typed view; zero-copy if all fields of T are double columns, else converted; throws
+        template<typename T> DataFrame<T> as() const {
+            
+            const std::vector<std::string>& names = dp::dp_names<T>();
+            std::vector<const Column*> src;
+            bool zero_copy = true;
+            
+            for( size_t j = 0; j < names.size(); ++j ){
+                const Column* c = find_column(names[j]);
+                if( !c || c->type == STRING )
+                    throw DataFrameException("No numeric column "+names[j]+".");
+                zero_copy &= ( c->type == FLOAT64 );
+                src.push_back(c);
+            }
+            
+            std::vector<const double*> columns;
+            
+            if( zero_copy ){
+                for( size_t j = 0; j < src.size(); ++j )
+                    columns.push_back( src[j]->values<double>() );
+                return DataFrame<T>::adopt( _rows, _owner, _index, columns, _meta );
+            }
+            
+            const size_t stride = padded_stride(_rows);
+            std::shared_ptr<void> block = allocate_block( block_size(_rows, src.size()) );
+            time_t* idx = static_cast<time_t*>( block.get() );
+            double* cols = reinterpret_cast<double*>( idx + stride );
+            
+            std::copy( _index, _index + _rows, idx );
+            for( size_t j = 0; j < src.size(); ++j ){
+                for( size_t i = 0; i < _rows; ++i )
+                    cols[j*stride + i] = src[j]->number(i);
+                columns.push_back( cols + j*stride );
+            }
+            return DataFrame<T>::adopt( _rows, block, idx, columns, _meta );
+        }
+        
+        // untyped view on a typed frame, sharing its storage
+        template<typename T> static DynFrame from( const DataFrame<T>& frame ){
+            
+            DynFrame d( frame.meta() );
+            std::shared_ptr< DataFrame<T> > keep( new DataFrame<T>(frame) );
+            d._owner = keep;
+            d._index = frame.index();
+            d._rows = frame.size();
+            
+            const std::vector<std::string>& names = frame.column_names();
+            for( size_t j = 0; j < names.size(); ++j ){
+                Column c = { names[j], FLOAT64, frame.column(j), NULL };
+                d._columns.push_back(c);
+            }
+            return d;
+        }
+        
+    private:
+        
+        std::string _meta;
+        std::shared_ptr<void> _owner;       // keeps all buffers alive
+        const time_t* _index;
+        std::vector<Column> _columns;
+        size_t _rows;
+    };
+    
+    
+    // ROW-WISE CONSTRUCTION
+    
+    class DynFrame::Builder {
+        
+    public:
+        
+        Builder( const std::vector<std::string>& names, const std::vector<ColumnType>& types,
+                 const std::string& meta = "" );    // throws on size mismatch
+        
+        void reserve( size_t rows );
+        
+        // append a row: add_row, then one set per column (unset columns get 0 / "")
+        void add_row( time_t t );
+        void set( size_t col, double v );
+        void set( size_t col, int64_t v );
+        void set( size_t col, const std::string& v );
+        
+        size_t size() const;
+        DynFrame finish();                  // the builder is empty afterwards
+        
+    private:
+        
+        struct Buffer {
+            ColumnType type;
+            std::vector<int32_t> i32;
+            std::vector<int64_t> i64;
+            std::vector<double> f64;
+            std::vector<char> chars;
+            std::vector<int32_t> offsets;   // offsets[i+1] written by set, carried forward by add_row
+        };
+        
+        struct Storage {
+            std::vector<time_t> index;
+            std::vector<Buffer> buffers;
+        };
+        
+        std::string _meta;
+        std::vector<std::string> _names;
+        std::shared_ptr<Storage> _storage;
+    };
+    
+} // namespace dataframe
+
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * engine.hpp
+ *
+ * Design Overview:
+ *
+ * Event loop driving strategies bar by bar over a data source. Sources
+ * and strategies are template parameters rather than virtual interfaces,
+ * so the per-bar call into a strategy is a direct, inlinable call.
+ *
+ * A source is any class with
+ *
+ *     bool next( time_t& t, const T*& bar );   // false when exhausted
+ *
+ * and a strategy any class with
+ *
+ *     void on_bar( time_t t, const T& bar );
+ *
+ * CoStrategy<T,Derived> lets strategies that are naturally sequential
+ * ("wait for a breakout, then for a pullback, then enter") be written as
+ * straight-line code instead of hand-written state machines. It is a
+ * stackless coroutine built on boost::asio::coroutine: the resume point is
+ * a single int and all state lives in members of the strategy object, so
+ * the "frames" are just the strategy objects the caller preallocates, and
+ * resuming is a switch statement with no heap traffic.
+ *
+ */
+
+
+#ifndef backtester_engine_hpp
+#define backtester_engine_hpp
+
+//STL
+#include <vector>
+#include <ctime>
+
+//BOOST
+#include <boost/asio/coroutine.hpp>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "macros.hpp"
+
+namespace dp = datapoint;
+namespace ts = timeseries;
+namespace df = dataframe;
+
+
+// COROUTINE STRATEGY MACROS
+// use only inside CoStrategy<T,Derived>::run(); at most one await per source line,
+// locals do not survive an await so keep state in data members
+
+#define STRATEGY_BODY           BOOST_ASIO_CORO_REENTER( this->coroutine() )
+#define AWAIT_NEXT_BAR          BOOST_ASIO_CORO_YIELD return
+#define AWAIT_UNTIL(cond)       while( !(cond) ) { BOOST_ASIO_CORO_YIELD return; }
+
+
+namespace engine {
+    
+    // -----------------------------------------------------------------
+    // SOURCES
+    // -----------------------------------------------------------------
+    
+    template<typename T> class SeriesSource {
+        
+    public:
+        
+        explicit SeriesSource( const ts::TimeSeries<T>& series )
+        :   _it( series.cbegin() ),
+            _end( series.cend() )
+        {};
+        
+        bool next( time_t& t, const T*& bar ){
+            if( _it == _end )
+                return false;
+            t = _it->first;
+            bar = &_it->second;
+            ++_it;
+            return true;
+        }
+        
+    private:
+        typename ts::TimeSeries<T>::const_iterator _it, _end;
+    };
+    
+    
+    template<typename T> class FrameSource {
+        
+    public:
+        
+        explicit FrameSource( const df::DataFrame<T>& frame, size_t begin = 0 )
+        :   _frame( frame ),
+            _pos( begin ),
+            _bar( frame.size() ? frame.row(0) : dp::dp_make<T>(_zeros()) )
+        {};
+        
+        bool next( time_t& t, const T*& bar ){
+            if( _pos >= _frame.size() )
+                return false;
+            t = _frame.timestamp(_pos);
+            _bar = _frame.row(_pos++);  // materialized into a member, no allocation
+            bar = &_bar;
+            return true;
+        }
+        
+    private:
+        static const double* _zeros(){
+            static const double z[dp::field_count<T>::value] = {};
+            return z;
+        }
+        
+        const df::DataFrame<T>& _frame;
+        size_t _pos;
+        T _bar;
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // COROUTINE STRATEGY BASE
+    // -----------------------------------------------------------------
+    
+    // Derived implements void run() as
+    //
+    //     void run() {
+    //         STRATEGY_BODY {
+    //             AWAIT_UNTIL( bar().close > _level );
+    //             ...
+    //             AWAIT_NEXT_BAR;
+    //         }
+    //     }
+    
+    template<typename T, typename Derived> class CoStrategy {
+        
+    public:
+        
+        CoStrategy(): _coro(), _t(0), _bar(NULL) {};
+        
+        // engine entry point, resumes the body until its next await
+        void on_bar( time_t t, const T& bar ){
+            if( _coro.is_complete() )
+                return;
+            _t = t;
+            _bar = &bar;
+            static_cast<Derived*>(this)->run();
+        }
+        
+        bool done() const {
+            return _coro.is_complete();
+        }
+        
+        void restart() {
+            _coro = boost::asio::coroutine();
+        }
+        
+    protected:
+        
+        time_t time() const {
+            return _t;
+        }
+        
+        const T& bar() const {
+            return *_bar;
+        }
+        
+        boost::asio::coroutine& coroutine() {
+            return _coro;
+        }
+        
+    private:
+        boost::asio::coroutine _coro;   // resume point
+        time_t _t;                      // current bar
+        const T* _bar;
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // ENGINE
+    // -----------------------------------------------------------------
+    
+    template<typename T> class Engine {
+        
+        BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
+        
+    public:
+        
+        Engine(): _bars(0) {};
+        
+        // feeds every bar of src to strategy; returns the number of bars processed
+        template<typename Source, typename Strategy> size_t run( Source& src, Strategy& strategy )
+        {
+            PROFILE_SCOPE("engine.run");
+            
+            time_t t;
+            const T* bar;
+            size_t n = 0;
+            
+            while( src.next(t, bar) ){
+                strategy.on_bar(t, *bar);
+                ++n;
+            }
+            PROFILE_COUNT("engine.bars", n);
+            _bars += n;
+            return n;
+        }
+        
+        // feeds every bar to each strategy of a preallocated pool, e.g. one per parameter set
+        template<typename Source, typename Strategy> size_t run( Source& src, std::vector<Strategy>& pool )
+        {
+            PROFILE_SCOPE("engine.run");
+            
+            time_t t;
+            const T* bar;
+            size_t n = 0;
+            
+            while( src.next(t, bar) ){
+                for( typename std::vector<Strategy>::iterator s = pool.begin(); s != pool.end(); ++s )
+                    s->on_bar(t, *bar);
+                ++n;
+            }
+            PROFILE_COUNT("engine.bars", n);
+            _bars += n;
+            return n;
+        }
+        
+        size_t bars_processed() const {
+            return _bars;
+        }
+        
+    private:
+        size_t _bars;
+    };
+    
+} // namespace engine
+
+
+#endif
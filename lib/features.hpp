@@ -0,0 +1,461 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * features.hpp
+ *
+ * Design Overview:
+ *
+ * Builder for lagged feature matrices (lags, returns, rolling statistics,
+ * calendar fields) as used for exporting training data to ML pipelines.
+ * Features are declared once on a FeatureMatrix<T> and then written
+ * directly into a caller-provided buffer in row- or column-major layout,
+ * without intermediate copies of the source data.
+ *
+ * Work is run on a small pool of threads. Column-major output is
+ * parallelized across columns. Row-major output is parallelized across
+ * row blocks instead, so that threads do not share cache lines.
+ *
+ * Sources can be a DataFrame<T> (random access on flat columns) or a
+ * TimeSeries<T> (kernels walk the map with a leading and a trailing
+ * iterator, so lags never need random access).
+ *
+ * Calendar features of a DataFrame come from its cached calendar columns
+ * (see calendar.hpp). Rows without enough history for a feature are set
+ * to NaN.
+ *
+ */
+
+
+#ifndef backtester_features_hpp
+#define backtester_features_hpp
+
+//STL
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <iterator>
+#include <algorithm>
+
+//BOOST
+#include <boost/iterator/transform_iterator.hpp>
+#include <boost/range/adaptor/map.hpp>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "utilities.hpp"
+#include "calendar.hpp"
+
+namespace dp = datapoint;
+namespace ts = timeseries;
+namespace df = dataframe;
+
+namespace features {
+    
+    enum Layout { ROW_MAJOR, COL_MAJOR };
+    
+    
+    // FEATURE SPECIFICATION
+    
+    struct Feature {
+        
+        enum Kind {
+            LAG,            // x[t-k]
+            RETURN,         // x[t]/x[t-k] - 1
+            LOG_RETURN,     // log(x[t]/x[t-k])
+            ROLLING_MEAN,   // mean of x[t-k+1..t]
+            ROLLING_STD,    // sample standard deviation of x[t-k+1..t]
+            HOUR,           // calendar fields of the row timestamp (UTC)
+            MINUTE_OF_DAY,
+            WEEKDAY,        // 0 = Sunday
+            DAY_OF_MONTH,
+            MONTH
+        };
+        
+        Kind kind;
+        size_t column;      // source column, dp_names<T>() ordering; unused for calendar features
+        unsigned window;    // lag or window length
+        std::string name;
+        
+        bool is_calendar() const {
+            return kind >= HOUR;
+        }
+        
+        // rows at the start of the series for which the feature is undefined
+        size_t warmup() const {
+            switch( kind ){
+                case LAG: case RETURN: case LOG_RETURN: return window;
+                case ROLLING_MEAN: case ROLLING_STD: return window ? window-1 : 0;
+                default: return 0;
+            }
+        }
+    };
+    
+    
+    // KERNELS
+    // compute feature f for rows [r0,r1) given iterators to row 0 of the value
+    // and timestamp columns; writes out[(i-r0)*stride]
+    
+    namespace detail {
+        
+        // mean and M2 (sum of squared deviations) of the window are updated in place as one
+        // value replaces another (Welford), and recomputed exactly from the window values
+        // when it first fills and every w rows after, at fixed row numbers, so rounding
+        // error cannot build up over a long series and row blocks agree with full columns
+        template<typename It> void rolling( const Feature& f, It xs, size_t r0, size_t r1, double* out, ptrdiff_t stride )
+        {
+            const double nan = std::numeric_limits<double>::quiet_NaN();
+            const size_t w = f.window;
+            size_t i = r0 > w ? r0 - w : 0;     // start accumulating up to w rows before r0
+            
+            if( !w ){
+                for( i = r0; i < r1; ++i, out += stride )
+                    *out = nan;
+                return;
+            }
+            
+            It lead = xs, trail = xs;           // trail: oldest row of the window
+            std::advance(lead, i);
+            std::advance(trail, i);
+            
+            double mean = 0, m2 = 0;
+            size_t n = 0;
+            
+            for( ; i < r1; ++i, ++lead ){
+                
+                const double x = *lead;
+                bool exact;
+                
+                if( n < w ){
+                    ++n;
+                    const double d = x - mean;
+                    mean += d / n;
+                    m2 += d * (x - mean);
+                    exact = ( n == w );
+                }
+                else {
+                    const double y = *trail;
+                    ++trail;
+                    const double old = mean;
+                    mean += (x - y) / w;
+                    m2 += (x - y) * (x - mean + y - old);
+                    exact = ( i % w == 0 );
+                }
+                
+                if( exact ){    // two-pass over the full window
+                    It it = trail;
+                    double sum = 0;
+                    for( size_t k = 0; k < w; ++k, ++it )
+                        sum += *it;
+                    mean = sum / w;
+                    it = trail;
+                    m2 = 0;
+                    for( size_t k = 0; k < w; ++k, ++it )
+                        m2 += (*it - mean) * (*it - mean);
+                }
+                
+                if( i < r0 )
+                    continue;
+                
+                double v = nan;
+                if( n == w ){
+                    if( f.kind == Feature::ROLLING_MEAN )
+                        v = mean;
+                    else if( w > 1 )
+                        v = std::sqrt( std::max(0.0, m2 / (w-1)) );
+                }
+                *out = v;
+                out += stride;
+            }
+        }
+        
+        template<typename It> void lagged( const Feature& f, It xs, size_t r0, size_t r1, double* out, ptrdiff_t stride )
+        {
+            const double nan = std::numeric_limits<double>::quiet_NaN();
+            const size_t k = f.window;
+            size_t i = r0;
+            
+            for( ; i < r1 && i < k; ++i, out += stride )
+                *out = nan;
+            
+            if( i == r1 )
+                return;
+            
+            It lead = xs, trail = xs;
+            std::advance(lead, i);
+            std::advance(trail, i-k);
+            
+            for( ; i < r1; ++i, ++lead, ++trail, out += stride ){
+                const double x = *lead, y = *trail;
+                switch( f.kind ){
+                    case Feature::LAG:        *out = y; break;
+                    case Feature::RETURN:     *out = x/y - 1.0; break;
+                    case Feature::LOG_RETURN: *out = std::log(x/y); break;
+                    default:                  *out = nan;
+                }
+            }
+        }
+        
+        template<typename It> void calendar( const Feature& f, It tms, size_t r0, size_t r1, double* out, ptrdiff_t stride )
+        {
+            std::advance(tms, r0);
+            
+            for( size_t i = r0; i < r1; ++i, ++tms, out += stride ){
+                const time_t t = *tms;
+                const long days = utilities::days_from_time_t(t);
+                switch( f.kind ){
+                    case Feature::HOUR:          *out = utilities::seconds_of_day(t) / 3600; break;
+                    case Feature::MINUTE_OF_DAY: *out = utilities::seconds_of_day(t) / 60; break;
+                    case Feature::WEEKDAY:       *out = utilities::weekday_from_days(days); break;
+                    case Feature::DAY_OF_MONTH:  *out = utilities::civil_from_days(days).day; break;
+                    case Feature::MONTH:         *out = utilities::civil_from_days(days).month; break;
+                    default:                     *out = std::numeric_limits<double>::quiet_NaN();
+                }
+            }
+        }
+        
+        // calendar feature from precomputed calendar columns
+        inline void calendar( const Feature& f, const ::calendar::Columns& cal,
+                              size_t r0, size_t r1, double* out, ptrdiff_t stride )
+        {
+            for( size_t i = r0; i < r1; ++i, out += stride ){
+                switch( f.kind ){
+                    case Feature::HOUR:          *out = cal.minute_of_day[i] / 60; break;
+                    case Feature::MINUTE_OF_DAY: *out = cal.minute_of_day[i]; break;
+                    case Feature::WEEKDAY:       *out = cal.weekday[i]; break;
+                    case Feature::DAY_OF_MONTH:  *out = cal.day[i]; break;
+                    case Feature::MONTH:         *out = cal.month[i]; break;
+                    default:                     *out = std::numeric_limits<double>::quiet_NaN();
+                }
+            }
+        }
+        
+        template<typename XIt, typename TIt> void compute( const Feature& f, XIt xs, TIt tms,
+                                                           size_t r0, size_t r1, double* out, ptrdiff_t stride )
+        {
+            if( f.is_calendar() )
+                calendar(f, tms, r0, r1, out, stride);
+            else if( f.kind == Feature::ROLLING_MEAN || f.kind == Feature::ROLLING_STD )
+                rolling(f, xs, r0, r1, out, stride);
+            else
+                lagged(f, xs, r0, r1, out, stride);
+        }
+        
+        // extracts a single field of a datapoint stored in a TimeSeries map
+        template<typename T> struct FieldOf {
+            typedef double result_type;
+            size_t column;
+            double operator()( const std::pair<const time_t, T>& p ) const {
+                double fields[dp::field_count<T>::value];
+                dp::dp_values<T>(p.second, fields);
+                return fields[column];
+            }
+        };
+        
+        struct KeyOf {
+            typedef time_t result_type;
+            template<typename P> time_t operator()( const P& p ) const { return p.first; }
+        };
+        
+    } // namespace detail
+    
+    
+    // -----------------------------------------------------------------
+    // FEATURE MATRIX BUILDER
+    // -----------------------------------------------------------------
+    
+    template<typename T> class FeatureMatrix {
+        
+        BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
+        
+    public:
+        
+        FeatureMatrix(): _features() {};
+        
+        
+        // DECLARATION (chainable); column names as in dp_names<T>(), throw if unknown
+        
+        FeatureMatrix& lag( const std::string& col, unsigned k ){
+            return _add(Feature::LAG, col, k, col+"_lag"+std::to_string(k));
+        }
+        FeatureMatrix& ret( const std::string& col, unsigned k = 1 ){
+            return _add(Feature::RETURN, col, k, col+"_ret"+std::to_string(k));
+        }
+        FeatureMatrix& log_ret( const std::string& col, unsigned k = 1 ){
+            return _add(Feature::LOG_RETURN, col, k, col+"_logret"+std::to_string(k));
+        }
+        FeatureMatrix& rolling_mean( const std::string& col, unsigned w ){
+            return _add(Feature::ROLLING_MEAN, col, w, col+"_mean"+std::to_string(w));
+        }
+        FeatureMatrix& rolling_std( const std::string& col, unsigned w ){
+            return _add(Feature::ROLLING_STD, col, w, col+"_std"+std::to_string(w));
+        }
+        FeatureMatrix& calendar( Feature::Kind kind ){
+            static const char* names[] = { "hour", "minute_of_day", "weekday", "day_of_month", "month" };
+            Feature f = { kind, 0, 0, "" };
+            if( !f.is_calendar() )
+                throw df::DataFrameException("Not a calendar feature.");
+            f.name = names[kind - Feature::HOUR];
+            _features.push_back(f);
+            return *this;
+        }
+        
+        
+        // ACCESSORS
+        
+        size_t ncols() const {
+            return _features.size();
+        }
+        
+        std::vector<std::string> column_names() const {
+            std::vector<std::string> names;
+            for( size_t j = 0; j < _features.size(); ++j )
+                names.push_back(_features[j].name);
+            return names;
+        }
+        
+        const std::vector<Feature>& features() const {
+            return _features;
+        }
+        
+        // largest number of leading rows with undefined features
+        size_t warmup() const {
+            size_t w = 0;
+            for( size_t j = 0; j < _features.size(); ++j )
+                w = std::max(w, _features[j].warmup());
+            return w;
+        }
+        
+        
+        // BUILD
+        // writes a size() x ncols() matrix to out; ld is the leading dimension, i.e. the
+        // distance between rows (ROW_MAJOR, ld >= ncols()) or columns (COL_MAJOR, ld >= size())
+        // out should be 64-byte aligned for best performance; threads = 0 uses all cores
+        
+        void build( const df::DataFrame<T>& src, double* out, size_t ld, Layout layout, unsigned threads = 0 ) const
+        {
+            std::vector<const double*> cols;
+            for( size_t j = 0; j < src.ncols(); ++j )
+                cols.push_back( src.column(j) );
+            
+            const ::calendar::Columns* cal = NULL;
+            for( size_t j = 0; j < _features.size() && !cal; ++j )
+                if( _features[j].is_calendar() )
+                    cal = &src.calendar();  // materialized once, before the workers start
+            
+            _run( src.size(), out, ld, layout, threads, 4096,
+                  [&]( const Feature& f, size_t r0, size_t r1, double* o, ptrdiff_t stride ){
+                      if( f.is_calendar() )
+                          detail::calendar(f, *cal, r0, r1, o, stride);
+                      else
+                          detail::compute(f, cols[f.column], src.index(), r0, r1, o, stride);
+                  });
+        }
+        
+        void build( const ts::TimeSeries<T>& src, double* out, size_t ld, Layout layout, unsigned threads = 0 ) const
+        {
+            typedef typename ts::TimeSeries<T>::const_iterator Iter;
+            
+            // map iterators advance in linear time, so use one row block per thread
+            const size_t block_rows = std::max<size_t>(1, ( src.size() + _threads(threads) - 1 ) / _threads(threads));
+            
+            _run( src.size(), out, ld, layout, threads, block_rows,
+                  [&]( const Feature& f, size_t r0, size_t r1, double* o, ptrdiff_t stride ){
+                      detail::FieldOf<T> field = { f.column };
+                      detail::compute(f,
+                                      boost::make_transform_iterator<detail::FieldOf<T>, Iter>(src.cbegin(), field),
+                                      boost::make_transform_iterator<detail::KeyOf, Iter>(src.cbegin(), detail::KeyOf()),
+                                      r0, r1, o, stride);
+                  });
+        }
+        
+        
+    private:
+        
+        FeatureMatrix& _add( Feature::Kind kind, const std::string& col, unsigned k, const std::string& name ){
+            std::vector<std::string> cols = dp::dp_names<T>();
+            std::vector<std::string>::const_iterator it = std::find(cols.begin(), cols.end(), col);
+            if( it == cols.end() )
+                throw df::DataFrameException("Unknown column name "+col+".");
+            Feature f = { kind, static_cast<size_t>(it - cols.begin()), k, name };
+            _features.push_back(f);
+            return *this;
+        }
+        
+        template<typename Kernel> void _run( size_t rows, double* out, size_t ld, Layout layout,
+                                             unsigned threads, size_t block_rows, Kernel kernel ) const
+        {
+            const size_t ncols = _features.size();
+            
+            if( !out && rows && ncols )
+                throw df::DataFrameException("Null output buffer.");
+            if( ( layout == ROW_MAJOR && ld < ncols ) || ( layout == COL_MAJOR && ld < rows ) )
+                throw df::DataFrameException("Leading dimension too small.");
+            if( !rows || !ncols )
+                return;
+            
+            // COL_MAJOR: one task per feature over all rows
+            // ROW_MAJOR: one task per row block over all features
+            const size_t ntasks = ( layout == COL_MAJOR ) ? ncols : ( rows + block_rows - 1 ) / block_rows;
+            std::atomic<size_t> next(0);
+            
+            auto worker = [&](){
+                for( size_t t = next++; t < ntasks; t = next++ ){
+                    if( layout == COL_MAJOR ){
+                        kernel( _features[t], 0, rows, out + t*ld, 1 );
+                        continue;
+                    }
+                    const size_t r0 = t * block_rows, r1 = std::min(rows, r0 + block_rows);
+                    for( size_t j = 0; j < ncols; ++j )
+                        kernel( _features[j], r0, r1, out + r0*ld + j, static_cast<ptrdiff_t>(ld) );
+                }
+            };
+            
+            const size_t nthreads = std::min<size_t>(_threads(threads), ntasks);
+            std::vector<std::thread> pool;
+            for( size_t i = 1; i < nthreads; ++i )
+                pool.push_back( std::thread(worker) );
+            worker();
+            for( size_t i = 0; i < pool.size(); ++i )
+                pool[i].join();
+        }
+        
+        static unsigned _threads( unsigned requested ){
+            return requested ? requested : std::max(1u, std::thread::hardware_concurrency());
+        }
+        
+        std::vector<Feature> _features;
+        
+    }; // FeatureMatrix class
+    
+} // namespace features
+
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <mutex>
+#include <set>
+#include <cstdio>
+#include <algorithm>
+
+#include "footprint.hpp"
+
+using namespace footprint;
+
+
+std::string footprint::format_bytes( size_t bytes )
+{
+    static const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    double v = static_cast<double>(bytes);
+    size_t u = 0;
+    while( v >= 1024 && u < 4 ){
+        v /= 1024;
+        ++u;
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), u ? "%.1f %s" : "%.0f %s", v, units[u]);
+    return buf;
+}
+
+
+std::string footprint::describe( const Usage& u )
+{
+    return format_bytes(u.total()) + " (payload " + format_bytes(u.payload) + ", index " + format_bytes(u.index)
+         + ", overhead " + format_bytes(u.overhead) + ", caches " + format_bytes(u.caches) + ")";
+}
+
+
+// REGISTRY
+
+namespace footprint {
+    
+    struct Registry {
+        
+        Registry(): head(NULL), count(0) {};
+        
+        void link( Tracked* t ){
+            std::lock_guard<std::mutex> guard(lock);
+            if( t->_linked )
+                return;
+            t->_linked = true;
+            t->_prev = NULL;
+            t->_next = head;
+            if( head )
+                head->_prev = t;
+            head = t;
+            ++count;
+        }
+        
+        void unlink( Tracked* t ){
+            std::lock_guard<std::mutex> guard(lock);
+            if( !t->_linked )
+                return;
+            t->_linked = false;
+            if( t->_prev )
+                t->_prev->_next = t->_next;
+            else
+                head = t->_next;
+            if( t->_next )
+                t->_next->_prev = t->_prev;
+            --count;
+        }
+        
+        std::vector<Entry> snapshot(){
+            std::lock_guard<std::mutex> guard(lock);
+            std::vector<Entry> entries;
+            entries.reserve(count);
+            for( const Tracked* t = head; t; t = t->_next ){
+                Entry e = { t->memory_label(), t->memory() };
+                entries.push_back(e);
+            }
+            return entries;
+        }
+        
+        std::mutex lock;
+        Tracked* head;
+        size_t count;
+    };
+    
+    Registry& registry(){
+        static Registry* r = new Registry();    // leaked: containers may outlive static destruction
+        return *r;
+    }
+}
+
+
+Tracked::Tracked()
+:   _prev(NULL),
+    _next(NULL),
+    _linked(false)
+{}
+
+Tracked::Tracked( const Tracked& )
+:   _prev(NULL),
+    _next(NULL),
+    _linked(false)
+{}
+
+Tracked::~Tracked()
+{
+    untrack();      // no-op unless the final class skipped it
+}
+
+void Tracked::track()
+{
+    registry().link(this);
+}
+
+void Tracked::untrack()
+{
+    registry().unlink(this);
+}
+
+
+std::vector<Entry> footprint::live()
+{
+    std::vector<Entry> entries = registry().snapshot();
+    std::sort( entries.begin(), entries.end(), []( const Entry& a, const Entry& b ){
+        return a.usage.total() > b.usage.total();
+    });
+    return entries;
+}
+
+
+Usage footprint::live_total()
+{
+    const std::vector<Entry> entries = live();
+    std::set<const void*> seen;
+    Usage total;
+    for( size_t i = 0; i < entries.size(); ++i ){
+        const Usage& u = entries[i].usage;
+        if( !u.shared || seen.insert(u.shared).second )  // copies sharing storage count once
+            total += u;
+    }
+    return total;
+}
+
+
+size_t footprint::live_count()
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    return r.count;
+}
+
+
+void footprint::print_live( std::ostream& out, size_t top )
+{
+    const std::vector<Entry> entries = live();
+    
+    out << std::endl << "Live containers: " << entries.size() << ", total " << describe( live_total() ) << std::endl;
+    for( size_t i = 0; i < entries.size() && i < top; ++i )
+        out << "  " << entries[i].label << ": " << describe( entries[i].usage )
+            << ( entries[i].usage.shared ? " [shared]" : "" ) << std::endl;
+}
@@ -0,0 +1,137 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * footprint.hpp
+ *
+ * Design Overview:
+ *
+ * Memory accounting for data containers. TimeSeries and DataFrame derive
+ * from Tracked. The most-derived constructor calls track() as its last
+ * step to link the container into a process-wide registry, and the
+ * destructor calls untrack() as its first, so a snapshot never sees an
+ * object whose virtual accessors are not yet, or no longer, usable. Each
+ * container reports a Usage split into
+ *
+ *   payload    bytes of the values themselves
+ *   index      bytes of the timestamps
+ *   overhead   container structure: map nodes, allocator headers, padding
+ *   caches     derived data such as calendar columns
+ *
+ * Map node sizes are estimates based on the node layout and glibc's malloc
+ * chunk rounding; flat storage is exact. DataFrame copies share their
+ * block, so registry totals count each shared block once.
+ *
+ * Snapshots read the containers without locking them; take them while
+ * the containers are not being modified.
+ *
+ */
+
+
+#ifndef backtester_footprint_hpp
+#define backtester_footprint_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstddef>
+
+namespace footprint {
+    
+    struct Usage {
+        
+        Usage(): payload(0), index(0), overhead(0), caches(0), shared(NULL) {};
+        
+        size_t payload;
+        size_t index;
+        size_t overhead;
+        size_t caches;
+        const void* shared;     // storage possibly shared with other containers, or NULL
+        
+        size_t total() const {
+            return payload + index + overhead + caches;
+        }
+        
+        Usage& operator+=( const Usage& u ){
+            payload += u.payload;
+            index += u.index;
+            overhead += u.overhead;
+            caches += u.caches;
+            return *this;
+        }
+    };
+    
+    // bytes glibc malloc uses for a request of n bytes, header included
+    inline size_t heap_bytes( size_t n ){
+        const size_t chunk = ( n + sizeof(size_t) + 15 ) & ~size_t(15);
+        return chunk < 32 ? 32 : chunk;
+    }
+    
+    std::string format_bytes( size_t bytes );       // "12.3 MB"
+    std::string describe( const Usage& u );         // total and breakdown on one line
+    
+    
+    // base of containers listed in the registry
+    class Tracked {
+        
+    public:
+        virtual Usage memory() const = 0;
+        virtual std::string memory_label() const = 0;
+        
+    protected:
+        Tracked();
+        Tracked( const Tracked& );
+        Tracked& operator=( const Tracked& ) { return *this; }
+        virtual ~Tracked();
+        
+        void track();       // call at the end of every constructor of the final class
+        void untrack();     // call first in its destructor; idempotent
+        
+    private:
+        friend struct Registry;
+        Tracked* _prev;
+        Tracked* _next;
+        bool _linked;
+    };
+    
+    
+    // REGISTRY
+    
+    struct Entry {
+        std::string label;
+        Usage usage;
+    };
+    
+    std::vector<Entry> live();                  // every live container, largest first
+    Usage live_total();                         // sum, shared storage counted once
+    size_t live_count();
+    void print_live( std::ostream& out = std::cout, size_t top = 20 );
+    
+} // namespace footprint
+
+
+#endif
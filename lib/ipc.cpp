@@ -0,0 +1,1218 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * ipc.cpp
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <utility>
+
+#include "ipc.hpp"
+
+using namespace ipc;
+
+// EXCEPTIONS
+
+IpcException::IpcException(const std::string& message):_msg(_spec + message){};
+IpcException::~IpcException() throw(){};
+
+const char* IpcException::what() const throw() {return _msg.c_str(); }
+const std::string IpcException::_spec = "Arrow IPC Exception: ";
+
+
+namespace {
+    
+    // Arrow format constants (Schema.fbs, Message.fbs, File.fbs)
+    
+    const int16_t METADATA_V5 = 4;
+    const uint32_t CONTINUATION = 0xFFFFFFFFu;
+    const char MAGIC[6] = { 'A', 'R', 'R', 'O', 'W', '1' };
+    const size_t BUFFER_ALIGN = 64;
+    
+    enum HeaderType { HEADER_SCHEMA = 1, HEADER_DICTIONARY = 2, HEADER_RECORD_BATCH = 3 };
+    
+    enum TypeId {
+        TYPE_INT = 2, TYPE_FLOAT = 3, TYPE_UTF8 = 5, TYPE_BOOL = 6, TYPE_DATE = 8, TYPE_TIMESTAMP = 10
+    };
+    
+    enum Codec { LZ4_FRAME = 0, ZSTD = 1 };
+    
+    enum Precision { HALF = 0, SINGLE = 1, DOUBLE = 2 };
+    
+    // flatbuffer structs, laid out as in the schema
+    struct FieldNode { int64_t length; int64_t null_count; };
+    struct BufferRef { int64_t offset; int64_t length; };
+    struct Block { int64_t offset; int32_t meta_length; int32_t pad; int64_t body_length; };
+    
+    
+    // -----------------------------------------------------------------
+    // FLATBUFFER WRITING
+    // -----------------------------------------------------------------
+    
+    // Builds a flatbuffer back to front, like the reference builder: children
+    // are created before their parents, so every uoffset points forward.
+    // References returned are distances from the end of the buffer.
+    class FlatBuilder {
+        
+    public:
+        
+        FlatBuilder(): _buf(), _fields(), _start(0) {};
+        
+        size_t size() const { return _buf.size(); }
+        
+        uint32_t string( const std::string& s ){
+            align( 4, s.size() + 1 );
+            _buf.insert( _buf.begin(), 1, 0 );
+            _buf.insert( _buf.begin(), s.begin(), s.end() );
+            push<uint32_t>( static_cast<uint32_t>( s.size() ) );
+            return ref();
+        }
+        
+        uint32_t offsets( const std::vector<uint32_t>& refs ){
+            align( 4, refs.size() * 4 );
+            for( size_t i = refs.size(); i-- > 0; )
+                push_offset( refs[i] );
+            push<uint32_t>( static_cast<uint32_t>( refs.size() ) );
+            return ref();
+        }
+        
+        template<typename S> uint32_t structs( const std::vector<S>& v ){
+            align( 8, v.size() * sizeof(S) );
+            const char* p = v.empty() ? NULL : reinterpret_cast<const char*>( &v[0] );
+            _buf.insert( _buf.begin(), p, p + v.size() * sizeof(S) );
+            push<uint32_t>( static_cast<uint32_t>( v.size() ) );
+            return ref();
+        }
+        
+        void start_table(){
+            _fields.clear();
+            _start = size();
+        }
+        
+        template<typename V> void add( uint16_t id, V v ){
+            push<V>(v);
+            _fields.push_back( std::make_pair( id, ref() ) );
+        }
+        
+        void add_offset( uint16_t id, uint32_t target ){
+            push_offset(target);
+            _fields.push_back( std::make_pair( id, ref() ) );
+        }
+        
+        uint32_t end_table(){
+            push<int32_t>(0);
+            const uint32_t table = ref();
+            
+            uint16_t n = 0;
+            for( size_t i = 0; i < _fields.size(); ++i )
+                n = std::max<uint16_t>( n, _fields[i].first + 1 );
+            std::vector<uint16_t> vt( n, 0 );
+            for( size_t i = 0; i < _fields.size(); ++i )
+                vt[ _fields[i].first ] = static_cast<uint16_t>( table - _fields[i].second );
+            
+            for( size_t i = n; i-- > 0; )
+                push<uint16_t>( vt[i] );
+            push<uint16_t>( static_cast<uint16_t>( table - _start ) );
+            push<uint16_t>( static_cast<uint16_t>( 4 + 2*n ) );
+            
+            // the table's first word is the signed distance back to its vtable
+            const int32_t soffset = static_cast<int32_t>( ref() - table );
+            std::memcpy( &_buf[ size() - table ], &soffset, sizeof(soffset) );
+            return table;
+        }
+        
+        const std::vector<char>& finish( uint32_t root ){
+            align( 8, 4 );
+            push_offset(root);
+            return _buf;
+        }
+        
+    private:
+        
+        uint32_t ref() const { return static_cast<uint32_t>( size() ); }
+        
+        void align( size_t a, size_t extra = 0 ){
+            const size_t pad = ( a - (size() + extra) % a ) % a;
+            _buf.insert( _buf.begin(), pad, 0 );
+        }
+        
+        template<typename V> void push( V v ){
+            align( sizeof(V) );
+            const char* p = reinterpret_cast<const char*>(&v);
+            _buf.insert( _buf.begin(), p, p + sizeof(V) );
+        }
+        
+        void push_offset( uint32_t target ){
+            align(4);
+            push<uint32_t>( ref() + 4 - target );
+        }
+        
+        std::vector<char> _buf;
+        std::vector< std::pair<uint16_t, uint32_t> > _fields;
+        size_t _start;
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // FLATBUFFER READING
+    // -----------------------------------------------------------------
+    
+    // a bounds-checked view on one table inside a flatbuffer
+    class FlatTable {
+        
+    public:
+        
+        FlatTable(): _base(NULL), _size(0), _pos(0), _vt(0), _vt_size(0) {};
+        
+        FlatTable( const uint8_t* base, size_t size, size_t pos )
+        :   _base(base), _size(size), _pos(pos)
+        {
+            const int64_t vt = int64_t(pos) - read<int32_t>(pos);
+            if( vt < 0 || size_t(vt) + 4 > size )
+                malformed();
+            _vt = size_t(vt);
+            _vt_size = read<uint16_t>(_vt);
+            if( _vt + _vt_size > size )
+                malformed();
+        }
+        
+        // the root table of the flatbuffer at base
+        static FlatTable root( const uint8_t* base, size_t size ){
+            uint32_t pos;
+            if( size < 4 )
+                malformed();
+            std::memcpy( &pos, base, 4 );
+            return FlatTable( base, size, pos );
+        }
+        
+        bool has( uint16_t id ) const { return field(id) != 0; }
+        
+        template<typename V> V scalar( uint16_t id, V def ) const {
+            const size_t f = field(id);
+            return f ? read<V>(f) : def;
+        }
+        
+        FlatTable table( uint16_t id ) const {
+            const size_t f = field(id);
+            if( !f )
+                malformed();
+            return FlatTable( _base, _size, target(f) );
+        }
+        
+        std::string string( uint16_t id ) const {
+            const size_t f = field(id);
+            if( !f )
+                return std::string();
+            const size_t s = target(f);
+            const uint32_t n = read<uint32_t>(s);
+            if( s + 4 + n > _size )
+                malformed();
+            return std::string( reinterpret_cast<const char*>(_base + s + 4), n );
+        }
+        
+        // element count of a vector; 0 if absent
+        size_t length( uint16_t id ) const {
+            const size_t f = field(id);
+            return f ? read<uint32_t>( target(f) ) : 0;
+        }
+        
+        // i-th table of a vector of tables
+        FlatTable element( uint16_t id, size_t i ) const {
+            const size_t e = elements( id, i, 4 );
+            return FlatTable( _base, _size, target(e) );
+        }
+        
+        // i-th struct of a vector of structs
+        template<typename S> S element( uint16_t id, size_t i ) const {
+            S s;
+            std::memcpy( &s, _base + elements( id, i, sizeof(S) ), sizeof(S) );
+            return s;
+        }
+        
+        static void malformed(){
+            throw IpcException("Malformed flatbuffer metadata.");
+        }
+        
+    private:
+        
+        template<typename V> V read( size_t pos ) const {
+            if( pos + sizeof(V) > _size )
+                malformed();
+            V v;
+            std::memcpy( &v, _base + pos, sizeof(V) );
+            return v;
+        }
+        
+        size_t field( uint16_t id ) const {
+            const size_t slot = 4 + 2*size_t(id);
+            if( slot + 2 > _vt_size )
+                return 0;
+            const uint16_t off = read<uint16_t>( _vt + slot );
+            return off ? _pos + off : 0;
+        }
+        
+        size_t target( size_t pos ) const {
+            const size_t t = pos + read<uint32_t>(pos);
+            if( t >= _size )
+                malformed();
+            return t;
+        }
+        
+        size_t elements( uint16_t id, size_t i, size_t width ) const {
+            const size_t f = field(id);
+            if( !f )
+                malformed();
+            const size_t v = target(f);
+            if( i >= read<uint32_t>(v) || v + 4 + (i+1)*width > _size )
+                malformed();
+            return v + 4 + i*width;
+        }
+        
+        const uint8_t* _base;
+        size_t _size;
+        size_t _pos;
+        size_t _vt;
+        uint16_t _vt_size;
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // SCHEMA
+    // -----------------------------------------------------------------
+    
+    uint32_t type_table( FlatBuilder& b, df::ColumnType type ){
+        b.start_table();
+        switch( type ){
+            case df::INT32:     b.add<int32_t>(0, 32); b.add<uint8_t>(1, 1); break;
+            case df::INT64:     b.add<int32_t>(0, 64); b.add<uint8_t>(1, 1); break;
+            case df::FLOAT64:   b.add<int16_t>(0, DOUBLE); break;
+            case df::STRING:    break;
+        }
+        return b.end_table();
+    }
+    
+    uint8_t type_id( df::ColumnType type ){
+        switch( type ){
+            case df::INT32:
+            case df::INT64:     return TYPE_INT;
+            case df::FLOAT64:   return TYPE_FLOAT;
+            case df::STRING:    return TYPE_UTF8;
+        }
+        return 0;
+    }
+    
+    uint32_t field_table( FlatBuilder& b, const std::string& name, bool nullable,
+                          uint8_t type, uint32_t type_ref ){
+        const uint32_t name_ref = b.string(name);
+        const uint32_t children = b.offsets( std::vector<uint32_t>() );
+        b.start_table();
+        b.add_offset(0, name_ref);
+        b.add<uint8_t>(1, nullable);
+        b.add<uint8_t>(2, type);
+        b.add_offset(3, type_ref);
+        b.add_offset(5, children);
+        return b.end_table();
+    }
+    
+    uint32_t schema_table( FlatBuilder& b, const df::DynFrame& frame ){
+        
+        std::vector<uint32_t> fields;
+        
+        b.start_table();                            // Timestamp{unit: SECOND}
+        b.add<int16_t>(0, 0);
+        const uint32_t ts_type = b.end_table();
+        fields.push_back( field_table( b, INDEX_NAME, false, TYPE_TIMESTAMP, ts_type ) );
+        
+        for( size_t j = 0; j < frame.ncols(); ++j ){
+            const df::Column& c = frame.column(j);
+            const uint32_t t = type_table( b, c.type );
+            fields.push_back( field_table( b, c.name, true, type_id(c.type), t ) );
+        }
+        const uint32_t fields_ref = b.offsets(fields);
+        
+        std::vector<uint32_t> custom;
+        if( !frame.meta().empty() ){
+            const uint32_t key = b.string("meta");
+            const uint32_t value = b.string( frame.meta() );
+            b.start_table();
+            b.add_offset(0, key);
+            b.add_offset(1, value);
+            custom.push_back( b.end_table() );
+        }
+        const uint32_t custom_ref = custom.empty() ? 0 : b.offsets(custom);
+        
+        b.start_table();
+        b.add<int16_t>(0, 0);                       // little endian
+        b.add_offset(1, fields_ref);
+        if( custom_ref )
+            b.add_offset(2, custom_ref);
+        return b.end_table();
+    }
+    
+    std::vector<char> message( uint8_t header_type, uint32_t header, int64_t body_length, FlatBuilder& b ){
+        b.start_table();
+        b.add<int16_t>(0, METADATA_V5);
+        b.add<uint8_t>(1, header_type);
+        b.add_offset(2, header);
+        b.add<int64_t>(3, body_length);
+        return b.finish( b.end_table() );
+    }
+    
+    
+    // -----------------------------------------------------------------
+    // OUTPUT
+    // -----------------------------------------------------------------
+    
+    size_t padded( size_t n ){
+        return (n + BUFFER_ALIGN - 1) / BUFFER_ALIGN * BUFFER_ALIGN;
+    }
+    
+    class Output {
+        
+    public:
+        
+        Output( int fd, const std::string& path ): _fd(fd), _path(path), _pos(0) {};
+        
+        size_t pos() const { return _pos; }
+        
+        void write( const void* data, size_t n ){
+            const char* p = static_cast<const char*>(data);
+            _pos += n;
+            while( n ){
+                ssize_t w = ::write( _fd, p, n );
+                if( w < 0 && errno == EINTR )
+                    continue;
+                if( w <= 0 )
+                    throw IpcException("Write to "+_path+" failed.");
+                p += w; n -= static_cast<size_t>(w);
+            }
+        }
+        
+        void zeros( size_t n ){
+            static const char z[BUFFER_ALIGN] = {};
+            while( n ){
+                const size_t k = std::min( n, sizeof(z) );
+                write( z, k );
+                n -= k;
+            }
+        }
+        
+        // continuation marker, metadata length, metadata; returns the Block without body
+        Block message( const std::vector<char>& meta ){
+            Block blk = { int64_t(_pos), int32_t(8 + meta.size()), 0, 0 };
+            const int32_t length = static_cast<int32_t>( meta.size() );  // a multiple of 8
+            write( &CONTINUATION, 4 );
+            write( &length, 4 );
+            write( &meta[0], meta.size() );
+            return blk;
+        }
+        
+    private:
+        int _fd;
+        std::string _path;
+        size_t _pos;
+    };
+    
+    
+    // one buffer of a record batch body
+    struct Piece {
+        const void* data;
+        size_t bytes;
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // INPUT
+    // -----------------------------------------------------------------
+    
+    struct MappedFile {
+        const uint8_t* data;
+        size_t bytes;
+        
+        MappedFile(): data(NULL), bytes(0) {};
+        ~MappedFile(){
+            if( data )
+                munmap( const_cast<uint8_t*>(data), bytes );
+        }
+    };
+    
+    std::shared_ptr<MappedFile> map_file( const std::string& path ){
+        int fd = ::open( path.c_str(), O_RDONLY );
+        if( fd < 0 )
+            throw IpcException("Could not open "+path+".");
+        
+        struct stat st;
+        if( fstat(fd, &st) != 0 ){
+            ::close(fd);
+            throw IpcException("Could not stat "+path+".");
+        }
+        
+        std::shared_ptr<MappedFile> m( new MappedFile() );
+        m->bytes = static_cast<size_t>( st.st_size );
+        if( m->bytes ){
+            void* addr = mmap( NULL, m->bytes, PROT_READ, MAP_SHARED, fd, 0 );
+            if( addr == MAP_FAILED ){
+                ::close(fd);
+                throw IpcException("Could not map "+path+".");
+            }
+            m->data = static_cast<const uint8_t*>(addr);
+            madvise( addr, m->bytes, MADV_WILLNEED );
+        }
+        ::close(fd);
+        return m;
+    }
+    
+    // one schema field with the parameters of its type
+    struct FieldInfo {
+        std::string name;
+        uint8_t type;
+        int bits;                   // Int: bit width
+        bool is_signed;             // Int
+        int16_t unit;               // Timestamp/Date unit, FloatingPoint precision
+    };
+    
+    struct Batch {
+        int64_t length;
+        std::vector<FieldNode> nodes;
+        std::vector<BufferRef> buffers;
+        const uint8_t* body;
+        size_t body_size;
+    };
+    
+    // a column's buffers within one batch
+    struct Slice {
+        size_t length;
+        size_t null_count;
+        const uint8_t* validity;    // NULL if all valid
+        const uint8_t* values;
+        const int32_t* offsets;     // Utf8 only
+    };
+    
+    std::vector<FieldInfo> parse_schema( const FlatTable& schema, std::string& meta ){
+        
+        if( schema.scalar<int16_t>(0, 0) != 0 )
+            throw IpcException("Big endian data is not supported.");
+        
+        for( size_t i = 0; i < schema.length(2); ++i ){
+            FlatTable kv = schema.element(2, i);
+            if( kv.string(0) == "meta" )
+                meta = kv.string(1);
+        }
+        
+        std::vector<FieldInfo> fields;
+        for( size_t i = 0; i < schema.length(1); ++i ){
+            FlatTable f = schema.element(1, i);
+            FieldInfo info = { f.string(0), f.scalar<uint8_t>(2, 0), 0, false, 0 };
+            
+            if( f.has(4) )
+                throw IpcException("Dictionary encoded column "+info.name+" is not supported.");
+            
+            FlatTable t = f.table(3);
+            switch( info.type ){
+                case TYPE_INT:
+                    info.bits = t.scalar<int32_t>(0, 0);
+                    info.is_signed = t.scalar<uint8_t>(1, 0) != 0;
+                    if( info.bits != 8 && info.bits != 16 && info.bits != 32 && info.bits != 64 )
+                        throw IpcException("Column "+info.name+" has an invalid integer width.");
+                    break;
+                case TYPE_FLOAT:
+                    info.unit = t.scalar<int16_t>(0, HALF);
+                    if( info.unit == HALF )
+                        throw IpcException("Half precision column "+info.name+" is not supported.");
+                    break;
+                case TYPE_TIMESTAMP:
+                case TYPE_DATE:
+                    info.unit = t.scalar<int16_t>(0, info.type == TYPE_DATE ? 1 : 0);
+                    break;
+                case TYPE_UTF8:
+                case TYPE_BOOL:
+                    break;
+                default:
+                    throw IpcException("Column "+info.name+" has an unsupported Arrow type.");
+            }
+            fields.push_back(info);
+        }
+        return fields;
+    }
+    
+    // parses the encapsulated message at pos; returns false at end of stream
+    bool parse_message( const MappedFile& m, size_t& pos, FlatTable& header, uint8_t& type,
+                        const uint8_t*& body, size_t& body_size ){
+        
+        uint32_t length;
+        if( pos + 4 > m.bytes )
+            return false;
+        std::memcpy( &length, m.data + pos, 4 );
+        pos += 4;
+        if( length == CONTINUATION ){               // absent before format 0.15
+            if( pos + 4 > m.bytes )
+                return false;
+            std::memcpy( &length, m.data + pos, 4 );
+            pos += 4;
+        }
+        if( length == 0 )
+            return false;
+        if( pos + length > m.bytes )
+            throw IpcException("Truncated message.");
+        
+        FlatTable msg = FlatTable::root( m.data + pos, length );
+        if( msg.scalar<int16_t>(0, 0) < METADATA_V5 - 1 )
+            throw IpcException("Metadata versions before V4 are not supported.");
+        
+        type = msg.scalar<uint8_t>(1, 0);
+        header = msg.table(2);
+        const int64_t body_length = msg.scalar<int64_t>(3, 0);
+        
+        pos += length;
+        if( pos % 8 )
+            throw IpcException("Message body is not 8-byte aligned.");
+        if( body_length < 0 || pos + size_t(body_length) > m.bytes )
+            throw IpcException("Truncated message body.");
+        body = m.data + pos;
+        body_size = size_t(body_length);
+        pos += body_size;
+        return true;
+    }
+    
+    // -----------------------------------------------------------------
+    // DECOMPRESSION
+    // -----------------------------------------------------------------
+    
+    void corrupt(){
+        throw IpcException("Corrupt LZ4 compressed buffer.");
+    }
+    
+    // length of an LZ4 literal run or match, extended by 255-bytes
+    size_t lz4_length( size_t n, const uint8_t*& ip, const uint8_t* end ){
+        if( n != 15 )
+            return n;
+        uint8_t b;
+        do {
+            if( ip == end )
+                corrupt();
+            b = *ip++;
+            n += b;
+        } while( b == 255 );
+        return n;
+    }
+    
+    // decodes one LZ4 block appending to out[pos...]; matches may reach back
+    // into earlier blocks of the same frame, which covers linked blocks
+    void lz4_block( const uint8_t* ip, const uint8_t* end, uint8_t* out, size_t& pos, size_t cap ){
+        while( ip < end ){
+            const uint8_t token = *ip++;
+            
+            const size_t lit = lz4_length( token >> 4, ip, end );
+            if( lit > size_t(end - ip) || lit > cap - pos )
+                corrupt();
+            std::memcpy( out + pos, ip, lit );
+            ip += lit;
+            pos += lit;
+            if( ip == end )
+                break;                                      // the last sequence has no match
+            
+            if( end - ip < 2 )
+                corrupt();
+            const size_t offset = size_t(ip[0]) | size_t(ip[1]) << 8;
+            ip += 2;
+            const size_t len = lz4_length( token & 15, ip, end ) + 4;
+            if( offset == 0 || offset > pos || len > cap - pos )
+                corrupt();
+            for( size_t i = 0; i < len; ++i, ++pos )         // may overlap its own output
+                out[pos] = out[pos - offset];
+        }
+    }
+    
+    // decodes an LZ4 frame into exactly cap bytes; checksums are not verified
+    void lz4_frame( const uint8_t* ip, size_t n, uint8_t* out, size_t cap ){
+        const uint8_t* end = ip + n;
+        uint32_t magic;
+        if( n < 7 )
+            corrupt();
+        std::memcpy( &magic, ip, 4 );
+        const uint8_t flg = ip[4];
+        if( magic != 0x184D2204u || ( flg >> 6 ) != 1 )
+            corrupt();
+        ip += 4 + 2 + ( flg & 0x08 ? 8 : 0 ) + ( flg & 0x01 ? 4 : 0 ) + 1;     // FLG BD [size] [dict] HC
+        
+        size_t pos = 0;
+        for( ;; ){
+            uint32_t size;
+            if( end - ip < 4 )
+                corrupt();
+            std::memcpy( &size, ip, 4 );
+            ip += 4;
+            if( size == 0 )
+                break;                                      // end mark
+            const size_t len = size & 0x7FFFFFFFu;
+            if( len > size_t(end - ip) )
+                corrupt();
+            if( size & 0x80000000u ){                       // stored uncompressed
+                if( len > cap - pos )
+                    corrupt();
+                std::memcpy( out + pos, ip, len );
+                pos += len;
+            }
+            else
+                lz4_block( ip, ip + len, out, pos, cap );
+            ip += len + ( flg & 0x10 ? 4 : 0 );             // block checksum
+        }
+        if( pos != cap )
+            corrupt();
+    }
+    
+    // decompresses every buffer of an LZ4_FRAME compressed batch body into a
+    // new body owned by the frame, rewriting the buffer references to match
+    const uint8_t* decompress( std::vector<BufferRef>& buffers, const uint8_t* body, size_t& body_size,
+                               std::vector< std::vector<char> >& owned ){
+        
+        std::vector<int64_t> sizes( buffers.size(), 0 );     // uncompressed length, -1 if stored as is
+        size_t total = 0;
+        for( size_t i = 0; i < buffers.size(); ++i ){
+            const BufferRef& r = buffers[i];
+            if( r.length == 0 )
+                continue;
+            if( r.length < 8 )
+                corrupt();
+            std::memcpy( &sizes[i], body + r.offset, 8 );
+            const int64_t n = sizes[i] < 0 ? r.length - 8 : sizes[i];
+            if( sizes[i] < -1 || n > int64_t( std::numeric_limits<int32_t>::max() ) )
+                corrupt();
+            total += ( size_t(n) + 7 ) & ~size_t(7);
+        }
+        
+        owned.push_back( std::vector<char>( std::max<size_t>( total, 1 ) ) );
+        uint8_t* out = reinterpret_cast<uint8_t*>( &owned.back()[0] );
+        size_t pos = 0;
+        for( size_t i = 0; i < buffers.size(); ++i ){
+            BufferRef& r = buffers[i];
+            const uint8_t* src = body + r.offset + 8;
+            const size_t n = size_t( sizes[i] < 0 ? r.length - 8 : sizes[i] );
+            if( sizes[i] < 0 )
+                std::memcpy( out + pos, src, n );
+            else if( n )
+                lz4_frame( src, size_t(r.length) - 8, out + pos, n );
+            r.offset = int64_t(pos);
+            r.length = int64_t(n);
+            pos += ( n + 7 ) & ~size_t(7);
+        }
+        body_size = total;
+        return out;
+    }
+    
+    Batch parse_batch( const FlatTable& rb, const uint8_t* body, size_t body_size,
+                       std::vector< std::vector<char> >& owned ){
+        
+        Batch b;
+        b.length = rb.scalar<int64_t>(0, 0);
+        for( size_t i = 0; i < rb.length(1); ++i )
+            b.nodes.push_back( rb.element<FieldNode>(1, i) );
+        for( size_t i = 0; i < rb.length(2); ++i ){
+            BufferRef r = rb.element<BufferRef>(2, i);
+            if( r.offset < 0 || r.length < 0 || r.offset % 8 || size_t(r.offset + r.length) > body_size )
+                throw IpcException("Record batch buffer out of range.");
+            b.buffers.push_back(r);
+        }
+        if( b.length < 0 )
+            FlatTable::malformed();
+        
+        if( rb.has(3) ){
+            const FlatTable c = rb.table(3);
+            if( c.scalar<int8_t>(0, LZ4_FRAME) != LZ4_FRAME || c.scalar<int8_t>(1, 0) != 0 )
+                throw IpcException("Only LZ4_FRAME compressed record batches are supported;"
+                                   " write with compression='lz4' or compression='uncompressed'.");
+            body = decompress( b.buffers, body, body_size, owned );
+        }
+        b.body = body;
+        b.body_size = body_size;
+        return b;
+    }
+    
+    // buffers of every column in a batch, in schema order
+    std::vector<Slice> slices( const Batch& b, const std::vector<FieldInfo>& fields ){
+        
+        if( b.nodes.size() != fields.size() )
+            throw IpcException("Record batch does not match the schema.");
+        
+        std::vector<Slice> out;
+        size_t k = 0;
+        for( size_t j = 0; j < fields.size(); ++j ){
+            const size_t nbuf = fields[j].type == TYPE_UTF8 ? 3 : 2;
+            if( k + nbuf > b.buffers.size() || b.nodes[j].length != b.length )
+                throw IpcException("Record batch does not match the schema.");
+            
+            Slice s;
+            s.length = size_t( b.nodes[j].length );
+            s.null_count = size_t( b.nodes[j].null_count );
+            s.validity = ( s.null_count && b.buffers[k].length ) ? b.body + b.buffers[k].offset : NULL;
+            s.offsets = NULL;
+            
+            size_t need;
+            const BufferRef& v = b.buffers[k + nbuf - 1];
+            if( nbuf == 3 ){
+                const BufferRef& o = b.buffers[k+1];
+                if( size_t(o.length) < (s.length + 1) * 4 )
+                    throw IpcException("Offsets of column "+fields[j].name+" are truncated.");
+                s.offsets = reinterpret_cast<const int32_t*>( b.body + o.offset );
+                for( size_t i = 0; i < s.length; ++i )
+                    if( s.offsets[i] < 0 || s.offsets[i] > s.offsets[i+1] )
+                        throw IpcException("Offsets of column "+fields[j].name+" are invalid.");
+                need = s.length ? size_t( s.offsets[s.length] ) : 0;
+            }
+            else {
+                const int width = fields[j].type == TYPE_BOOL ? 0
+                                : fields[j].type == TYPE_INT ? fields[j].bits / 8
+                                : fields[j].type == TYPE_FLOAT ? ( fields[j].unit == SINGLE ? 4 : 8 )
+                                : fields[j].type == TYPE_DATE ? ( fields[j].unit == 0 ? 4 : 8 )
+                                : 8;
+                need = width ? s.length * size_t(width) : ( s.length + 7 ) / 8;
+            }
+            if( size_t(v.length) < need )
+                throw IpcException("Values of column "+fields[j].name+" are truncated.");
+            if( s.validity && size_t(b.buffers[k].length) < (s.length + 7) / 8 )
+                throw IpcException("Validity of column "+fields[j].name+" is truncated.");
+            s.values = b.body + v.offset;
+            
+            out.push_back(s);
+            k += nbuf;
+        }
+        return out;
+    }
+    
+    
+    // -----------------------------------------------------------------
+    // CONVERSION
+    // -----------------------------------------------------------------
+    
+    template<typename V> V load( const uint8_t* p, size_t i ){
+        V v;
+        std::memcpy( &v, p + i*sizeof(V), sizeof(V) );
+        return v;
+    }
+    
+    bool bit( const uint8_t* p, size_t i ){
+        return ( p[i >> 3] >> (i & 7) ) & 1;
+    }
+    
+    bool valid( const Slice& s, size_t i ){
+        return !s.validity || bit( s.validity, i );
+    }
+    
+    int64_t integer( const FieldInfo& f, const uint8_t* p, size_t i ){
+        switch( f.bits ){
+            case 8:     return f.is_signed ? int64_t( load<int8_t>(p, i) ) : int64_t( load<uint8_t>(p, i) );
+            case 16:    return f.is_signed ? int64_t( load<int16_t>(p, i) ) : int64_t( load<uint16_t>(p, i) );
+            case 32:    return f.is_signed ? int64_t( load<int32_t>(p, i) ) : int64_t( load<uint32_t>(p, i) );
+            default:    return load<int64_t>(p, i);
+        }
+    }
+    
+    int64_t floor_div( int64_t a, int64_t b ){
+        const int64_t q = a / b;
+        return ( a % b != 0 && a < 0 ) ? q - 1 : q;
+    }
+    
+    // Timestamp or Date value in unix seconds, rounded down
+    int64_t seconds( const FieldInfo& f, const uint8_t* p, size_t i ){
+        if( f.type == TYPE_DATE )
+            return f.unit == 0 ? int64_t( load<int32_t>(p, i) ) * 86400 : floor_div( load<int64_t>(p, i), 1000 );
+        static const int64_t per_second[4] = { 1, 1000, 1000000, 1000000000 };
+        return floor_div( load<int64_t>(p, i), per_second[ f.unit & 3 ] );
+    }
+    
+    // the column type a field is read as
+    df::ColumnType column_type( const FieldInfo& f, bool nulls ){
+        switch( f.type ){
+            case TYPE_INT:
+                if( nulls )
+                    return df::FLOAT64;
+                return ( f.bits < 32 || ( f.bits == 32 && f.is_signed ) ) ? df::INT32 : df::INT64;
+            case TYPE_BOOL:
+                return nulls ? df::FLOAT64 : df::INT32;
+            case TYPE_FLOAT:
+                return df::FLOAT64;
+            case TYPE_UTF8:
+                return df::STRING;
+            default:
+                return nulls ? df::FLOAT64 : df::INT64;
+        }
+    }
+    
+    // true if the slice already holds values of type in their stored form
+    bool native_layout( const FieldInfo& f, df::ColumnType type, const Slice& s ){
+        if( s.null_count && type != df::STRING )
+            return false;
+        if( reinterpret_cast<uintptr_t>(s.values) % 8 || ( s.offsets && reinterpret_cast<uintptr_t>(s.offsets) % 4 ) )
+            return false;
+        switch( f.type ){
+            case TYPE_INT:          return f.is_signed && ( f.bits == 32 || f.bits == 64 );
+            case TYPE_FLOAT:        return f.unit == DOUBLE;
+            case TYPE_UTF8:         return true;
+            case TYPE_TIMESTAMP:    return f.unit == 0;
+            default:                return false;
+        }
+    }
+    
+    // converts the slices of one field into a buffer of type; returns the data pointer
+    const void* convert( const FieldInfo& f, df::ColumnType type, const std::vector<const Slice*>& parts,
+                         size_t rows, std::vector< std::vector<char> >& owned, const int32_t*& offsets ){
+        
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        
+        if( type == df::STRING ){
+            owned.push_back( std::vector<char>( (rows + 1) * sizeof(int32_t) ) );
+            int32_t* off = reinterpret_cast<int32_t*>( &owned.back()[0] );
+            std::vector<char> chars;
+            size_t r = 0;
+            off[0] = 0;
+            for( size_t k = 0; k < parts.size(); ++k ){
+                const Slice& s = *parts[k];
+                for( size_t i = 0; i < s.length; ++i, ++r ){
+                    if( valid(s, i) )
+                        chars.insert( chars.end(), s.values + s.offsets[i], s.values + s.offsets[i+1] );
+                    if( chars.size() > size_t( std::numeric_limits<int32_t>::max() ) )
+                        throw IpcException("Column "+f.name+" exceeds 2 GB of text.");
+                    off[r+1] = static_cast<int32_t>( chars.size() );
+                }
+            }
+            offsets = off;
+            owned.push_back( chars );
+            return owned.back().empty() ? NULL : &owned.back()[0];
+        }
+        
+        const size_t width = type == df::INT32 ? 4 : 8;
+        owned.push_back( std::vector<char>( std::max<size_t>( rows * width, 1 ) ) );
+        char* out = &owned.back()[0];
+        size_t r = 0;
+        
+        for( size_t k = 0; k < parts.size(); ++k ){
+            const Slice& s = *parts[k];
+            for( size_t i = 0; i < s.length; ++i, ++r ){
+                double d;
+                int64_t v;
+                if( f.type == TYPE_FLOAT ){
+                    d = f.unit == SINGLE ? double( load<float>(s.values, i) ) : load<double>(s.values, i);
+                    v = 0;
+                }
+                else {
+                    v = f.type == TYPE_INT ? integer(f, s.values, i)
+                      : f.type == TYPE_BOOL ? int64_t( bit(s.values, i) )
+                      : seconds(f, s.values, i);
+                    d = double(v);
+                }
+                
+                switch( type ){
+                    case df::INT32:   { const int32_t x = int32_t(v); std::memcpy( out + r*4, &x, 4 ); break; }
+                    case df::INT64:   std::memcpy( out + r*8, &v, 8 ); break;
+                    default:          { if( !valid(s, i) ) d = nan; std::memcpy( out + r*8, &d, 8 ); break; }
+                }
+            }
+        }
+        offsets = NULL;
+        return out;
+    }
+    
+    // keeps the mapping and any converted buffers alive for the frame's lifetime
+    struct Holder {
+        std::shared_ptr<MappedFile> map;
+        std::vector< std::vector<char> > owned;
+    };
+}
+
+
+// -----------------------------------------------------------------
+// WRITING
+// -----------------------------------------------------------------
+
+void ipc::write( const std::string& path, const df::DynFrame& frame, Format format, size_t batch_rows )
+{
+    const size_t rows = frame.size();
+    if( batch_rows == 0 )
+        batch_rows = std::max<size_t>( rows, 1 );
+    
+    const std::string tmp = path + ".tmp";
+    int fd = ::open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( fd < 0 )
+        throw IpcException("Could not open "+tmp+".");
+    
+    try {
+        Output out( fd, path );
+        std::vector<Block> blocks;
+        
+        if( format == FILE ){
+            out.write( MAGIC, sizeof(MAGIC) );
+            out.zeros(2);
+        }
+        
+        {
+            FlatBuilder b;
+            const uint32_t schema = schema_table( b, frame );
+            out.message( message( HEADER_SCHEMA, schema, 0, b ) );
+        }
+        
+        for( size_t r0 = 0; r0 < rows || ( rows == 0 && r0 == 0 ); r0 += batch_rows ){
+            
+            const size_t n = std::min( batch_rows, rows - r0 );
+            
+            // buffers in schema order: validity (empty, no nulls), then values or offsets + chars
+            std::vector<Piece> pieces;
+            std::vector< std::vector<int32_t> > rebased;
+            rebased.reserve( frame.ncols() );
+            
+            const Piece none = { NULL, 0 };
+            const Piece index = { frame.index() + r0, n * sizeof(time_t) };
+            pieces.push_back(none);
+            pieces.push_back(index);
+            
+            for( size_t j = 0; j < frame.ncols(); ++j ){
+                const df::Column& c = frame.column(j);
+                pieces.push_back(none);
+                if( c.type == df::STRING ){
+                    const int32_t base = n ? c.offsets[r0] : 0;
+                    rebased.push_back( std::vector<int32_t>( n + 1 ) );
+                    for( size_t i = 0; i <= n; ++i )
+                        rebased.back()[i] = n ? c.offsets[r0 + i] - base : 0;
+                    const Piece offsets = { &rebased.back()[0], (n + 1) * sizeof(int32_t) };
+                    const Piece chars = { static_cast<const char*>(c.data) + base, size_t( rebased.back()[n] ) };
+                    pieces.push_back(offsets);
+                    pieces.push_back(chars);
+                }
+                else {
+                    const size_t width = c.type == df::INT32 ? 4 : 8;
+                    const Piece values = { static_cast<const char*>(c.data) + r0 * width, n * width };
+                    pieces.push_back(values);
+                }
+            }
+            
+            std::vector<FieldNode> nodes( frame.ncols() + 1 );
+            for( size_t j = 0; j < nodes.size(); ++j ){
+                nodes[j].length = int64_t(n);
+                nodes[j].null_count = 0;
+            }
+            
+            std::vector<BufferRef> buffers;
+            size_t body = 0;
+            for( size_t k = 0; k < pieces.size(); ++k ){
+                const BufferRef r = { int64_t(body), int64_t(pieces[k].bytes) };
+                buffers.push_back(r);
+                body += padded( pieces[k].bytes );
+            }
+            
+            FlatBuilder b;
+            const uint32_t nodes_ref = b.structs(nodes);
+            const uint32_t buffers_ref = b.structs(buffers);
+            b.start_table();
+            b.add<int64_t>(0, int64_t(n));
+            b.add_offset(1, nodes_ref);
+            b.add_offset(2, buffers_ref);
+            const uint32_t batch = b.end_table();
+            
+            Block blk = out.message( message( HEADER_RECORD_BATCH, batch, int64_t(body), b ) );
+            blk.body_length = int64_t(body);
+            blocks.push_back(blk);
+            
+            for( size_t k = 0; k < pieces.size(); ++k ){
+                if( pieces[k].bytes )
+                    out.write( pieces[k].data, pieces[k].bytes );
+                out.zeros( padded( pieces[k].bytes ) - pieces[k].bytes );
+            }
+            
+            if( rows == 0 )
+                break;
+        }
+        
+        const uint32_t eos[2] = { CONTINUATION, 0 };
+        out.write( eos, sizeof(eos) );
+        
+        if( format == FILE ){
+            FlatBuilder b;
+            const uint32_t schema = schema_table( b, frame );
+            const uint32_t dictionaries = b.structs( std::vector<Block>() );
+            const uint32_t batches = b.structs(blocks);
+            b.start_table();
+            b.add<int16_t>(0, METADATA_V5);
+            b.add_offset(1, schema);
+            b.add_offset(2, dictionaries);
+            b.add_offset(3, batches);
+            const std::vector<char>& footer = b.finish( b.end_table() );
+            const int32_t length = static_cast<int32_t>( footer.size() );
+            out.write( &footer[0], footer.size() );
+            out.write( &length, 4 );
+            out.write( MAGIC, sizeof(MAGIC) );
+        }
+    }
+    catch( ... ){
+        ::close(fd);
+        ::unlink( tmp.c_str() );
+        throw;
+    }
+    
+    if( ::close(fd) != 0 || ::rename( tmp.c_str(), path.c_str() ) != 0 ){
+        ::unlink( tmp.c_str() );
+        throw IpcException("Could not write "+path+".");
+    }
+}
+
+
+// -----------------------------------------------------------------
+// READING
+// -----------------------------------------------------------------
+
+df::DynFrame ipc::read( const std::string& path )
+{
+    std::shared_ptr<Holder> holder( new Holder() );
+    holder->map = map_file(path);
+    const MappedFile& m = *holder->map;
+    
+    std::vector<FieldInfo> fields;
+    std::vector<Batch> batches;
+    std::string meta;
+    bool have_schema = false;
+    
+    FlatTable header;
+    uint8_t type;
+    const uint8_t* body;
+    size_t body_size;
+    
+    const bool is_file = m.bytes >= 8 && std::memcmp( m.data, MAGIC, sizeof(MAGIC) ) == 0;
+    
+    if( is_file ){
+        
+        // footer: flatbuffer, its int32 length, magic
+        if( m.bytes < 8 + 10 || std::memcmp( m.data + m.bytes - 6, MAGIC, sizeof(MAGIC) ) != 0 )
+            throw IpcException(path+" is truncated.");
+        int32_t length;
+        std::memcpy( &length, m.data + m.bytes - 10, 4 );
+        if( length <= 0 || size_t(length) > m.bytes - 18 )
+            throw IpcException(path+" has an invalid footer.");
+        
+        FlatTable footer = FlatTable::root( m.data + m.bytes - 10 - length, size_t(length) );
+        if( footer.length(2) )
+            throw IpcException("Dictionary batches are not supported.");
+        fields = parse_schema( footer.table(1), meta );
+        have_schema = true;
+        
+        for( size_t i = 0; i < footer.length(3); ++i ){
+            const Block blk = footer.element<Block>(3, i);
+            if( blk.offset < 0 || size_t(blk.offset) >= m.bytes )
+                throw IpcException(path+" has an invalid record batch block.");
+            size_t pos = size_t(blk.offset);
+            if( !parse_message( m, pos, header, type, body, body_size ) || type != HEADER_RECORD_BATCH )
+                throw IpcException(path+" has an invalid record batch block.");
+            batches.push_back( parse_batch( header, body, body_size, holder->owned ) );
+        }
+    }
+    else {
+        size_t pos = 0;
+        while( parse_message( m, pos, header, type, body, body_size ) ){
+            if( type == HEADER_SCHEMA && !have_schema ){
+                fields = parse_schema( header, meta );
+                have_schema = true;
+            }
+            else if( type == HEADER_RECORD_BATCH && have_schema )
+                batches.push_back( parse_batch( header, body, body_size, holder->owned ) );
+            else if( type == HEADER_DICTIONARY )
+                throw IpcException("Dictionary batches are not supported.");
+            else
+                throw IpcException(path+" is not an Arrow IPC stream.");
+        }
+    }
+    
+    if( !have_schema )
+        throw IpcException(path+" is not an Arrow IPC file or stream.");
+    
+    // the index: date_time, else the first timestamp column
+    size_t index = fields.size();
+    for( size_t j = 0; j < fields.size() && index == fields.size(); ++j )
+        if( fields[j].name == INDEX_NAME )
+            index = j;
+    for( size_t j = 0; j < fields.size() && index == fields.size(); ++j )
+        if( fields[j].type == TYPE_TIMESTAMP )
+            index = j;
+    if( index == fields.size() )
+        throw IpcException(path+" has no "+INDEX_NAME+" or timestamp column.");
+    
+    const FieldInfo& fi = fields[index];
+    if( fi.type != TYPE_TIMESTAMP && fi.type != TYPE_DATE && !( fi.type == TYPE_INT && fi.bits == 64 ) )
+        throw IpcException("Index column "+fi.name+" is not a timestamp.");
+    
+    size_t rows = 0;
+    std::vector< std::vector<Slice> > parts;
+    for( size_t k = 0; k < batches.size(); ++k ){
+        parts.push_back( slices( batches[k], fields ) );
+        rows += size_t( batches[k].length );
+    }
+    
+    holder->owned.reserve( 2 * fields.size() + 1 );
+    
+    const time_t* idx = NULL;
+    std::vector<df::Column> columns;
+    
+    for( size_t j = 0; j < fields.size(); ++j ){
+        
+        const FieldInfo& f = fields[j];
+        std::vector<const Slice*> p;
+        size_t nulls = 0;
+        for( size_t k = 0; k < parts.size(); ++k ){
+            p.push_back( &parts[k][j] );
+            nulls += parts[k][j].null_count;
+        }
+        
+        if( j == index && nulls )
+            throw IpcException("Index column "+f.name+" contains nulls.");
+        
+        const df::ColumnType ct = j == index ? df::INT64 : column_type( f, nulls != 0 );
+        df::Column c = { f.name, ct, NULL, NULL };
+        
+        if( p.size() == 1 && native_layout( f, ct, *p[0] ) ){
+            c.data = p[0]->values;
+            c.offsets = p[0]->offsets;
+        }
+        else if( !p.empty() ){
+            FieldInfo g = f;
+            if( j == index && f.type == TYPE_INT )
+                g.type = TYPE_TIMESTAMP;            // plain int64 index: already seconds
+            c.data = convert( g, ct, p, rows, holder->owned, c.offsets );
+        }
+        
+        if( j == index )
+            idx = static_cast<const time_t*>( c.data );
+        else
+            columns.push_back(c);
+    }
+    
+    return df::DynFrame::adopt( rows, holder, idx, columns, meta );
+}
@@ -0,0 +1,134 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * ipc.hpp
+ *
+ * Design Overview:
+ *
+ * Apache Arrow IPC import and export, in both the stream format (.arrows)
+ * and the random-access file format (.arrow, a.k.a. Feather v2), for
+ * exchanging frames with pyarrow/pandas/polars without a serialization
+ * step. The Arrow library is not used: the few flatbuffer tables the
+ * format needs (Message, Schema, Field, RecordBatch, Footer) are built
+ * and parsed by hand in ipc.cpp.
+ *
+ * Writing emits one schema message and one record batch per batch_rows
+ * rows (all rows by default). The index becomes a non-null column
+ * "date_time" of type timestamp[s]; columns map to float64, int32, int64
+ * and utf8. Buffers are written straight from the column pointers and
+ * padded to 64 bytes. The frame's meta string is kept in the schema's
+ * custom metadata under "meta".
+ *
+ * Reading maps the file. A column whose buffers can be used as they are
+ * (a single record batch, a type the frame stores natively, no nulls) is
+ * a zero-copy view on the mapping; anything else is converted into a
+ * buffer owned by the frame: narrow integers widen to int32/int64,
+ * float32 to float64, timestamps and dates to unix seconds, bools to
+ * int32 0/1, and integer and bool columns with nulls become float64 with
+ * NaN, as in pandas. The index is the "date_time" column, or else the
+ * first timestamp column. LZ4_FRAME compressed batches (pyarrow's default
+ * for feather.write_feather) are decompressed into buffers owned by the
+ * frame; ZSTD is rejected, so write those with compression='lz4' or
+ * compression='uncompressed'. Dictionary encoding and nested types are
+ * rejected.
+ *
+ * Everything is little endian, like the hosts we run on.
+ *
+ */
+
+
+#ifndef backtester_ipc_hpp
+#define backtester_ipc_hpp
+
+//STL
+#include <string>
+#include <stdint.h>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "dynframe.hpp"
+
+namespace dp = datapoint;
+namespace ts = timeseries;
+namespace df = dataframe;
+
+namespace ipc {
+    
+    // EXCEPTIONS
+    
+    class IpcException: public std::exception {
+        
+    public:
+        IpcException(const std::string& message);
+        ~IpcException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    enum Format { FILE, STREAM };
+    
+    const char* const INDEX_NAME = "date_time";
+    
+    // writes frame to path; batch_rows = 0 writes a single record batch
+    void write( const std::string& path, const df::DynFrame& frame,
+                Format format = FILE, size_t batch_rows = 0 );
+    
+    // reads an Arrow IPC file or stream, detected from the contents; throws IpcException
+    df::DynFrame read( const std::string& path );
+    
+    
+    // -----------------------------------------------------------------
+    // TYPED INTERFACE
+    // -----------------------------------------------------------------
+    
+    template<typename T> void write( const std::string& path, const df::DataFrame<T>& frame,
+                                     Format format = FILE, size_t batch_rows = 0 ){
+        write( path, df::DynFrame::from(frame), format, batch_rows );
+    }
+    
+    template<typename T> void write( const std::string& path, const ts::TimeSeries<T>& series,
+                                     Format format = FILE, size_t batch_rows = 0 ){
+        write( path, df::DataFrame<T>(series), format, batch_rows );
+    }
+    
+    // typed view; zero-copy when the fields of T are single-batch float64 columns
+    template<typename T> df::DataFrame<T> read( const std::string& path ){
+        return read(path).as<T>();
+    }
+    
+    template<typename T> void read( ts::TimeSeries<T>& series, const std::string& path ){
+        series = read<T>(path).to_series();
+    }
+}
+
+#endif
@@ -0,0 +1,373 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * journal.cpp
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#include "journal.hpp"
+
+using namespace journal;
+
+// EXCEPTIONS
+
+JournalException::JournalException(const std::string& message):_msg(_spec + message){};
+JournalException::~JournalException() throw(){};
+
+const char* JournalException::what() const throw() {return _msg.c_str(); }
+const std::string JournalException::_spec = "Journal Exception: ";
+
+
+namespace {
+    
+    const size_t PAGE = static_cast<size_t>( sysconf(_SC_PAGESIZE) );
+    
+    size_t page_floor( size_t n ){
+        return n / PAGE * PAGE;
+    }
+    
+    size_t page_align( size_t n ){
+        return (n + PAGE - 1) / PAGE * PAGE;
+    }
+    
+    size_t record_size( size_t ncols ){
+        return 16 + ncols * sizeof(double) + 8;
+    }
+    
+    // mark, position and checksum of record i are intact
+    bool valid( const char* rec, size_t i, size_t size ){
+        uint32_t mark, crc;
+        int64_t seq;
+        std::memcpy( &seq, rec, 8 );
+        std::memcpy( &mark, rec + size - 8, 4 );
+        std::memcpy( &crc, rec + size - 4, 4 );
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return mark == RECORD_MARK && seq == int64_t(i) && crc == crc32c( rec, size - 4 );
+    }
+    
+    // slicing-by-8 tables: t[k][b] is the CRC of byte b followed by k zero bytes
+    struct CrcTable {
+        uint32_t t[8][256];
+        CrcTable(){
+            for( uint32_t i = 0; i < 256; ++i ){
+                uint32_t c = i;
+                for( int k = 0; k < 8; ++k )
+                    c = ( c & 1 ) ? ( c >> 1 ) ^ 0x82f63b78u : c >> 1;
+                t[0][i] = c;
+            }
+            for( uint32_t i = 0; i < 256; ++i )
+                for( int k = 1; k < 8; ++k )
+                    t[k][i] = ( t[k-1][i] >> 8 ) ^ t[0][ t[k-1][i] & 0xff ];
+        }
+    };
+    
+    std::vector<std::string> read_names( const FileHeader* h, const std::string& path, size_t bytes ){
+        if( bytes < sizeof(FileHeader) || h->magic != MAGIC || h->version != VERSION
+            || sizeof(FileHeader) + h->ncols * NAME_SIZE > h->data_offset || h->data_offset > bytes
+            || h->record_size != record_size(h->ncols) )
+            throw JournalException(path+" is not a journal.");
+        
+        std::vector<std::string> names;
+        const char* base = reinterpret_cast<const char*>(h);
+        for( size_t j = 0; j < h->ncols; ++j ){
+            const char* name = base + sizeof(FileHeader) + j*NAME_SIZE;
+            names.push_back( std::string( name, strnlen(name, NAME_SIZE) ) );
+        }
+        return names;
+    }
+}
+
+
+uint32_t journal::crc32c( const void* data, size_t n, uint32_t crc )
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint32_t c = ~crc;
+    
+#ifdef __SSE4_2__
+    uint64_t c64 = c;
+    for( ; n >= 8; n -= 8, p += 8 ){
+        uint64_t w;
+        std::memcpy( &w, p, 8 );
+        c64 = _mm_crc32_u64( c64, w );
+    }
+    c = static_cast<uint32_t>(c64);
+    for( ; n; --n, ++p )
+        c = _mm_crc32_u8( c, *p );
+#else
+    static const CrcTable table;
+    const uint32_t (*t)[256] = table.t;
+    for( ; n >= 8; n -= 8, p += 8 ){
+        uint32_t lo, hi;
+        std::memcpy( &lo, p, 4 );
+        std::memcpy( &hi, p + 4, 4 );
+        lo ^= c;
+        c = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+          ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    for( ; n; --n, ++p )
+        c = t[0][ (c ^ *p) & 0xff ] ^ ( c >> 8 );
+#endif
+    
+    return ~c;
+}
+
+
+// WRITER
+
+Writer::Writer( const std::string& path, const std::vector<std::string>& names,
+                const std::string& meta, const Options& opts )
+:   _path(path),
+    _opts(opts),
+    _fd(-1),
+    _base(NULL),
+    _ncols(names.size()),
+    _record( record_size(names.size()) ),
+    _offset( page_align( sizeof(FileHeader) + names.size() * NAME_SIZE ) ),
+    _file(0),
+    _count(0),
+    _synced(0),
+    _durable(0),
+    _recovered(0),
+    _dropped(0)
+{
+    for( size_t j = 0; j < names.size(); ++j )
+        if( names[j].size() >= NAME_SIZE )
+            throw JournalException("Column name "+names[j]+" too long.");
+    
+    _fd = ::open( path.c_str(), O_RDWR | O_CREAT, 0644 );
+    if( _fd < 0 )
+        throw JournalException("Could not open "+path+".");
+    
+    // one writer per journal: recovery truncates the file, which would fault a second writer's mapping
+    if( flock(_fd, LOCK_EX | LOCK_NB) != 0 ){
+        const int err = errno;
+        ::close(_fd);
+        throw JournalException( err == EWOULDBLOCK ? path+" is already being written."
+                                                   : "Could not lock "+path+"." );
+    }
+    
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if( fstat(_fd, &st) == 0 )
+        addr = mmap( NULL, _opts.reserve_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0 );
+    if( addr == MAP_FAILED ){
+        ::close(_fd);
+        throw JournalException("Could not map "+path+".");
+    }
+    _base = static_cast<char*>(addr);
+    _file = static_cast<size_t>( st.st_size );
+    
+    try {
+        
+        if( _file == 0 ){
+            grow( _offset );
+            FileHeader* h = reinterpret_cast<FileHeader*>(_base);
+            h->magic = MAGIC;
+            h->version = VERSION;
+            h->ncols = static_cast<uint32_t>( _ncols );
+            h->record_size = _record;
+            h->data_offset = _offset;
+            std::strncpy( h->meta, meta.c_str(), sizeof(h->meta) - 1 );
+            for( size_t j = 0; j < names.size(); ++j )
+                std::memcpy( _base + sizeof(FileHeader) + j*NAME_SIZE, names[j].data(), names[j].size() );
+            _durable = size_t(-1);
+            sync();
+            return;
+        }
+        
+        const FileHeader* h = reinterpret_cast<const FileHeader*>(_base);
+        if( read_names(h, path, _file) != names )
+            throw JournalException("Columns of "+path+" do not match.");
+        _offset = h->data_offset;
+        
+        // recovery: keep the intact prefix, drop everything after it
+        const size_t slots = ( _file - _offset ) / _record;
+        while( _count < slots && valid( _base + _offset + _count * _record, _count, _record ) )
+            ++_count;
+        
+        const size_t end = _offset + _count * _record;
+        for( size_t i = _file; i > end; --i )
+            if( _base[i-1] ){
+                _dropped = i - end;
+                break;
+            }
+        
+        if( ftruncate(_fd, end) != 0 )
+            throw JournalException("Could not truncate "+path+".");
+        _file = end;
+        _recovered = _synced = _durable = _count;
+    }
+    catch( ... ){
+        munmap( _base, _opts.reserve_bytes );
+        ::close(_fd);
+        throw;
+    }
+}
+
+Writer::~Writer()
+{
+    try {
+        sync();
+    }
+    catch( ... ){
+    }
+    if( ftruncate(_fd, _offset + _count * _record) == 0 )
+        fdatasync(_fd);
+    munmap( _base, _opts.reserve_bytes );
+    ::close(_fd);
+}
+
+void Writer::grow( size_t bytes )
+{
+    const size_t size = page_align( std::max( bytes, _file + _opts.grow_bytes ) );
+    if( size > _opts.reserve_bytes )
+        throw JournalException(_path+" is full.");
+    
+    // allocate the blocks now: a store to an unbacked page would raise SIGBUS on a full disk
+    int err = posix_fallocate( _fd, _file, size - _file );
+    if( err == EINVAL || err == EOPNOTSUPP )
+        err = ftruncate( _fd, size ) == 0 ? 0 : errno;
+    if( err != 0 )
+        throw JournalException("Could not grow "+_path+".");
+    _file = size;
+}
+
+void Writer::append( time_t t, const double* values )
+{
+    const size_t pos = _offset + _count * _record;
+    if( pos + _record > _file )
+        grow( pos + _record );
+    
+    char* rec = _base + pos;
+    const int64_t seq = static_cast<int64_t>(_count);
+    const int64_t time = static_cast<int64_t>(t);
+    std::memcpy( rec, &seq, 8 );
+    std::memcpy( rec + 8, &time, 8 );
+    std::memcpy( rec + 16, values, _ncols * sizeof(double) );
+    std::memcpy( rec + _record - 8, &RECORD_MARK, 4 );
+    
+    // the checksum goes last, so readers never accept a partly written record
+    const uint32_t crc = crc32c( rec, _record - 4 );
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy( rec + _record - 4, &crc, 4 );
+    
+    ++_count;
+    
+    if( _opts.sync_every && _count - _synced >= _opts.sync_every ){
+        const size_t from = page_floor( _offset + _synced * _record );
+        msync( _base + from, pos + _record - from, MS_ASYNC );
+        _synced = _count;
+    }
+}
+
+void Writer::sync()
+{
+    const size_t from = _durable == size_t(-1) ? 0 : page_floor( _offset + _durable * _record );
+    const size_t end = _offset + _count * _record;
+    if( end > from && msync( _base + from, end - from, MS_SYNC ) != 0 )
+        throw JournalException("Could not sync "+_path+".");
+    if( fdatasync(_fd) != 0 )
+        throw JournalException("Could not sync "+_path+".");
+    _durable = _synced = _count;
+}
+
+
+// READER
+
+Reader::Reader( const std::string& path, size_t reserve_bytes )
+:   _path(path),
+    _fd(-1),
+    _base(NULL),
+    _reserve(reserve_bytes),
+    _names(),
+    _meta(),
+    _record(0),
+    _offset(0),
+    _count(0)
+{
+    _fd = ::open( path.c_str(), O_RDONLY );
+    if( _fd < 0 )
+        throw JournalException("Could not open "+path+".");
+    
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if( fstat(_fd, &st) == 0 )
+        addr = mmap( NULL, _reserve, PROT_READ, MAP_SHARED, _fd, 0 );
+    if( addr == MAP_FAILED ){
+        ::close(_fd);
+        throw JournalException("Could not map "+path+".");
+    }
+    _base = static_cast<const char*>(addr);
+    
+    try {
+        const FileHeader* h = reinterpret_cast<const FileHeader*>(_base);
+        _names = read_names( h, path, static_cast<size_t>(st.st_size) );
+        _meta = std::string( h->meta, strnlen(h->meta, sizeof(h->meta)) );
+        _record = h->record_size;
+        _offset = h->data_offset;
+    }
+    catch( ... ){
+        munmap( const_cast<char*>(_base), _reserve );
+        ::close(_fd);
+        throw;
+    }
+    
+    refresh();
+}
+
+Reader::~Reader()
+{
+    munmap( const_cast<char*>(_base), _reserve );
+    ::close(_fd);
+}
+
+size_t Reader::refresh()
+{
+    struct stat st;
+    if( fstat(_fd, &st) != 0 )
+        throw JournalException("Could not stat "+_path+".");
+    
+    const size_t bytes = std::min( static_cast<size_t>(st.st_size), _reserve );
+    const size_t slots = bytes > _offset ? ( bytes - _offset ) / _record : 0;
+    while( _count < slots && valid( record(_count), _count, _record ) )
+        ++_count;
+    return _count;
+}
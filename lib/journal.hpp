@@ -0,0 +1,272 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * journal.hpp
+ *
+ * Design Overview:
+ *
+ * Crash-safe append-only journal for live capture of bars, replayable
+ * without the TSDB. Appends are plain stores into a shared file mapping,
+ * so capture runs at memory speed; the kernel writes the pages back, and
+ * the writer msyncs every Options::sync_every records (and on sync() and
+ * close) to bound what an OS crash can lose.
+ *
+ * The file is a page-sized header (column names, meta) followed by fixed
+ * size records:
+ *
+ *   int64 seq | int64 time | double value[ncols] | uint32 mark | uint32 crc
+ *
+ * seq is the record's position and crc a CRC-32C of everything before it,
+ * written last. On open the writer scans the records and truncates the
+ * file after the last one whose mark, seq and checksum are intact, so a
+ * torn or partial append from a crash is dropped and appending resumes.
+ *
+ * A journal has a single Writer at a time. The writer holds an exclusive
+ * flock on the file for its lifetime, and opening a second one, in this
+ * or another process, throws. Any number of Readers may tail it.
+ *
+ * The file grows in Options::grow_bytes steps inside one large reserved
+ * mapping, so record addresses never change. Reader maps the file the
+ * same way, read-only, and validates records as it goes; refresh() picks
+ * up records appended since, from this or another process, so a reader
+ * can tail a live journal. Records are read in place: Source<T> runs the
+ * engine directly over a reader and replay() fills a TimeSeries.
+ *
+ */
+
+
+#ifndef backtester_journal_hpp
+#define backtester_journal_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <ctime>
+#include <stdint.h>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "utilities.hpp"
+
+namespace dp = datapoint;
+namespace ts = timeseries;
+
+namespace journal {
+    
+    // EXCEPTIONS
+    
+    class JournalException: public std::exception {
+        
+    public:
+        JournalException(const std::string& message);
+        ~JournalException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    const uint64_t MAGIC = 0x314e524a42445354ull;     // "TSDBJRN1"
+    const uint32_t VERSION = 1;
+    const size_t NAME_SIZE = 32;                        // per column name, zero padded
+    const uint32_t RECORD_MARK = 0x7e57a11du;
+    
+    struct FileHeader {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t ncols;
+        uint64_t record_size;
+        uint64_t data_offset;       // bytes from start of file to the first record
+        char meta[128];
+    };
+    
+    struct Options {
+        
+        Options()
+        :   sync_every(4096),
+            grow_bytes(64 << 20),
+            reserve_bytes(size_t(1) << 36)
+        {};
+        
+        size_t sync_every;          // records between asynchronous msyncs; 0 = only on sync()
+        size_t grow_bytes;          // file growth step
+        size_t reserve_bytes;       // address space reserved for the mapping; the size limit
+    };
+    
+    // CRC-32C (Castagnoli), hardware accelerated with SSE4.2
+    uint32_t crc32c( const void* data, size_t n, uint32_t crc = 0 );
+    
+    
+    // -----------------------------------------------------------------
+    // WRITER
+    // -----------------------------------------------------------------
+    
+    class Writer: private utilities::Uncopyable {
+        
+    public:
+        
+        // creates path, or opens it and recovers; throws if the columns differ
+        // or another Writer has the journal open
+        Writer( const std::string& path, const std::vector<std::string>& names,
+                const std::string& meta = "", const Options& opts = Options() );
+        ~Writer();      // syncs and trims the file to its records
+        
+        // values holds one value per column
+        void append( time_t t, const double* values );
+        
+        void sync();    // blocks until every record is on disk
+        
+        size_t size() const { return _count; }
+        size_t recovered() const { return _recovered; }    // valid records found on open
+        size_t dropped() const { return _dropped; }        // bytes discarded on open
+        size_t ncols() const { return _ncols; }
+        
+    private:
+        void grow( size_t bytes );
+        
+        std::string _path;
+        Options _opts;
+        int _fd;
+        char* _base;                // reserved mapping
+        size_t _ncols;
+        size_t _record;             // record size
+        size_t _offset;             // data offset
+        size_t _file;               // current file size
+        size_t _count;
+        size_t _synced;             // records covered by the last msync
+        size_t _durable;            // records covered by the last synchronous msync
+        size_t _recovered;
+        size_t _dropped;
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // READER
+    // -----------------------------------------------------------------
+    
+    class Reader: private utilities::Uncopyable {
+        
+    public:
+        
+        explicit Reader( const std::string& path, size_t reserve_bytes = Options().reserve_bytes );
+        ~Reader();
+        
+        // validates records appended since the last call; returns the new size
+        size_t refresh();
+        
+        size_t size() const { return _count; }
+        size_t ncols() const { return _names.size(); }
+        const std::vector<std::string>& column_names() const { return _names; }
+        const std::string& meta() const { return _meta; }
+        
+        time_t time( size_t i ) const {
+            return static_cast<time_t>( *reinterpret_cast<const int64_t*>( record(i) + 8 ) );
+        }
+        
+        const double* values( size_t i ) const {
+            return reinterpret_cast<const double*>( record(i) + 16 );
+        }
+        
+    private:
+        const char* record( size_t i ) const {
+            return _base + _offset + i * _record;
+        }
+        
+        std::string _path;
+        int _fd;
+        const char* _base;
+        size_t _reserve;
+        std::vector<std::string> _names;
+        std::string _meta;
+        size_t _record;
+        size_t _offset;
+        size_t _count;
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // TYPED INTERFACE
+    // -----------------------------------------------------------------
+    
+    // the writer for T is Writer( path, dp::dp_names<T>(), ... )
+    template<typename T> void append( Writer& w, time_t t, const T& bar ){
+        double values[dp::field_count<T>::value];
+        dp::dp_values<T>(bar, values);
+        w.append(t, values);
+    }
+    
+    // engine source over the records of a reader, in file order
+    template<typename T> class Source {
+        
+    public:
+        
+        explicit Source( const Reader& reader, size_t begin = 0 )
+        :   _reader(reader),
+            _pos(begin),
+            _bar( dp::dp_make<T>(_zeros()) )
+        {
+            if( reader.column_names() != dp::dp_names<T>() )
+                throw JournalException("Columns of the journal do not match datapoint type.");
+        };
+        
+        bool next( time_t& t, const T*& bar ){
+            if( _pos >= _reader.size() )
+                return false;
+            t = _reader.time(_pos);
+            _bar = dp::dp_make<T>( _reader.values(_pos++) );
+            bar = &_bar;
+            return true;
+        }
+        
+    private:
+        static const double* _zeros(){
+            static const double z[dp::field_count<T>::value] = {};
+            return z;
+        }
+        
+        const Reader& _reader;
+        size_t _pos;
+        T _bar;
+    };
+    
+    // inserts every record of the journal at path; records with existing timestamps are skipped
+    template<typename T> void replay( const std::string& path, ts::TimeSeries<T>& series ){
+        Reader reader(path);
+        Source<T> src(reader);
+        time_t t;
+        const T* bar;
+        while( src.next(t, bar) )
+            series.insert( std::make_pair(t, *bar) );
+    }
+    
+} // namespace journal
+
+
+#endif
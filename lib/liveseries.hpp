@@ -0,0 +1,291 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * liveseries.hpp
+ *
+ * Design Overview:
+ *
+ * Append-only series for live data: one writer thread appends bars while
+ * any number of reader threads (signals, monitoring) iterate and query it
+ * concurrently, without locks and without copying.
+ *
+ * Rows live in fixed-size chunks that never move once allocated, found
+ * through a directory of chunk pointers. The writer fills a row, then
+ * publishes it by storing the new committed length with release
+ * semantics. A reader loads the length with acquire semantics and gets a
+ * View of that prefix: every row below it is complete and immutable, so
+ * the view can be read freely while the writer keeps appending.
+ *
+ * When the directory fills up the writer publishes a larger copy. The old
+ * directory is retired but not freed, since a reader may still hold it;
+ * directories double in size, so the retired ones together are smaller
+ * than the current one. Chunks and directories are freed with the series,
+ * which must therefore outlive its views.
+ *
+ * Timestamps must be strictly increasing, which keeps lookups in a view a
+ * binary search. Use ViewSource to run the engine over a view.
+ *
+ */
+
+
+#ifndef backtester_liveseries_hpp
+#define backtester_liveseries_hpp
+
+//STL
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <algorithm>
+
+#include "datapoint.hpp"
+#include "footprint.hpp"
+#include "utilities.hpp"
+
+namespace dp = datapoint;
+
+namespace timeseries {
+    
+    template<typename T> class LiveSeries: public footprint::Tracked, private utilities::Uncopyable {
+        
+        BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
+        
+        struct Chunk {
+            std::vector<time_t> times;
+            std::vector<T> bars;
+        };
+        
+        struct Directory {
+            std::vector<const Chunk*> chunks;   // sized once, slots filled by the writer
+        };
+        
+    public:
+        
+        // a stable prefix of the series; valid while the series lives
+        class View {
+            
+        public:
+            
+            View(): _dir(NULL), _size(0), _shift(0), _mask(0) {};
+            
+            size_t size() const { return _size; }
+            bool isEmpty() const { return _size == 0; }
+            
+            time_t time( size_t i ) const {
+                return _dir->chunks[i >> _shift]->times[i & _mask];
+            }
+            
+            const T& operator[]( size_t i ) const {
+                return _dir->chunks[i >> _shift]->bars[i & _mask];
+            }
+            
+            time_t front_time() const { return time(0); }
+            time_t back_time() const { return time(_size - 1); }
+            
+            // first row at or after t; size() if none
+            size_t lower_bound( time_t t ) const {
+                size_t lo = 0, hi = _size;
+                while( lo < hi ){
+                    const size_t mid = lo + (hi - lo) / 2;
+                    if( time(mid) < t )
+                        lo = mid + 1;
+                    else
+                        hi = mid;
+                }
+                return lo;
+            }
+            
+            // bar at exactly t, or NULL
+            const T* find( time_t t ) const {
+                const size_t i = lower_bound(t);
+                return ( i < _size && time(i) == t ) ? &(*this)[i] : NULL;
+            }
+            
+            // last bar at or before t, or NULL
+            const T* as_of( time_t t ) const {
+                const size_t i = lower_bound(t);
+                if( i < _size && time(i) == t )
+                    return &(*this)[i];
+                return i ? &(*this)[i-1] : NULL;
+            }
+            
+        private:
+            friend class LiveSeries;
+            
+            View( const Directory* dir, size_t size, unsigned shift )
+            :   _dir(dir), _size(size), _shift(shift), _mask( (size_t(1) << shift) - 1 )
+            {};
+            
+            const Directory* _dir;
+            size_t _size;
+            unsigned _shift;
+            size_t _mask;
+        };
+        
+        
+        // chunk_rows is rounded up to a power of two
+        explicit LiveSeries( const std::string& meta = "", size_t chunk_rows = 4096 )
+        :   _meta(meta),
+            _shift(0),
+            _size(0),
+            _dir(NULL),
+            _chunks(),
+            _retired(),
+            _last(0)
+        {
+            while( (size_t(1) << _shift) < chunk_rows )
+                ++_shift;
+            std::unique_ptr<Directory> d( new Directory() );
+            d->chunks.assign( 16, NULL );
+            _dir.store( d.get(), std::memory_order_release );
+            _retired.push_back( std::move(d) );
+            track();
+        }
+        
+        ~LiveSeries(){
+            untrack();
+        }
+        
+        
+        // WRITER (one thread at a time)
+        
+        // false if t is not after the last timestamp
+        bool append( time_t t, const T& bar ){
+            
+            const size_t n = _size.load(std::memory_order_relaxed);
+            if( n && t <= _last )
+                return false;
+            
+            const size_t k = n >> _shift;
+            const size_t i = n & ( (size_t(1) << _shift) - 1 );
+            
+            if( i == 0 )
+                add_chunk(k, bar);
+            
+            Chunk& c = *_chunks[k];
+            c.times[i] = t;
+            c.bars[i] = bar;
+            _last = t;
+            
+            _size.store(n + 1, std::memory_order_release);    // publish the row
+            return true;
+        }
+        
+        
+        // READERS (any thread)
+        
+        size_t size() const {
+            return _size.load(std::memory_order_acquire);
+        }
+        
+        View view() const {
+            const size_t n = _size.load(std::memory_order_acquire);
+            return View( _dir.load(std::memory_order_acquire), n, _shift );
+        }
+        
+        const std::string& meta() const { return _meta; }
+        
+        footprint::Usage memory() const {
+            const size_t chunks = ( size() + (size_t(1) << _shift) - 1 ) >> _shift;
+            const size_t rows = chunks << _shift;
+            footprint::Usage u;
+            u.payload = rows * dp::field_count<T>::value * sizeof(double);
+            u.index = rows * sizeof(time_t);
+            u.overhead = rows * ( sizeof(T) - dp::field_count<T>::value * sizeof(double) )
+                       + _dir.load(std::memory_order_acquire)->chunks.capacity() * 2 * sizeof(void*)
+                       + sizeof(*this) + _meta.capacity();
+            return u;
+        }
+        
+        std::string memory_label() const {
+            return "LiveSeries " + _meta;
+        }
+        
+    private:
+        
+        void add_chunk( size_t k, const T& bar ){
+            
+            std::unique_ptr<Chunk> c( new Chunk() );
+            c->times.assign( size_t(1) << _shift, 0 );
+            c->bars.assign( size_t(1) << _shift, bar );
+            
+            const Directory* dir = _dir.load(std::memory_order_relaxed);
+            if( k == dir->chunks.size() ){
+                // publish a larger copy; readers may keep using the old one
+                std::unique_ptr<Directory> d( new Directory() );
+                d->chunks.assign( 2 * k, NULL );
+                std::copy( dir->chunks.begin(), dir->chunks.end(), d->chunks.begin() );
+                dir = d.get();
+                _retired.push_back( std::move(d) );
+            }
+            const_cast<Directory*>(dir)->chunks[k] = c.get();
+            _dir.store( dir, std::memory_order_release );
+            _chunks.push_back( std::move(c) );
+        }
+        
+        std::string _meta;
+        unsigned _shift;                                // log2 of rows per chunk
+        std::atomic<size_t> _size;                      // committed rows
+        std::atomic<const Directory*> _dir;             // current directory
+        std::vector< std::unique_ptr<Chunk> > _chunks;  // writer only
+        std::vector< std::unique_ptr<Directory> > _retired; // every directory, current included
+        time_t _last;                                   // writer only
+    };
+    
+    
+    // engine source over a view; bars are passed by reference into the series
+    template<typename T> class ViewSource {
+        
+    public:
+        
+        explicit ViewSource( const typename LiveSeries<T>::View& view, size_t begin = 0 )
+        :   _view(view), _pos(begin)
+        {};
+        
+        bool next( time_t& t, const T*& bar ){
+            if( _pos >= _view.size() )
+                return false;
+            t = _view.time(_pos);
+            bar = &_view[_pos++];
+            return true;
+        }
+        
+        // continue from where this source stopped on a newer view
+        void refresh( const typename LiveSeries<T>::View& view ){
+            _view = view;
+        }
+        
+    private:
+        typename LiveSeries<T>::View _view;
+        size_t _pos;
+    };
+    
+} // namespace timeseries
+
+
+#endif
@@ -30,9 +30,43 @@
 
 // #define DEBUG        (enable/disable debugging)
 #ifdef DEBUG
+#include <cstdio>
+#include <cstdlib>
 #define ASSERT(c) do {                                                  \
 if (!(c)) { fprintf(stderr, "ASSERT failure at line %d\n", __LINE__); \
 exit(1); }} while(0)
 #else
 #define ASSERT(c)
 #endif
+
+// #define PROFILE      (enable/disable hot-path instrumentation, see profile.hpp)
+#ifdef PROFILE
+#include "profile.hpp"
+#define PROFILE_CAT_(a,b) a##b
+#define PROFILE_CAT(a,b) PROFILE_CAT_(a,b)
+#define PROFILE_SCOPE(name)                                                         \
+static const ::profile::Probe PROFILE_CAT(_probe_,__LINE__)(name, ::profile::TIMER); \
+const ::profile::ScopedTimer PROFILE_CAT(_timer_,__LINE__)(PROFILE_CAT(_probe_,__LINE__))
+#define PROFILE_COUNT(name, n) do {                                                 \
+static const ::profile::Probe _probe(name, ::profile::COUNTER);                     \
+::profile::add(_probe, (n)); } while(0)
+#define PROFILE_VALUE(name, v) do {                                                 \
+static const ::profile::Probe _probe(name, ::profile::VALUE);                       \
+::profile::record(_probe, (v)); } while(0)
+#define PROFILE_TICKS() ::profile::ticks()
+#define PROFILE_SPAN(name, start, track, arg) do {                                  \
+static const ::profile::Probe _probe(name, ::profile::TIMER);                       \
+const uint64_t _end = ::profile::ticks();                                           \
+::profile::record(_probe, _end - (start));                                          \
+if (::profile::tracing()) ::profile::trace(_probe, (start), _end, (track), (arg)); } while(0)
+#define PROFILE_REPORT() ::profile::report()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(name, n) do {} while(0)
+#define PROFILE_VALUE(name, v) do {} while(0)
+#define PROFILE_TICKS() 0ull
+#define PROFILE_SPAN(name, start, track, arg) do {} while(0)
+#define PROFILE_REPORT() do {} while(0)
+#endif
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include "native.hpp"
+
+using namespace native;
+
+// EXCEPTIONS
+
+NativeException::NativeException(const std::string& message):_msg(_spec + message){};
+NativeException::~NativeException() throw(){};
+
+const char* NativeException::what() const throw() {return _msg.c_str(); }
+const std::string NativeException::_spec = "Native Format Exception: ";
+
+
+namespace {
+    
+    size_t page_align( size_t n ){
+        const size_t page = static_cast<size_t>( sysconf(_SC_PAGESIZE) );
+        return (n + page - 1) / page * page;
+    }
+    
+    void write_all( int fd, const void* data, size_t n, const std::string& path ){
+        const char* p = static_cast<const char*>(data);
+        while( n ){
+            ssize_t w = ::write(fd, p, n);
+            if( w < 0 && errno == EINTR )
+                continue;
+            if( w <= 0 )
+                throw NativeException("Write to "+path+" failed.");
+            p += w; n -= static_cast<size_t>(w);
+        }
+    }
+    
+    void write_zeros( int fd, size_t n, const std::string& path ){
+        static const char zeros[4096] = {};
+        while( n ){
+            const size_t k = std::min(n, sizeof(zeros));
+            write_all(fd, zeros, k, path);
+            n -= k;
+        }
+    }
+}
+
+
+Mapping::~Mapping()
+{
+    munmap( const_cast<FileHeader*>(header), bytes );
+}
+
+
+void native::write_columns( const std::string& path, size_t rows, const time_t* index,
+                            const std::vector<const double*>& columns,
+                            const std::vector<std::string>& names, const std::string& meta )
+{
+    if( names.size() != columns.size() )
+        throw NativeException("Column names do not match columns.");
+    
+    const size_t stride = df::padded_stride(rows);
+    
+    std::vector<char> head( sizeof(FileHeader) + names.size() * NAME_SIZE, 0 );
+    FileHeader* h = reinterpret_cast<FileHeader*>( &head[0] );
+    h->magic = MAGIC;
+    h->version = VERSION;
+    h->ncols = static_cast<uint32_t>( columns.size() );
+    h->rows = rows;
+    h->stride = stride;
+    h->data_offset = page_align( head.size() );
+    std::strncpy( h->meta, meta.c_str(), sizeof(h->meta) - 1 );
+    
+    for( size_t j = 0; j < names.size(); ++j ){
+        if( names[j].size() >= NAME_SIZE )
+            throw NativeException("Column name "+names[j]+" too long.");
+        std::memcpy( &head[sizeof(FileHeader) + j*NAME_SIZE], names[j].data(), names[j].size() );
+    }
+    
+    // write to a temporary and rename, so readers never map a partial file
+    const std::string tmp = path + ".tmp";
+    int fd = ::open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( fd < 0 )
+        throw NativeException("Could not open "+tmp+".");
+    
+    try {
+        const size_t pad = (stride - rows) * sizeof(double);
+        
+        write_all( fd, &head[0], head.size(), path );
+        write_zeros( fd, h->data_offset - head.size(), path );
+        
+        write_all( fd, index, rows * sizeof(time_t), path );
+        write_zeros( fd, pad, path );
+        
+        for( size_t j = 0; j < columns.size(); ++j ){
+            write_all( fd, columns[j], rows * sizeof(double), path );
+            write_zeros( fd, pad, path );
+        }
+    }
+    catch( ... ){
+        ::close(fd);
+        ::unlink( tmp.c_str() );
+        throw;
+    }
+    
+    if( ::close(fd) != 0 || ::rename( tmp.c_str(), path.c_str() ) != 0 ){
+        ::unlink( tmp.c_str() );
+        throw NativeException("Could not write "+path+".");
+    }
+}
+
+
+std::shared_ptr<Mapping> native::map_file( const std::string& path )
+{
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+        throw NativeException("Could not open "+path+".");
+    
+    struct stat st;
+    if( fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader) ){
+        ::close(fd);
+        throw NativeException(path+" is not a native file.");
+    }
+    
+    const size_t bytes = static_cast<size_t>( st.st_size );
+    void* addr = mmap( NULL, bytes, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close(fd);
+    if( addr == MAP_FAILED )
+        throw NativeException("Could not map "+path+".");
+    
+    std::shared_ptr<Mapping> m( new Mapping() );
+    m->header = static_cast<const FileHeader*>(addr);
+    m->bytes = bytes;
+    
+    const FileHeader* h = m->header;
+    const size_t cols_end = sizeof(FileHeader) + size_t(h->ncols) * NAME_SIZE;
+    if( h->magic != MAGIC || h->version != VERSION || cols_end > bytes || h->data_offset < cols_end
+        || h->stride < h->rows || h->data_offset + (1 + h->ncols) * h->stride * sizeof(double) > bytes )
+        throw NativeException(path+" is not a native file or is truncated.");
+    
+    const char* base = static_cast<const char*>(addr);
+    for( size_t j = 0; j < h->ncols; ++j ){
+        const char* name = base + sizeof(FileHeader) + j*NAME_SIZE;
+        m->names.push_back( std::string( name, strnlen(name, NAME_SIZE) ) );
+    }
+    
+    m->index = reinterpret_cast<const time_t*>( base + h->data_offset );
+    const double* cols = reinterpret_cast<const double*>( m->index + h->stride );
+    for( size_t j = 0; j < h->ncols; ++j )
+        m->columns.push_back( cols + j*h->stride );
+    
+    madvise( addr, bytes, MADV_WILLNEED );
+    
+    return m;
+}
+
+
+df::DynFrame native::read( const std::string& path )
+{
+    std::shared_ptr<Mapping> m = map_file(path);
+    std::vector<df::Column> columns;
+    for( size_t j = 0; j < m->names.size(); ++j ){
+        df::Column c = { m->names[j], df::FLOAT64, m->columns[j], NULL };
+        columns.push_back(c);
+    }
+    return df::DynFrame::adopt( m->header->rows, m, m->index, columns, std::string(m->header->meta) );
+}
@@ -0,0 +1,152 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * native.hpp
+ *
+ * Design Overview:
+ *
+ * Native binary file format for DataFrames. The file is a page-sized
+ * header followed by the data laid out exactly like a DataFrame block:
+ * the index column, then one column per field, each padded to the same
+ * cache-line aligned stride. Writing is a few large write() calls straight
+ * from the column pointers; reading maps the file and returns a DataFrame
+ * view on the mapping, so nothing is parsed or copied.
+ *
+ * File layout (little endian, native doubles):
+ *
+ *   FileHeader                              at 0
+ *   ncols column names, NAME_SIZE bytes each
+ *   index    time_t[stride]                 at data_offset (page aligned)
+ *   column j double[stride]                 at data_offset + (1+j)*stride*8
+ *
+ */
+
+
+#ifndef backtester_native_hpp
+#define backtester_native_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "dynframe.hpp"
+
+namespace dp = datapoint;
+namespace ts = timeseries;
+namespace df = dataframe;
+
+namespace native {
+    
+    // EXCEPTIONS
+    
+    class NativeException: public std::exception {
+        
+    public:
+        NativeException(const std::string& message);
+        ~NativeException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    const uint64_t MAGIC = 0x3154414e42445354ull;     // "TSDBNAT1"
+    const uint32_t VERSION = 1;
+    const size_t NAME_SIZE = 32;                        // per column name, zero padded
+    
+    struct FileHeader {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t ncols;
+        uint64_t rows;
+        uint64_t stride;            // elements per column including padding
+        uint64_t data_offset;       // bytes from start of file to the index column
+        char meta[128];
+    };
+    
+    // a read-only mapping of a native file; unmapped when the last reference goes
+    struct Mapping {
+        const FileHeader* header;
+        std::vector<std::string> names;
+        const time_t* index;
+        std::vector<const double*> columns;
+        size_t bytes;
+        
+        ~Mapping();
+    };
+    
+    // writes rows of index and columns (each holding rows values) to path
+    void write_columns( const std::string& path, size_t rows, const time_t* index,
+                        const std::vector<const double*>& columns,
+                        const std::vector<std::string>& names, const std::string& meta );
+    
+    // maps path and checks the header; throws NativeException if it is not a native file
+    std::shared_ptr<Mapping> map_file( const std::string& path );
+    
+    // zero-copy untyped view on the file, whatever its columns
+    df::DynFrame read( const std::string& path );
+    
+    
+    // -----------------------------------------------------------------
+    // TYPED INTERFACE
+    // -----------------------------------------------------------------
+    
+    template<typename T> void write( const std::string& path, const df::DataFrame<T>& frame ){
+        std::vector<const double*> columns;
+        for( size_t j = 0; j < frame.ncols(); ++j )
+            columns.push_back( frame.column(j) );
+        write_columns( path, frame.size(), frame.index(), columns, frame.column_names(), frame.meta() );
+    }
+    
+    template<typename T> void write( const std::string& path, const ts::TimeSeries<T>& series ){
+        write( path, df::DataFrame<T>(series) );
+    }
+    
+    // zero-copy view on the file; the mapping lives as long as the frame or its copies
+    template<typename T> df::DataFrame<T> read( const std::string& path ){
+        std::shared_ptr<Mapping> m = map_file(path);
+        if( m->names != dp::dp_names<T>() )
+            throw NativeException("Columns of "+path+" do not match datapoint type.");
+        return df::DataFrame<T>::adopt( m->header->rows, m, m->index, m->columns, std::string(m->header->meta) );
+    }
+    
+    template<typename T> void read( ts::TimeSeries<T>& series, const std::string& path ){
+        series = read<T>(path).to_series();
+    }
+    
+} // namespace native
+
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "numa.hpp"
+
+namespace {
+    
+    // from linux/mempolicy.h
+    const int MPOL_BIND_ = 2;
+    const int MPOL_INTERLEAVE_ = 3;
+    
+    // parses sysfs list syntax, e.g. "0-3,8-11"
+    std::vector<int> parse_list( const std::string& path ){
+        
+        std::vector<int> ids;
+        std::ifstream in( path.c_str() );
+        std::string line, item;
+        
+        if( !std::getline(in, line) )
+            return ids;
+        
+        std::stringstream ss(line);
+        while( std::getline(ss, item, ',') ){
+            int lo = 0, hi = 0;
+            const int n = sscanf(item.c_str(), "%d-%d", &lo, &hi);
+            if( n < 1 )
+                continue;
+            if( n == 1 )
+                hi = lo;
+            for( int i = lo; i <= hi; ++i )
+                ids.push_back(i);
+        }
+        return ids;
+    }
+    
+    long mbind_( void* addr, size_t len, int mode, const unsigned long* mask, unsigned long maxnode ){
+        return syscall(SYS_mbind, addr, len, mode, mask, maxnode, 0);
+    }
+    
+    // anonymous mapping with a memory policy applied before first touch
+    std::shared_ptr<void> map_with_policy( size_t bytes, int mode, const std::vector<unsigned long>& mask ){
+        
+        if( !bytes )
+            bytes = 1;
+        
+        void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if( p == MAP_FAILED )
+            throw std::bad_alloc();
+        
+        if( !mask.empty() )
+            mbind_(p, bytes, mode, &mask[0], mask.size() * sizeof(unsigned long) * 8 + 1); // best effort
+        
+        df::advise_hugepages(p, bytes);
+        std::memset(p, 0, bytes);   // fault pages in under the policy
+        return std::shared_ptr<void>( p, [bytes]( void* q ){ munmap(q, bytes); } );
+    }
+    
+    std::vector<unsigned long> node_mask( const std::vector<int>& nodes ){
+        const size_t bits = sizeof(unsigned long) * 8;
+        std::vector<unsigned long> mask;
+        for( size_t i = 0; i < nodes.size(); ++i ){
+            const size_t n = static_cast<size_t>(nodes[i]);
+            if( mask.size() <= n / bits )
+                mask.resize(n / bits + 1, 0);
+            mask[n / bits] |= 1ul << (n % bits);
+        }
+        return mask;
+    }
+}
+
+
+// TOPOLOGY
+
+const std::vector<int>& numa::online_nodes()
+{
+    static const std::vector<int> nodes = [](){
+        std::vector<int> ids = parse_list("/sys/devices/system/node/online");
+        if( ids.empty() )
+            ids.push_back(0);
+        return ids;
+    }();
+    return nodes;
+}
+
+
+unsigned numa::node_count()
+{
+    return static_cast<unsigned>( online_nodes().size() );
+}
+
+
+std::vector<int> numa::node_cpus( int node )
+{
+    return parse_list( "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist" );
+}
+
+
+int numa::current_node()
+{
+    unsigned cpu = 0, node = 0;
+    if( syscall(SYS_getcpu, &cpu, &node, NULL) != 0 )
+        return 0;
+    return static_cast<int>(node);
+}
+
+
+bool numa::available()
+{
+    static const bool avail = node_count() > 1 && ( mbind_(NULL, 0, 0, NULL, 0) == 0 || errno != ENOSYS );
+    return avail;
+}
+
+
+// PINNING
+
+bool numa::pin_thread_to_node( int node )
+{
+    std::vector<int> cpus = node_cpus(node);
+    if( cpus.empty() )
+        return false;
+    
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for( size_t i = 0; i < cpus.size(); ++i )
+        CPU_SET(cpus[i], &set);
+    
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+
+// PLACEMENT
+
+std::shared_ptr<void> numa::allocate_on_node( size_t bytes, int node )
+{
+    if( !available() )
+        return df::allocate_block(bytes);
+    return map_with_policy( bytes, MPOL_BIND_, node_mask( std::vector<int>(1, node) ) );
+}
+
+
+std::shared_ptr<void> numa::allocate_interleaved( size_t bytes )
+{
+    if( !available() )
+        return df::allocate_block(bytes);
+    return map_with_policy( bytes, MPOL_INTERLEAVE_, node_mask( online_nodes() ) );
+}
@@ -0,0 +1,144 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * numa.hpp
+ *
+ * Design Overview:
+ *
+ * NUMA topology queries, page placement and thread pinning for running
+ * parallel sweeps over large read-only datasets on multi-socket hosts.
+ *
+ * Read-only DataFrame storage can either be replicated, one copy bound to
+ * each node (Replicated<T>, workers read the replica of the node they run
+ * on), or interleaved page by page across all nodes. Workers are pinned to
+ * the CPUs of a node so that the replica they read stays local.
+ *
+ * Notes:
+ *
+ * Uses the mbind/getcpu system calls and /sys topology directly instead of
+ * linking libnuma. On single-node hosts, or kernels without NUMA support,
+ * everything degrades to ordinary allocations and no-op pinning.
+ *
+ */
+
+
+#ifndef backtester_numa_hpp
+#define backtester_numa_hpp
+
+//STL
+#include <vector>
+#include <memory>
+#include <string>
+
+#include "dataframe.hpp"
+
+namespace df = dataframe;
+
+namespace numa {
+    
+    // TOPOLOGY
+    
+    const std::vector<int>& online_nodes(); // ids of the online nodes, ascending; may have gaps
+    unsigned node_count();                  // online nodes, at least 1
+    std::vector<int> node_cpus( int node ); // cpus of a node, empty if unknown
+    int current_node();                     // node of the calling thread's cpu, 0 if unknown
+    bool available();                       // more than one node and mbind supported
+    
+    
+    // PINNING
+    
+    bool pin_thread_to_node( int node );    // restricts the calling thread to the cpus of node
+    
+    
+    // PLACEMENT
+    
+    enum Placement { DEFAULT, INTERLEAVE, REPLICATE };
+    
+    // page-aligned, zeroed blocks whose pages are bound to node, or interleaved across
+    // all nodes; fall back to ordinary allocation where NUMA policies are unavailable
+    std::shared_ptr<void> allocate_on_node( size_t bytes, int node );
+    std::shared_ptr<void> allocate_interleaved( size_t bytes );
+    
+    
+    template<typename T> df::DataFrame<T> copy_to_node( const df::DataFrame<T>& frame, int node ){
+        return frame.clone( [node]( size_t bytes ){ return allocate_on_node(bytes, node); } );
+    }
+    
+    template<typename T> df::DataFrame<T> interleave( const df::DataFrame<T>& frame ){
+        return frame.clone( allocate_interleaved );
+    }
+    
+    
+    // -----------------------------------------------------------------
+    // REPLICATED DATAFRAME
+    // -----------------------------------------------------------------
+    
+    template<typename T> class Replicated {
+        
+    public:
+        
+        explicit Replicated( const df::DataFrame<T>& frame, Placement placement = REPLICATE )
+        :   _placement( available() ? placement : DEFAULT ),
+            _replicas()
+        {
+            if( _placement == REPLICATE )
+                for( size_t i = 0; i < online_nodes().size(); ++i )
+                    _replicas.push_back( copy_to_node(frame, online_nodes()[i]) );
+            else if( _placement == INTERLEAVE )
+                _replicas.push_back( interleave(frame) );
+            else
+                _replicas.push_back( frame );
+        };
+        
+        // replica closest to the calling thread; pin the thread first for this to be stable
+        const df::DataFrame<T>& local() const {
+            return on_node( current_node() );
+        }
+        
+        const df::DataFrame<T>& on_node( int node ) const {
+            if( _placement == REPLICATE ){
+                const std::vector<int>& ids = online_nodes();     // replicas are in this order
+                for( size_t i = 0; i < ids.size(); ++i )
+                    if( ids[i] == node )
+                        return _replicas[i];
+            }
+            return _replicas[0];
+        }
+        
+        Placement placement() const {
+            return _placement;
+        }
+        
+    private:
+        Placement _placement;
+        std::vector< df::DataFrame<T> > _replicas;
+    };
+    
+} // namespace numa
+
+
+#endif
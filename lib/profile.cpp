@@ -0,0 +1,391 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "profile.hpp"
+
+using namespace profile;
+
+namespace {
+    
+    struct Registry {
+        
+        Registry(): next(0), trace_size(1 << 16), trace_base(0), trace_epoch(0) {
+            if( const char* path = std::getenv("TSDB_TRACE") ){
+                trace_path = path;
+                trace_base = ticks();
+                trace_enabled.store(true);
+            }
+            std::atexit( &at_exit );
+        }
+        
+        static void at_exit(){
+            stop_trace();
+            report(stderr);
+        }
+        
+        std::mutex lock;
+        const char* names[MAX_PROBES];
+        Kind kinds[MAX_PROBES];
+        std::atomic<size_t> next;
+        std::vector<Slots*> threads;    // never freed, so counts survive their threads
+        std::vector<Slots*> spare;      // of exited threads, reused by new ones
+        
+        std::string trace_path;
+        size_t trace_size;              // ring events per thread
+        uint64_t trace_base;            // ticks at trace start
+        std::atomic<uint64_t> trace_epoch;  // bumped by start_trace
+    };
+    
+    Registry& registry(){
+        static Registry* r = new Registry();    // leaked: must outlive the atexit report
+        return *r;
+    }
+    
+    // hands the calling thread's slots back when it exits
+    struct Recycler {
+        Recycler(): slots(NULL) {};
+        ~Recycler(){
+            if( !slots )
+                return;
+            Registry& r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.spare.push_back(slots);
+        }
+        Slots* slots;
+    };
+    
+    std::string duration( double ns ){
+        char buf[32];
+        if( ns < 1e3 )      std::snprintf(buf, sizeof(buf), "%.1f ns", ns);
+        else if( ns < 1e6 ) std::snprintf(buf, sizeof(buf), "%.1f us", ns * 1e-3);
+        else if( ns < 1e9 ) std::snprintf(buf, sizeof(buf), "%.1f ms", ns * 1e-6);
+        else                std::snprintf(buf, sizeof(buf), "%.2f s", ns * 1e-9);
+        return buf;
+    }
+    
+    double percentile( const uint64_t* hist, uint64_t count, double q, double scale ){
+        const uint64_t target = static_cast<uint64_t>( q * count );
+        uint64_t seen = 0;
+        for( size_t b = 0; b < BUCKETS; ++b ){
+            seen += hist[b];
+            if( seen > target )
+                return b ? static_cast<double>(1ull << (b - 1)) * 1.5 / scale : 0;    // bucket midpoint
+        }
+        return 0;
+    }
+}
+
+
+double profile::ticks_per_ns()
+{
+    static const double rate = [](){
+        const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        const uint64_t c0 = ticks();
+        std::this_thread::sleep_for( std::chrono::milliseconds(20) );
+        const uint64_t c1 = ticks();
+        const double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - t0 ).count();
+        return static_cast<double>(c1 - c0) / ns;
+    }();
+    return rate;
+}
+
+
+Probe::Probe( const char* name, Kind kind )
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    
+    // probes in inlined code may be constructed once per translation unit; share ids by name
+    const size_t n = r.next.load();
+    for( size_t i = 0; i < n; ++i ){
+        if( std::strcmp(r.names[i], name) == 0 ){
+            _id = i;
+            return;
+        }
+    }
+    
+    if( n == MAX_PROBES ){
+        std::fprintf(stderr, "profile: too many probes, %s ignored\n", name);
+        _id = MAX_PROBES - 1;
+        return;
+    }
+    r.names[n] = name;
+    r.kinds[n] = kind;
+    r.next.store(n + 1);
+    _id = n;
+}
+
+
+Slots* profile::register_thread()
+{
+    static thread_local Recycler recycler;
+    Registry& r = registry();
+    
+    // slots of an exited thread keep their counts, the new thread adds to them
+    {
+        std::lock_guard<std::mutex> guard(r.lock);
+        if( !r.spare.empty() ){
+            recycler.slots = r.spare.back();
+            r.spare.pop_back();
+            return recycler.slots;
+        }
+    }
+    
+    Slots* s = static_cast<Slots*>( std::calloc(1, sizeof(Slots)) );
+    if( !s )
+        throw std::bad_alloc();
+    
+    std::lock_guard<std::mutex> guard(r.lock);
+    s->tid = static_cast<uint32_t>( r.threads.size() + 1 );
+    r.threads.push_back(s);
+    recycler.slots = s;
+    return s;
+}
+
+
+// TIMELINE
+
+std::atomic<bool> profile::trace_enabled(false);
+
+
+void profile::trace( const Probe& p, uint64_t start, uint64_t end, uint32_t track, int64_t arg )
+{
+    Slots& s = local();
+    Registry& r = registry();
+    const uint64_t h = s.head.load(std::memory_order_relaxed);
+    
+    // first event since start_trace: earlier ones belong to the previous trace
+    const uint64_t epoch = r.trace_epoch.load(std::memory_order_acquire);
+    if( s.epoch.load(std::memory_order_relaxed) != epoch ){
+        s.first.store(h, std::memory_order_relaxed);
+        s.epoch.store(epoch, std::memory_order_relaxed);
+    }
+    
+    if( !s.ring ){
+        std::lock_guard<std::mutex> guard(r.lock);
+        s.ring = static_cast<TraceEvent*>( std::calloc(r.trace_size, sizeof(TraceEvent)) );
+        if( !s.ring )
+            return;
+        s.ring_size = r.trace_size;
+    }
+    
+    // claim before overwriting, so a reader can tell the slot may have changed under it
+    s.claimed.store(h + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    TraceEvent& e = s.ring[ h % s.ring_size ];
+    e.probe.store( static_cast<uint32_t>( p.id() ), std::memory_order_relaxed );
+    e.track.store( track, std::memory_order_relaxed );
+    e.start.store( start, std::memory_order_relaxed );
+    e.end.store( end, std::memory_order_relaxed );
+    e.arg.store( arg, std::memory_order_relaxed );
+    s.head.store(h + 1, std::memory_order_release);
+}
+
+
+void profile::start_trace( const std::string& path, size_t events_per_thread )
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    
+    r.trace_path = path;
+    r.trace_size = std::max<size_t>(1, events_per_thread);  // applies to rings not yet allocated
+    r.trace_base = ticks();
+    r.trace_epoch.fetch_add(1, std::memory_order_release);     // threads restart their rings lazily
+    trace_enabled.store(true);
+}
+
+
+void profile::stop_trace()
+{
+    if( !trace_enabled.exchange(false) )
+        return;
+    
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    
+    FILE* out = std::fopen(r.trace_path.c_str(), "w");
+    if( !out ){
+        std::fprintf(stderr, "profile: could not write trace to %s\n", r.trace_path.c_str());
+        return;
+    }
+    
+    const double us = ticks_per_ns() * 1e3;     // ticks per microsecond
+    const long pid = static_cast<long>( getpid() );
+    std::vector<uint32_t> tracks;
+    uint64_t dropped = 0;
+    const char* sep = "";
+    
+    std::fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    std::fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":0,\"args\":{\"name\":\"tsdb %ld\"}}", pid, pid);
+    sep = ",\n";
+    
+    const uint64_t epoch = r.trace_epoch.load(std::memory_order_relaxed);
+    const size_t nprobes = r.next.load();
+    
+    for( size_t t = 0; t < r.threads.size(); ++t ){
+        
+        // the owner keeps writing; only events published before this load are read
+        const Slots& s = *r.threads[t];
+        const uint64_t head = s.head.load(std::memory_order_acquire);
+        if( !s.ring || s.epoch.load(std::memory_order_relaxed) != epoch )
+            continue;
+        
+        uint64_t first = std::min( s.first.load(std::memory_order_relaxed), head );
+        if( head - first > s.ring_size ){
+            dropped += head - first - s.ring_size;
+            first = head - s.ring_size;
+        }
+        if( first == head )
+            continue;
+        
+        std::fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                     sep, pid, s.tid, s.tid);
+        
+        for( uint64_t k = first; k < head; ++k ){
+            
+            const TraceEvent& ev = s.ring[k % s.ring_size];
+            const uint32_t probe = ev.probe.load(std::memory_order_relaxed);
+            const uint32_t track = ev.track.load(std::memory_order_relaxed);
+            const uint64_t start = ev.start.load(std::memory_order_relaxed);
+            const uint64_t end = ev.end.load(std::memory_order_relaxed);
+            const int64_t arg = ev.arg.load(std::memory_order_relaxed);
+            
+            // overwritten by a later lap of the ring while we read it
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if( s.claimed.load(std::memory_order_relaxed) > k + s.ring_size ){
+                ++dropped;
+                continue;
+            }
+            if( probe >= nprobes || start < r.trace_base )
+                continue;
+            
+            const char* name = r.names[probe];
+            const char* dot = std::strchr(name, '.');
+            const std::string cat = dot ? std::string(name, dot) : std::string(name);
+            
+            // explicit tracks are shown as processes of their own, e.g. sweep workers
+            const long epid = track ? static_cast<long>(track) : pid;
+            const unsigned tid = track ? track : s.tid;
+            if( track && std::find(tracks.begin(), tracks.end(), track) == tracks.end() )
+                tracks.push_back(track);
+            
+            std::fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%u",
+                         sep, name, cat.c_str(), (start - r.trace_base) / us, (end - start) / us, epid, tid);
+            if( arg >= 0 )
+                std::fprintf(out, ",\"args\":{\"arg\":%lld}", static_cast<long long>(arg));
+            std::fprintf(out, "}");
+        }
+    }
+    
+    for( size_t k = 0; k < tracks.size(); ++k )
+        std::fprintf(out, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+                     sep, tracks[k], tracks[k], tracks[k]);
+    
+    std::fprintf(out, "\n]}\n");
+    std::fclose(out);
+    
+    if( dropped )
+        std::fprintf(stderr, "profile: trace rings wrapped, %llu oldest events dropped\n", (unsigned long long)dropped);
+}
+
+
+void profile::report( FILE* out )
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    const size_t n = r.next.load();
+    if( n == 0 )
+        return;
+    
+    const double scale = ticks_per_ns();
+    bool header = false;
+    
+    for( size_t i = 0; i < n; ++i ){
+        
+        uint64_t count = 0, sum = 0, hist[BUCKETS] = {};
+        for( size_t t = 0; t < r.threads.size(); ++t ){
+            const Slot& s = r.threads[t]->slot[i];
+            count += s.count.load(std::memory_order_relaxed);
+            sum += s.sum.load(std::memory_order_relaxed);
+            for( size_t b = 0; b < BUCKETS; ++b )
+                hist[b] += s.hist[b].load(std::memory_order_relaxed);
+        }
+        if( count == 0 )
+            continue;
+        
+        if( !header ){
+            std::fprintf(out, "\n%-28s %12s %14s %12s %12s %12s\n", "Probe", "Calls", "Total", "Mean", "p50", "p99");
+            header = true;
+        }
+        
+        switch( r.kinds[i] ){
+            case TIMER:
+                std::fprintf(out, "%-28s %12llu %14s %12s %12s %12s\n", r.names[i], (unsigned long long)count,
+                             duration(sum / scale).c_str(), duration(sum / scale / count).c_str(),
+                             duration(percentile(hist, count, 0.5, scale)).c_str(),
+                             duration(percentile(hist, count, 0.99, scale)).c_str());
+                break;
+            case COUNTER:
+                std::fprintf(out, "%-28s %12llu %14llu\n", r.names[i], (unsigned long long)count, (unsigned long long)sum);
+                break;
+            case VALUE:
+                std::fprintf(out, "%-28s %12llu %14llu %12.1f %12.1f %12.1f\n", r.names[i],
+                             (unsigned long long)count, (unsigned long long)sum, static_cast<double>(sum) / count,
+                             percentile(hist, count, 0.5, 1.0), percentile(hist, count, 0.99, 1.0));
+                break;
+        }
+    }
+    std::fflush(out);
+}
+
+
+void profile::reset()
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    
+    // counters only; the trace rings and thread ids stay
+    for( size_t t = 0; t < r.threads.size(); ++t ){
+        for( size_t i = 0; i < MAX_PROBES; ++i ){
+            Slot& s = r.threads[t]->slot[i];
+            s.count.store(0, std::memory_order_relaxed);
+            s.sum.store(0, std::memory_order_relaxed);
+            for( size_t b = 0; b < BUCKETS; ++b )
+                s.hist[b].store(0, std::memory_order_relaxed);
+        }
+    }
+}
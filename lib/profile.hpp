@@ -0,0 +1,219 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * profile.hpp
+ *
+ * Design Overview:
+ *
+ * Low-overhead instrumentation for hot paths. Use it through the macros in
+ * macros.hpp, which compile to nothing unless PROFILE is defined:
+ *
+ *     PROFILE_SCOPE("csv.parse");          // time the enclosing scope
+ *     PROFILE_COUNT("ts.insert", 1);       // add to a counter
+ *     PROFILE_VALUE("sweep.lease", n);     // record a value in a histogram
+ *     PROFILE_REPORT();                    // print the report now
+ *
+ * Every probe site owns a static Probe holding a small integer id. Each
+ * thread records into its own Slots array indexed by that id, so a probe
+ * is a TSC read (for timers) plus a few adds to thread-local memory, with
+ * no locks and no shared cache lines. Slots are owned by a process-wide
+ * registry and outlive their threads, so the report, printed at exit or
+ * on demand, sums counts from every thread that ever ran. The slots of an
+ * exited thread go to the next new thread, so short-lived workers do not
+ * add memory; in traces they share a track.
+ *
+ * Histograms have one bucket per power of two (ticks for timers), which
+ * is enough to tell a 50ns probe from a 5us one and to spot tails. A timer
+ * costs two TSC reads, so time loops or phases rather than single bars;
+ * counters cost a few adds.
+ *
+ * Timelines: while tracing is on (start_trace, or TSDB_TRACE=<file> in
+ * the environment), every timed scope also appends a complete event to a
+ * ring buffer of its thread; PROFILE_SPAN adds spans on explicit tracks,
+ * such as one per sweep worker process. stop_trace, or process exit,
+ * writes all rings as Chrome trace-event JSON, which chrome://tracing and
+ * Perfetto open directly. Rings keep the newest events when they wrap.
+ * Only the owning thread writes its ring; it publishes each event with a
+ * release store of its head, and start_trace bumps an epoch that threads
+ * notice on their next event instead of resetting their heads, so rings
+ * can be written out while probes keep firing.
+ * Forked sweep workers leave through _exit and do not write traces of
+ * their own; their leases are traced by the coordinator.
+ *
+ */
+
+
+#ifndef backtester_profile_hpp
+#define backtester_profile_hpp
+
+//STL
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <algorithm>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace profile {
+    
+    const size_t MAX_PROBES = 256;
+    const size_t BUCKETS = 64;
+    
+    enum Kind { TIMER, COUNTER, VALUE };
+    
+    // cycle counter on x86, nanoseconds elsewhere
+    inline uint64_t ticks(){
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch() ).count() );
+#endif
+    }
+    
+    double ticks_per_ns();      // calibrated once against steady_clock
+    
+    
+    // one per probe site, registered on first use
+    class Probe {
+        
+    public:
+        Probe( const char* name, Kind kind );
+        
+        size_t id() const { return _id; }
+        
+    private:
+        size_t _id;
+    };
+    
+    
+    // per-thread counters of one probe; written only by the owning thread
+    struct Slot {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> hist[BUCKETS];
+    };
+    
+    // atomic fields, accessed relaxed, since stop_trace reads rings that are being written
+    struct TraceEvent {
+        std::atomic<uint32_t> probe;
+        std::atomic<uint32_t> track;    // 0 = recording thread, else a process id
+        std::atomic<uint64_t> start;
+        std::atomic<uint64_t> end;
+        std::atomic<int64_t> arg;       // shown in the event args unless negative
+    };
+    
+    struct Slots {
+        Slot slot[MAX_PROBES];
+        TraceEvent* ring;               // allocated on the first traced event
+        size_t ring_size;
+        std::atomic<uint64_t> head;     // events published so far (release)
+        std::atomic<uint64_t> claimed;  // events started; a slot below claimed - ring_size is stale
+        std::atomic<uint64_t> epoch;    // trace the events from first on belong to
+        std::atomic<uint64_t> first;
+        uint32_t tid;
+    };
+    
+    Slots* register_thread();   // slots owned by the registry, recycled when the thread exits
+    
+    inline Slots& local(){
+        static thread_local Slots* slots = NULL;
+        if( !slots )
+            slots = register_thread();
+        return *slots;
+    }
+    
+    // single writer, so a relaxed load and store suffice and compile to a plain add
+    inline void bump( std::atomic<uint64_t>& a, uint64_t v ){
+        a.store( a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed );
+    }
+    
+    inline size_t bucket( uint64_t v ){
+        return v ? 64 - static_cast<size_t>( __builtin_clzll(v) ) : 0;
+    }
+    
+    inline void record( const Probe& p, uint64_t v ){
+        Slot& s = local().slot[p.id()];
+        bump(s.count, 1);
+        bump(s.sum, v);
+        bump(s.hist[ std::min(bucket(v), BUCKETS-1) ], 1);
+    }
+    
+    inline void add( const Probe& p, uint64_t n ){
+        Slot& s = local().slot[p.id()];
+        bump(s.count, 1);
+        bump(s.sum, n);
+    }
+    
+    
+    // TIMELINE
+    
+    extern std::atomic<bool> trace_enabled;
+    
+    inline bool tracing(){
+        return trace_enabled.load(std::memory_order_relaxed);
+    }
+    
+    void trace( const Probe& p, uint64_t start, uint64_t end, uint32_t track = 0, int64_t arg = -1 );
+    
+    void start_trace( const std::string& path, size_t events_per_thread = 1 << 16 );
+    void stop_trace();          // writes the trace file, no-op if not tracing
+    
+    
+    class ScopedTimer {
+        
+    public:
+        explicit ScopedTimer( const Probe& p ): _probe(p), _start( ticks() ) {};
+        ~ScopedTimer(){
+            const uint64_t end = ticks();
+            record(_probe, end - _start);
+            if( tracing() )
+                trace(_probe, _start, end);
+        }
+        
+    private:
+        ScopedTimer( const ScopedTimer& );
+        ScopedTimer& operator=( const ScopedTimer& );
+        
+        const Probe& _probe;
+        const uint64_t _start;
+    };
+    
+    
+    // REPORT
+    
+    void report( FILE* out = stderr );      // totals over all threads so far
+    void reset();                           // zero all counters
+    
+} // namespace profile
+
+
+#endif
@@ -0,0 +1,456 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * pyramid.cpp
+ *
+ */
+
+#include <dirent.h>
+#include <cstdio>
+#include <algorithm>
+
+#include "pyramid.hpp"
+#include "native.hpp"
+
+using namespace pyramid;
+
+// EXCEPTIONS
+
+PyramidException::PyramidException(const std::string& message):_msg(_spec + message){};
+PyramidException::~PyramidException() throw(){};
+
+const char* PyramidException::what() const throw() {return _msg.c_str(); }
+const std::string PyramidException::_spec = "Pyramid Exception: ";
+
+
+namespace {
+    
+    void rules_for( const std::vector<std::string>& names, std::vector<Rule>& rules, size_t& volume ){
+        rules.clear();
+        volume = std::find( names.begin(), names.end(), "volume" ) - names.begin();
+        for( size_t c = 0; c < names.size(); ++c ){
+            const Rule r = rule_for(names[c]);
+            rules.push_back( r == VWAP && volume == names.size() ? LAST : r );
+        }
+    }
+    
+    double fold( Rule rule, const double* v, const double* w, size_t n ){
+        double x = 0, y = 0;
+        switch( rule ){
+            case FIRST:
+                return v[0];
+            case LAST:
+                return v[n-1];
+            case MAX:
+                return *std::max_element(v, v + n);
+            case MIN:
+                return *std::min_element(v, v + n);
+            case SUM:
+                for( size_t i = 0; i < n; ++i )
+                    x += v[i];
+                return x;
+            case VWAP:
+                for( size_t i = 0; i < n; ++i ){
+                    x += v[i] * w[i];
+                    y += w[i];
+                }
+                return y != 0 ? x / y : v[n-1];
+        }
+        return v[n-1];
+    }
+    
+    // appends the period bars of ascending rows to out_index and out
+    void aggregate( time_t period, const std::vector<Rule>& rules, size_t volume,
+                    size_t rows, const time_t* index, const std::vector<const double*>& columns,
+                    std::vector<time_t>& out_index, std::vector< std::vector<double> >& out ){
+        
+        for( size_t i = 0; i < rows; ){
+            const time_t b = bucket( index[i], period );
+            size_t j = i + 1;
+            while( j < rows && index[j] < b + period )
+                ++j;
+            
+            out_index.push_back(b);
+            for( size_t c = 0; c < columns.size(); ++c ){
+                const double* w = volume < columns.size() ? columns[volume] + i : NULL;
+                out[c].push_back( fold( rules[c], columns[c] + i, w, j - i ) );
+            }
+            i = j;
+        }
+    }
+    
+    std::vector<const double*> column_ptrs( const df::DynFrame& frame ){
+        std::vector<const double*> columns;
+        for( size_t c = 0; c < frame.ncols(); ++c )
+            columns.push_back( frame.column(c).values<double>() );
+        return columns;
+    }
+    
+    std::string level_meta( const std::string& meta, time_t period ){
+        return meta + (meta.empty() ? "" : " ") + "[" + label(period) + "]";
+    }
+    
+    // hour and day levels would be a handful of rows per daily file
+    dataset::Granularity level_granularity( time_t period, dataset::Granularity base ){
+        return period >= H1 ? dataset::MONTH : base;
+    }
+}
+
+
+std::vector<time_t> pyramid::default_periods()
+{
+    const time_t p[] = { M5, M15, H1, D1 };
+    return std::vector<time_t>( p, p + 4 );
+}
+
+
+std::string pyramid::label( time_t period )
+{
+    char buf[32];
+    if( period % D1 == 0 )
+        std::snprintf( buf, sizeof(buf), "%lldd", static_cast<long long>(period / D1) );
+    else if( period % H1 == 0 )
+        std::snprintf( buf, sizeof(buf), "%lldh", static_cast<long long>(period / H1) );
+    else if( period % M1 == 0 )
+        std::snprintf( buf, sizeof(buf), "%lldm", static_cast<long long>(period / M1) );
+    else
+        std::snprintf( buf, sizeof(buf), "%llds", static_cast<long long>(period) );
+    return buf;
+}
+
+
+time_t pyramid::parse_label( const std::string& label )
+{
+    if( label.size() < 2 || label.size() > 12 || label[0] < '1' || label[0] > '9' )
+        return 0;
+    
+    time_t n = 0;
+    for( size_t i = 0; i + 1 < label.size(); ++i ){
+        if( label[i] < '0' || label[i] > '9' )
+            return 0;
+        n = n * 10 + (label[i] - '0');
+    }
+    
+    switch( label[label.size() - 1] ){
+        case 's': return n;
+        case 'm': return n * M1;
+        case 'h': return n * H1;
+        case 'd': return n * D1;
+    }
+    return 0;
+}
+
+
+Rule pyramid::rule_for( const std::string& column )
+{
+    if( column == "open" )
+        return FIRST;
+    if( column == "high" )
+        return MAX;
+    if( column == "low" )
+        return MIN;
+    if( column == "volume" || column == "trades" )
+        return SUM;
+    if( column == "vwap" )
+        return VWAP;
+    return LAST;
+}
+
+
+// -----------------------------------------------------------------
+// IN MEMORY
+// -----------------------------------------------------------------
+
+Pyramid::Pyramid( const std::vector<std::string>& names,
+                  const std::vector<time_t>& periods,
+                  const std::string& meta )
+:   _names(names),
+    _rules(),
+    _volume(0),
+    _meta(meta),
+    _levels(),
+    _tail(),
+    _empty(true),
+    _last(0)
+{
+    for( size_t k = 0; k < periods.size(); ++k ){
+        if( periods[k] <= 0 || ( k && ( periods[k] <= periods[k-1] || periods[k] % periods[k-1] ) ) )
+            throw PyramidException("Periods must be increasing multiples of each other.");
+        
+        Level level;
+        level.period = periods[k];
+        level.columns.resize( names.size() );
+        _levels.push_back(level);
+    }
+    
+    rules_for( _names, _rules, _volume );
+    _tail.period = periods.empty() ? 0 : periods[0];
+    _tail.columns.resize( names.size() );
+}
+
+
+void Pyramid::append( size_t rows, const time_t* index, const std::vector<const double*>& columns )
+{
+    if( columns.size() != _names.size() )
+        throw PyramidException("Column count does not match the pyramid.");
+    if( !rows )
+        return;
+    for( size_t i = 1; i < rows; ++i )
+        if( index[i] <= index[i-1] )
+            throw PyramidException("Appended index is not strictly increasing.");
+    if( !_empty && index[0] <= _last )
+        throw PyramidException("Appended rows must come after the last appended timestamp.");
+    
+    _empty = false;
+    _last = index[rows-1];
+    if( _levels.empty() )
+        return;
+    
+    // the lowest level from the base rows of its open period plus the new ones
+    time_t from = bucket( index[0], _tail.period );
+    if( !_tail.index.empty() && _tail.index[0] < from ){
+        _tail.index.clear();
+        for( size_t c = 0; c < _names.size(); ++c )
+            _tail.columns[c].clear();
+    }
+    _tail.index.insert( _tail.index.end(), index, index + rows );
+    for( size_t c = 0; c < _names.size(); ++c )
+        _tail.columns[c].insert( _tail.columns[c].end(), columns[c], columns[c] + rows );
+    
+    const Level* lower = &_tail;
+    
+    // every level above from the rows of the one below in its last changed period
+    for( size_t k = 0; k < _levels.size(); ++k ){
+        Level& level = _levels[k];
+        from = bucket( from, level.period );
+        
+        const size_t keep = std::lower_bound( level.index.begin(), level.index.end(), from ) - level.index.begin();
+        level.index.resize(keep);
+        for( size_t c = 0; c < _names.size(); ++c )
+            level.columns[c].resize(keep);
+        
+        const size_t s = std::lower_bound( lower->index.begin(), lower->index.end(), from ) - lower->index.begin();
+        std::vector<const double*> src;
+        for( size_t c = 0; c < _names.size(); ++c )
+            src.push_back( lower->columns[c].data() + s );
+        
+        aggregate( level.period, _rules, _volume, lower->index.size() - s, lower->index.data() + s, src,
+                   level.index, level.columns );
+        lower = &level;
+    }
+    
+    // keep only the base rows of the lowest level's open period
+    const size_t drop = std::lower_bound( _tail.index.begin(), _tail.index.end(),
+                                          bucket( _last, _tail.period ) ) - _tail.index.begin();
+    _tail.index.erase( _tail.index.begin(), _tail.index.begin() + drop );
+    for( size_t c = 0; c < _names.size(); ++c )
+        _tail.columns[c].erase( _tail.columns[c].begin(), _tail.columns[c].begin() + drop );
+}
+
+
+bool Pyramid::has( time_t period ) const
+{
+    for( size_t k = 0; k < _levels.size(); ++k )
+        if( _levels[k].period == period )
+            return true;
+    return false;
+}
+
+
+size_t Pyramid::size( time_t period ) const
+{
+    return _find(period).index.size();
+}
+
+
+const Pyramid::Level& Pyramid::_find( time_t period ) const
+{
+    for( size_t k = 0; k < _levels.size(); ++k )
+        if( _levels[k].period == period )
+            return _levels[k];
+    throw PyramidException("No "+label(period)+" level.");
+}
+
+
+df::DynFrame Pyramid::level( time_t period ) const
+{
+    const Level& level = _find(period);
+    const size_t rows = level.index.size();
+    const size_t stride = df::padded_stride(rows);
+    
+    std::shared_ptr<void> block = df::allocate_block( df::block_size(rows, _names.size()) );
+    time_t* idx = static_cast<time_t*>( block.get() );
+    double* cols = reinterpret_cast<double*>( idx + stride );
+    
+    std::vector<df::Column> columns;
+    std::copy( level.index.begin(), level.index.end(), idx );
+    for( size_t c = 0; c < _names.size(); ++c ){
+        std::copy( level.columns[c].begin(), level.columns[c].end(), cols + c*stride );
+        df::Column col = { _names[c], df::FLOAT64, cols + c*stride, NULL };
+        columns.push_back(col);
+    }
+    return df::DynFrame::adopt( rows, block, idx, columns, level_meta(_meta, period) );
+}
+
+
+// -----------------------------------------------------------------
+// NEXT TO A NATIVE FILE
+// -----------------------------------------------------------------
+
+std::string pyramid::level_path( const std::string& path, time_t period )
+{
+    const std::string ext = ".tsn";
+    if( path.size() > ext.size() && path.compare( path.size() - ext.size(), ext.size(), ext ) == 0 )
+        return path.substr( 0, path.size() - ext.size() ) + "." + label(period) + ext;
+    return path + "." + label(period);
+}
+
+
+void pyramid::write( const std::string& path, const Pyramid& pyramid )
+{
+    for( size_t k = 0; k < pyramid.nlevels(); ++k ){
+        const df::DynFrame frame = pyramid.level( pyramid.period(k) );
+        native::write_columns( level_path(path, pyramid.period(k)), frame.size(), frame.index(),
+                               column_ptrs(frame), pyramid.column_names(), frame.meta() );
+    }
+}
+
+
+df::DynFrame pyramid::read( const std::string& path, time_t period )
+{
+    return native::read( level_path(path, period) );
+}
+
+
+// -----------------------------------------------------------------
+// INSIDE A DATASET
+// -----------------------------------------------------------------
+
+std::string pyramid::level_dir( const std::string& dir, time_t period )
+{
+    return dir + "/" + label(period);
+}
+
+
+std::vector<time_t> pyramid::levels( const std::string& dir )
+{
+    std::vector<time_t> periods;
+    DIR* d = ::opendir( dir.c_str() );
+    if( !d )
+        return periods;
+    
+    while( struct dirent* e = ::readdir(d) ){
+        const time_t period = parse_label( e->d_name );
+        if( period && dataset::exists( dir + "/" + e->d_name ) )
+            periods.push_back(period);
+    }
+    ::closedir(d);
+    
+    std::sort( periods.begin(), periods.end() );
+    return periods;
+}
+
+
+void pyramid::build_levels( const std::string& dir, const std::vector<time_t>& periods )
+{
+    const dataset::Manifest m = dataset::read_manifest(dir);
+    Pyramid p( m.columns, periods, m.meta );
+    
+    for( size_t k = 0; k < m.partitions.size(); ++k ){
+        const df::DynFrame part = dataset::load_columns( dir, m.partitions[k].first, m.partitions[k].last, 1 );
+        p.append( part.size(), part.index(), column_ptrs(part) );
+    }
+    
+    const std::vector<time_t> stored = levels(dir);
+    for( size_t k = 0; k < stored.size(); ++k )
+        dataset::remove( level_dir(dir, stored[k]) );
+    
+    for( size_t k = 0; k < p.nlevels(); ++k ){
+        const df::DynFrame frame = p.level( p.period(k) );
+        dataset::append_columns( level_dir(dir, p.period(k)), frame.size(), frame.index(), column_ptrs(frame),
+                                 m.columns, frame.meta(), level_granularity( p.period(k), m.granularity ) );
+    }
+}
+
+
+void pyramid::append_columns( const std::string& dir, size_t rows, const time_t* index,
+                              const std::vector<const double*>& columns,
+                              const std::vector<std::string>& names, const std::string& meta,
+                              dataset::Granularity g )
+{
+    const std::vector<time_t> periods = levels(dir);
+    
+    dataset::append_columns( dir, rows, index, columns, names, meta, g );
+    if( !rows || periods.empty() )
+        return;
+    
+    const dataset::Manifest m = dataset::read_manifest(dir);
+    std::vector<Rule> rules;
+    size_t volume;
+    rules_for( names, rules, volume );
+    
+    // each level from the rows of the one below, starting at its own last bar or
+    // at the period of index[0], whichever is earlier; the stored bars from there
+    // on are replaced, which touches the newest partitions only. The last bar is
+    // the level's high-water mark: it holds the newest base row folded in, so base
+    // rows an interrupted earlier append left out all come after its start
+    std::string lower = dir;
+    
+    for( size_t k = 0; k < periods.size(); ++k ){
+        const std::string ld = level_dir( dir, periods[k] );
+        const dataset::Manifest lm = dataset::read_manifest(ld);
+        
+        time_t from = bucket( index[0], periods[k] );
+        if( lm.partitions.empty() )
+            from = dataset::MIN_TIME;
+        else
+            from = std::min( from, lm.partitions.back().last );
+        const df::DynFrame src = dataset::load_columns( lower, from, dataset::MAX_TIME, 1 );
+        
+        std::vector<time_t> idx;
+        std::vector< std::vector<double> > values( names.size() );
+        aggregate( periods[k], rules, volume, src.size(), src.index(), column_ptrs(src), idx, values );
+        
+        std::vector<const double*> ptrs;
+        for( size_t c = 0; c < names.size(); ++c )
+            ptrs.push_back( values[c].data() );
+        
+        lower = ld;
+        dataset::replace_columns( lower, idx.size(), idx.data(), ptrs, names, level_meta(m.meta, periods[k]),
+                                  level_granularity( periods[k], m.granularity ) );
+    }
+}
+
+
+df::DynFrame pyramid::load_columns( const std::string& dir, time_t period, time_t start, time_t end,
+                                    unsigned threads )
+{
+    const std::string ld = level_dir(dir, period);
+    if( !dataset::exists(ld) )
+        throw PyramidException("No "+label(period)+" level in "+dir+".");
+    return dataset::load_columns( ld, start, end, threads );
+}
@@ -0,0 +1,264 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * pyramid.hpp
+ *
+ * Design Overview:
+ *
+ * Precomputed coarser resolutions of a bar series, so multi-timeframe
+ * strategies and dashboards read 5m, 15m, 1h or 1d bars directly instead
+ * of resampling each run. The levels are optional and chosen per series;
+ * each must be a multiple of the one below, and each is aggregated from
+ * the one below (1m -> 5m -> 15m -> 1h -> 1d). A bar is stamped with the
+ * start of its period, periods are aligned to the epoch (days are UTC
+ * days) and periods without base rows have no bar.
+ *
+ * Columns are aggregated by name, see rule_for(): open is the first value,
+ * high the maximum, low the minimum, volume and trades are summed, vwap is
+ * weighted by volume, anything else takes the last value.
+ *
+ * Appending base rows only recomputes the tail of each level: the open
+ * bar of the lowest level is rebuilt from the base rows of its period,
+ * and each level above from the rows of the level below that fall into
+ * its own last period, so appends cost the same however long the history.
+ *
+ * A Pyramid holds the levels of a series in memory. They persist next to
+ * the base data: as native files beside a native file (es.tsn, es.5m.tsn,
+ * ...), or as datasets inside a dataset directory (see dataset.hpp), one
+ * subdirectory per level (ES/5m, ES/1h, ...). build_levels() creates the
+ * latter from the base, and append_columns() then appends to the base and
+ * updates every stored level, touching only their newest partitions. A
+ * level is recomputed from its own last bar when that is older than the
+ * appended rows, so an append interrupted between the base and the levels
+ * is caught up by the next one.
+ *
+ */
+
+
+#ifndef backtester_pyramid_hpp
+#define backtester_pyramid_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <ctime>
+
+//BOOST
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "dynframe.hpp"
+#include "dataset.hpp"
+#include "utilities.hpp"
+
+namespace bpt = boost::posix_time;
+namespace dp = datapoint;
+namespace ts = timeseries;
+namespace df = dataframe;
+
+namespace pyramid {
+    
+    // EXCEPTIONS
+    
+    class PyramidException: public std::exception {
+        
+    public:
+        PyramidException(const std::string& message);
+        ~PyramidException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    const time_t M1 = 60;
+    const time_t M5 = 300;
+    const time_t M15 = 900;
+    const time_t H1 = 3600;
+    const time_t D1 = 86400;
+    
+    // 5m, 15m, 1h and 1d, for a 1m base
+    std::vector<time_t> default_periods();
+    
+    std::string label( time_t period );                 // "5m", "1h", "1d", "30s"
+    time_t parse_label( const std::string& label );     // 0 if not a label
+    
+    // start of the period holding t
+    inline time_t bucket( time_t t, time_t period ){
+        const time_t r = t % period;
+        return r < 0 ? t - r - period : t - r;
+    }
+    
+    enum Rule { FIRST, MAX, MIN, LAST, SUM, VWAP };
+    
+    Rule rule_for( const std::string& column );
+    
+    
+    // -----------------------------------------------------------------
+    // IN MEMORY
+    // -----------------------------------------------------------------
+    
+    class Pyramid {
+        
+    public:
+        
+        // throws unless periods are increasing multiples of each other
+        Pyramid( const std::vector<std::string>& names,
+                 const std::vector<time_t>& periods = default_periods(),
+                 const std::string& meta = "" );
+        
+        template<typename T> static Pyramid build( const df::DataFrame<T>& base,
+                                                   const std::vector<time_t>& periods = default_periods() ){
+            Pyramid p( base.column_names(), periods, base.meta() );
+            p.append(base);
+            return p;
+        }
+        
+        // base rows, strictly increasing and after those appended before; throws
+        void append( size_t rows, const time_t* index, const std::vector<const double*>& columns );
+        
+        template<typename T> void append( const df::DataFrame<T>& base ){
+            std::vector<const double*> columns;
+            for( size_t j = 0; j < base.ncols(); ++j )
+                columns.push_back( base.column(j) );
+            append( base.size(), base.index(), columns );
+        }
+        
+        // ACCESSORS
+        
+        size_t nlevels() const { return _levels.size(); }
+        time_t period( size_t k ) const { return _levels.at(k).period; }
+        bool has( time_t period ) const;
+        size_t size( time_t period ) const;                 // throws if there is no such level
+        const std::vector<std::string>& column_names() const { return _names; }
+        const std::string& meta() const { return _meta; }
+        
+        // a copy of the level, unaffected by later appends; throws if there is no such level
+        df::DynFrame level( time_t period ) const;
+        
+        template<typename T> df::DataFrame<T> get( time_t period ) const {
+            if( _names != dp::dp_names<T>() )
+                throw PyramidException("Columns do not match datapoint type.");
+            return level(period).as<T>();
+        }
+        
+    private:
+        
+        struct Level {
+            time_t period;
+            std::vector<time_t> index;
+            std::vector< std::vector<double> > columns;
+        };
+        
+        const Level& _find( time_t period ) const;
+        
+        std::vector<std::string> _names;
+        std::vector<Rule> _rules;
+        size_t _volume;                 // column weighting VWAP, _names.size() if none
+        std::string _meta;
+        std::vector<Level> _levels;
+        Level _tail;                    // base rows in the open period of the lowest level
+        bool _empty;
+        time_t _last;                   // last base timestamp
+    };
+    
+    
+    // -----------------------------------------------------------------
+    // NEXT TO A NATIVE FILE
+    // -----------------------------------------------------------------
+    
+    // es.tsn -> es.5m.tsn
+    std::string level_path( const std::string& path, time_t period );
+    
+    // writes every level of pyramid beside the native file path
+    void write( const std::string& path, const Pyramid& pyramid );
+    
+    // zero-copy view on the level stored beside path
+    df::DynFrame read( const std::string& path, time_t period );
+    
+    template<typename T> df::DataFrame<T> read( const std::string& path, time_t period ){
+        df::DynFrame frame = read(path, period);
+        if( frame.column_names() != dp::dp_names<T>() )
+            throw PyramidException("Columns of "+level_path(path, period)+" do not match datapoint type.");
+        return frame.as<T>();
+    }
+    
+    
+    // -----------------------------------------------------------------
+    // INSIDE A DATASET
+    // -----------------------------------------------------------------
+    
+    std::string level_dir( const std::string& dir, time_t period );
+    
+    // periods stored in the dataset in dir, ascending
+    std::vector<time_t> levels( const std::string& dir );
+    
+    // (re)computes the levels of the dataset in dir from its base rows, one base
+    // partition at a time, replacing any stored ones; with no periods it only removes them
+    void build_levels( const std::string& dir, const std::vector<time_t>& periods = default_periods() );
+    
+    // dataset::append_columns, then brings every stored level up to date; throws
+    void append_columns( const std::string& dir, size_t rows, const time_t* index,
+                         const std::vector<const double*>& columns,
+                         const std::vector<std::string>& names, const std::string& meta,
+                         dataset::Granularity g = dataset::DAY );
+    
+    template<typename T> void append( const std::string& dir, const df::DataFrame<T>& frame,
+                                      dataset::Granularity g = dataset::DAY ){
+        std::vector<const double*> columns;
+        for( size_t j = 0; j < frame.ncols(); ++j )
+            columns.push_back( frame.column(j) );
+        append_columns( dir, frame.size(), frame.index(), columns, frame.column_names(), frame.meta(), g );
+    }
+    
+    // bars of the level with start <= t <= end; throws if the level is not stored
+    df::DynFrame load_columns( const std::string& dir, time_t period,
+                               time_t start = dataset::MIN_TIME, time_t end = dataset::MAX_TIME,
+                               unsigned threads = 0 );
+    
+    // same range convention as dataset::load
+    template<typename T> df::DataFrame<T> load( const std::string& dir, time_t period,
+                                                bpt::ptime start = bpt::ptime(),
+                                                bpt::ptime end = bpt::ptime(),
+                                                unsigned threads = 0 ){
+        const time_t from = start.is_not_a_date_time() ? dataset::MIN_TIME : utilities::bpt_to_time_t(start);
+        const time_t to = end.is_not_a_date_time() ? dataset::MAX_TIME : utilities::bpt_to_time_t(end);
+        df::DynFrame frame = load_columns( dir, period, from, to, threads );
+        if( frame.column_names() != dp::dp_names<T>() )
+            throw PyramidException("Columns of "+level_dir(dir, period)+" do not match datapoint type.");
+        return frame.as<T>();
+    }
+    
+} // namespace pyramid
+
+
+#endif
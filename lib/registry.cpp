@@ -0,0 +1,113 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * registry.cpp
+ *
+ */
+
+#include <deque>
+#include <mutex>
+
+#include "registry.hpp"
+
+using namespace registry;
+
+// EXCEPTIONS
+
+RegistryException::RegistryException(const std::string& message):_msg(_spec + message){};
+RegistryException::~RegistryException() throw(){};
+
+const char* RegistryException::what() const throw() {return _msg.c_str(); }
+const std::string RegistryException::_spec = "Strategy Registry Exception: ";
+
+
+namespace {
+    
+    // a deque keeps entries in place as it grows
+    struct Table {
+        std::mutex lock;
+        std::deque<Entry> entries;
+    };
+    
+    Table& table(){
+        static Table t;     // constructed on first use, safe during static initialization
+        return t;
+    }
+}
+
+
+void registry::add( const std::string& name, size_t nparams, const std::string& description, const Runner& run )
+{
+    Table& t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    
+    for( size_t i = 0; i < t.entries.size(); ++i )
+        if( t.entries[i].name == name )
+            throw RegistryException("Strategy "+name+" is already registered.");
+    
+    Entry e = { name, description, nparams, run };
+    t.entries.push_back(e);
+}
+
+const Entry* registry::find( const std::string& name )
+{
+    Table& t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    
+    for( size_t i = 0; i < t.entries.size(); ++i )
+        if( t.entries[i].name == name )
+            return &t.entries[i];
+    return NULL;
+}
+
+size_t registry::count()
+{
+    Table& t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    return t.entries.size();
+}
+
+const Entry* registry::at( size_t i )
+{
+    Table& t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    return i < t.entries.size() ? &t.entries[i] : NULL;
+}
+
+std::vector<sweep::Metrics> registry::run( const std::string& name, const df::DynFrame& frame,
+                                           const std::vector<sweep::Params>& grid )
+{
+    const Entry* e = find(name);
+    if( !e )
+        throw RegistryException("Unknown strategy "+name+".");
+    
+    for( size_t k = 0; k < grid.size(); ++k )
+        if( grid[k].size() != e->nparams )
+            throw RegistryException("Strategy "+name+" takes "+std::to_string(e->nparams)+" parameters.");
+    
+    return e->run(frame, grid);
+}
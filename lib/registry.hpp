@@ -0,0 +1,141 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * registry.hpp
+ *
+ * Design Overview:
+ *
+ * Process-wide table of strategies that can be run by name, for callers
+ * that cannot instantiate templates: the C interface (capi.h), job
+ * schedulers and the sweep workers. A registered strategy is a Runner
+ * that takes an untyped DynFrame and a set of parameter vectors and
+ * returns one Metrics accumulator per parameter vector.
+ *
+ * pool_runner<T,Strategy>(make) builds the usual Runner for engine
+ * strategies: it views the frame as DataFrame<T> (zero-copy when the
+ * fields of T are double columns), constructs one strategy per parameter
+ * vector with make, and feeds all of them in a single pass of the Engine.
+ * Strategy must provide metrics().
+ *
+ * Registration is explicit (add, or a static Registrar) and thread-safe;
+ * registered entries are never removed, so pointers returned by find stay
+ * valid for the life of the process.
+ *
+ */
+
+
+#ifndef backtester_registry_hpp
+#define backtester_registry_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "datapoint.hpp"
+#include "dataframe.hpp"
+#include "dynframe.hpp"
+#include "engine.hpp"
+#include "sweep.hpp"
+
+namespace df = dataframe;
+
+namespace registry {
+    
+    // EXCEPTIONS
+    
+    class RegistryException: public std::exception {
+        
+    public:
+        RegistryException(const std::string& message);
+        ~RegistryException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    typedef std::function< std::vector<sweep::Metrics>( const df::DynFrame&, const std::vector<sweep::Params>& ) > Runner;
+    
+    struct Entry {
+        std::string name;
+        std::string description;
+        size_t nparams;             // length of every parameter vector
+        Runner run;
+    };
+    
+    // throws RegistryException if name is taken
+    void add( const std::string& name, size_t nparams, const std::string& description, const Runner& run );
+    
+    const Entry* find( const std::string& name );      // NULL if unknown
+    size_t count();
+    const Entry* at( size_t i );                        // registration order; NULL if out of range
+    
+    // runs a registered strategy once per parameter vector; throws on unknown name or bad params
+    std::vector<sweep::Metrics> run( const std::string& name, const df::DynFrame& frame,
+                                     const std::vector<sweep::Params>& grid );
+    
+    
+    // registers at static initialization
+    struct Registrar {
+        Registrar( const std::string& name, size_t nparams, const std::string& description, const Runner& run ){
+            add( name, nparams, description, run );
+        }
+    };
+    
+    
+    // one pass of the engine over frame as DataFrame<T>, with one Strategy per parameter vector
+    template<typename T, typename Strategy, typename Make> Runner pool_runner( Make make ){
+        
+        return [make]( const df::DynFrame& frame, const std::vector<sweep::Params>& grid ){
+            
+            const df::DataFrame<T> data = frame.as<T>();
+            
+            std::vector<Strategy> pool;
+            pool.reserve( grid.size() );
+            for( size_t k = 0; k < grid.size(); ++k )
+                pool.push_back( make(grid[k]) );
+            
+            engine::FrameSource<T> src(data);
+            engine::Engine<T> eng;
+            eng.run(src, pool);
+            
+            std::vector<sweep::Metrics> out;
+            out.reserve( pool.size() );
+            for( size_t k = 0; k < pool.size(); ++k )
+                out.push_back( pool[k].metrics() );
+            return out;
+        };
+    }
+    
+} // namespace registry
+
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * ring.hpp
+ *
+ * Design Overview:
+ *
+ * Bounded lock-free single-producer/single-consumer queue of bar events,
+ * for handing bars from a feed-handler thread to a strategy thread in live
+ * or paper trading.
+ *
+ * The ring is a power-of-two array of (time, bar) slots with two free
+ * running indices: head, written only by the producer, and tail, written
+ * only by the consumer. Each is published with a release store and read
+ * with an acquire load, and each side keeps a private cached copy of the
+ * other side's index so that the shared cache line is only touched when
+ * the cached value says the ring is full (producer) or empty (consumer).
+ * The two indices and their caches sit on separate cache lines.
+ *
+ * The consumer reads slots in place: peek() returns the longest
+ * contiguous run of ready events and release() hands the slots back, so
+ * a batch costs one acquire and one release regardless of its length.
+ * RingSource wraps this as an engine source (see engine.hpp); it blocks,
+ * spinning briefly and then yielding, until bars arrive, and ends once
+ * the producer has called close() and the ring is drained.
+ *
+ * T must be copy assignable; slots are initialized once with zero bars.
+ *
+ */
+
+
+#ifndef backtester_ring_hpp
+#define backtester_ring_hpp
+
+//STL
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <ctime>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "datapoint.hpp"
+#include "utilities.hpp"
+
+namespace dp = datapoint;
+
+namespace ring {
+    
+    const size_t CACHE_LINE = 64;
+    
+    // backoff for a waiting thread: a short spin, then yield the core
+    inline void relax( unsigned& spins ){
+        if( ++spins < 64 ){
+#ifdef __SSE2__
+            _mm_pause();
+#endif
+        }
+        else
+            std::this_thread::yield();
+    }
+    
+    
+    template<typename T> class Ring: private utilities::Uncopyable {
+        
+        BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
+        
+    public:
+        
+        struct Event {
+            time_t t;
+            T bar;
+        };
+        
+        // capacity is rounded up to a power of two
+        explicit Ring( size_t capacity )
+        :   _head(0), _tail_cache(0),
+            _tail(0), _head_cache(0),
+            _closed(false),
+            _slots(), _mask(0)
+        {
+            size_t n = 2;
+            while( n < capacity )
+                n <<= 1;
+            static const double zeros[dp::field_count<T>::value] = {};
+            const Event zero = { 0, dp::dp_make<T>(zeros) };
+            _slots.assign( n, zero );
+            _mask = n - 1;
+        }
+        
+        size_t capacity() const { return _slots.size(); }
+        
+        // events ready to read; exact only when called from either end's thread
+        size_t size() const {
+            return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+        }
+        
+        
+        // PRODUCER
+        
+        // false if the ring is full
+        bool push( time_t t, const T& bar ){
+            const size_t head = _head.load(std::memory_order_relaxed);
+            if( head - _tail_cache == _slots.size() ){
+                _tail_cache = _tail.load(std::memory_order_acquire);
+                if( head - _tail_cache == _slots.size() )
+                    return false;
+            }
+            Event& e = _slots[head & _mask];
+            e.t = t;
+            e.bar = bar;
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+        
+        // waits while the ring is full
+        void push_wait( time_t t, const T& bar ){
+            unsigned spins = 0;
+            while( !push(t, bar) )
+                relax(spins);
+        }
+        
+        // pushes as many of n events as fit, published at once; returns the number pushed
+        size_t push_batch( const Event* events, size_t n ){
+            const size_t head = _head.load(std::memory_order_relaxed);
+            if( _slots.size() - (head - _tail_cache) < n )
+                _tail_cache = _tail.load(std::memory_order_acquire);
+            const size_t k = std::min( n, _slots.size() - (head - _tail_cache) );
+            for( size_t i = 0; i < k; ++i )
+                _slots[(head + i) & _mask] = events[i];
+            if( k )
+                _head.store(head + k, std::memory_order_release);
+            return k;
+        }
+        
+        // no more pushes; the consumer ends after draining the ring
+        void close(){
+            _closed.store(true, std::memory_order_release);
+        }
+        
+        
+        // CONSUMER
+        
+        // longest contiguous run of at most max ready events, read in place until release()
+        size_t peek( const Event*& first, size_t max = size_t(-1) ){
+            const size_t tail = _tail.load(std::memory_order_relaxed);
+            if( _head_cache == tail )
+                _head_cache = _head.load(std::memory_order_acquire);
+            const size_t ready = _head_cache - tail;
+            const size_t run = std::min( std::min(ready, max), _slots.size() - (tail & _mask) );
+            first = &_slots[tail & _mask];
+            return run;
+        }
+        
+        // returns the first n peeked slots to the producer
+        void release( size_t n ){
+            if( n )
+                _tail.store(_tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+        }
+        
+        // copies up to max events into out; returns the number popped
+        size_t pop_batch( Event* out, size_t max ){
+            size_t n = 0;
+            const Event* run;
+            for( size_t k; n < max && ( k = peek(run, max - n) ) > 0; n += k ){
+                std::copy( run, run + k, out + n );
+                release(k);
+            }
+            return n;
+        }
+        
+        bool pop( time_t& t, T& bar ){
+            const Event* e;
+            if( !peek(e, 1) )
+                return false;
+            t = e->t;
+            bar = e->bar;
+            release(1);
+            return true;
+        }
+        
+        // true once close() was called and every event has been read
+        bool finished(){
+            if( !_closed.load(std::memory_order_acquire) )
+                return false;
+            _head_cache = _head.load(std::memory_order_acquire);
+            return _head_cache == _tail.load(std::memory_order_relaxed);
+        }
+        
+    private:
+        
+        // producer line
+        alignas(CACHE_LINE) std::atomic<size_t> _head;     // next slot to write
+        size_t _tail_cache;                                 // producer's copy of _tail
+        
+        // consumer line
+        alignas(CACHE_LINE) std::atomic<size_t> _tail;     // next slot to read
+        size_t _head_cache;                                 // consumer's copy of _head
+        
+        alignas(CACHE_LINE) std::atomic<bool> _closed;
+        std::vector<Event> _slots;
+        size_t _mask;
+    };
+    
+    
+    // engine source reading a ring in batches; bars are passed by reference into the slots
+    template<typename T> class RingSource {
+        
+    public:
+        
+        explicit RingSource( Ring<T>& ring, size_t batch = 256 )
+        :   _ring(ring), _batch(batch), _run(NULL), _n(0), _pos(0)
+        {};
+        
+        ~RingSource(){
+            _ring.release(_pos);
+        }
+        
+        // blocks until a bar is ready; false once the ring is closed and drained
+        bool next( time_t& t, const T*& bar ){
+            if( _pos == _n ){
+                _ring.release(_n);
+                _pos = _n = 0;
+                unsigned spins = 0;
+                while( ( _n = _ring.peek(_run, _batch) ) == 0 ){
+                    if( _ring.finished() )
+                        return false;
+                    relax(spins);
+                }
+            }
+            const typename Ring<T>::Event& e = _run[_pos++];
+            t = e.t;
+            bar = &e.bar;
+            return true;
+        }
+        
+    private:
+        Ring<T>& _ring;
+        size_t _batch;
+        const typename Ring<T>::Event* _run;
+        size_t _n, _pos;        // current run and read position in it
+    };
+    
+} // namespace ring
+
+
+#endif
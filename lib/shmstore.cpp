@@ -0,0 +1,320 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+#include "shmstore.hpp"
+
+using namespace shmstore;
+
+// STATICS
+
+const std::string ShmStoreException::base_msg = "Shared Memory Store Exception: ";
+
+const std::map<int,std::string> ShmStoreException::messages {
+    {0, "Unknown shared memory store exception."},
+    {1, "Could not create or map shared memory segment."},
+    {2, "Dataset not found in shared memory."},
+    {3, "Dataset version already published."},
+    {4, "Datapoint type does not match shared dataset."},
+    {5, "Timed out waiting for dataset to be loaded."},
+    {6, "Publishing process failed to load dataset."}};
+
+ShmStoreException::ShmStoreException(unsigned short code)
+:   _msg( base_msg + ( messages.count(code) ? messages.at(code) : messages.at(0) ) )
+{};
+
+namespace {
+    
+    const uint64_t MAGIC = 0x314d485342445354ull;     // "TSDBSHM1" little endian
+    const uint32_t FORMAT = 2;
+    
+    size_t header_bytes(){
+        static const size_t page = static_cast<size_t>( sysconf(_SC_PAGESIZE) );
+        return ( sizeof(SegmentHeader) + page - 1 ) / page * page;
+    }
+    
+    // unmaps a segment and drops its reference; last reader unlinks unless persistent
+    void release( Segment* s ){
+        
+        if( s->header ){
+            if( s->header->refcount.fetch_sub(1) == 1 && !s->header->persist ){
+                int32_t zero = 0;
+                if( s->header->refcount.compare_exchange_strong(zero, -1) )
+                    shm_unlink( s->name.c_str() );
+            }
+            if( s->data )
+                munmap( const_cast<char*>(s->data), s->data_bytes );
+            munmap( s->header, header_bytes() );
+        }
+        delete s;
+    }
+    
+    // takes a reference unless the segment has already been torn down
+    bool acquire( SegmentHeader* h ){
+        int32_t n = h->refcount.load();
+        while( n >= 0 )
+            if( h->refcount.compare_exchange_weak(n, n+1) )
+                return true;
+        return false;
+    }
+}
+
+
+uint64_t shmstore::type_hash( const std::vector<std::string>& names )
+{
+    uint64_t h = 14695981039346656037ull;   // FNV-1a
+    for( size_t i = 0; i < names.size(); ++i ){
+        for( size_t j = 0; j < names[i].size(); ++j ){
+            h ^= static_cast<unsigned char>(names[i][j]);
+            h *= 1099511628211ull;
+        }
+        h ^= ',';
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+// REGISTRY
+
+void Registry::remove( const std::string& name, uint64_t version )
+{
+    shm_unlink( segment_name(name, version).c_str() );
+}
+
+
+bool Registry::_create( const std::string& seg )
+{
+    int fd = shm_open( seg.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 );
+    if( fd < 0 ){
+        if( errno == EEXIST )
+            return false;
+        throw ShmStoreException(1);
+    }
+    
+    // size the header right away and sign it, so waiters can tell if we die while loading
+    void* p = MAP_FAILED;
+    if( ftruncate(fd, static_cast<off_t>(header_bytes())) == 0 )
+        p = mmap( NULL, header_bytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close(fd);
+    if( p == MAP_FAILED ){
+        shm_unlink( seg.c_str() );
+        throw ShmStoreException(1);
+    }
+    static_cast<SegmentHeader*>(p)->loader.store( static_cast<int32_t>(getpid()) );
+    munmap(p, header_bytes());
+    return true;
+}
+
+
+bool Registry::_reclaim( SegmentHeader* h )
+{
+    int32_t pid = h->loader.load();
+    if( pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH )
+        return false;
+    
+    // only one of the waiters takes over
+    return h->loader.compare_exchange_strong( pid, static_cast<int32_t>(getpid()) );
+}
+
+
+void Registry::_abandon( const std::string& seg )
+{
+    int fd = shm_open( seg.c_str(), O_RDWR, 0 );
+    if( fd >= 0 ){
+        struct stat st;
+        if( fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= header_bytes() ){
+            void* p = mmap( NULL, header_bytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+            if( p != MAP_FAILED ){
+                static_cast<SegmentHeader*>(p)->state.store(FAILED);
+                munmap(p, header_bytes());
+            }
+        }
+        close(fd);
+    }
+    shm_unlink( seg.c_str() );
+}
+
+
+std::shared_ptr<Segment> Registry::_try_attach( const std::string& seg, uint64_t hash, bool create )
+{
+    const std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(_timeout);
+    
+    while( true ){
+        
+        int fd = shm_open( seg.c_str(), O_RDWR, 0 );
+        
+        if( fd < 0 ){
+            if( errno != ENOENT )
+                throw ShmStoreException(1);
+            if( !create )
+                return std::shared_ptr<Segment>();
+            if( _create(seg) )
+                return std::shared_ptr<Segment>();  // caller loads and publishes
+            continue;                               // lost the race, open the winner's segment
+        }
+        
+        // wait for the publisher to size the segment and mark it ready
+        struct stat st;
+        SegmentHeader* h = NULL;
+        
+        while( true ){
+            
+            if( fstat(fd, &st) != 0 ){
+                close(fd);
+                throw ShmStoreException(1);
+            }
+            
+            if( !h && static_cast<size_t>(st.st_size) >= header_bytes() ){
+                void* p = mmap( NULL, header_bytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+                if( p == MAP_FAILED ){
+                    close(fd);
+                    throw ShmStoreException(1);
+                }
+                h = static_cast<SegmentHeader*>(p);
+            }
+            
+            if( h && h->state.load() != LOADING )
+                break;
+            
+            // the loader died before publishing
+            if( h && _reclaim(h) ){
+                munmap(h, header_bytes());
+                close(fd);
+                if( create )
+                    return std::shared_ptr<Segment>();  // caller loads and publishes into it
+                _abandon(seg);
+                return std::shared_ptr<Segment>();
+            }
+            
+            if( std::chrono::steady_clock::now() > deadline ){
+                if( h )
+                    munmap(h, header_bytes());
+                close(fd);
+                throw ShmStoreException(5);
+            }
+            std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+        }
+        
+        const bool failed = ( h->state.load() == FAILED );
+        
+        if( failed || !acquire(h) ){   // publisher failed or segment torn down, retry
+            munmap(h, header_bytes());
+            close(fd);
+            if( failed && !create )
+                throw ShmStoreException(6);
+            continue;
+        }
+        
+        std::shared_ptr<Segment> s( new Segment(), release );
+        s->name = seg;
+        s->header = h;
+        s->data = NULL;
+        s->data_bytes = static_cast<size_t>(st.st_size) - header_bytes();
+        
+        if( h->magic != MAGIC || h->format != FORMAT || h->type_hash != hash ){
+            close(fd);
+            throw ShmStoreException(4);
+        }
+        
+        if( s->data_bytes ){
+            void* p = mmap( NULL, s->data_bytes, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(header_bytes()) );
+            if( p == MAP_FAILED ){
+                close(fd);
+                throw ShmStoreException(1);
+            }
+            s->data = static_cast<const char*>(p);
+            df::advise_hugepages(p, s->data_bytes);
+        }
+        
+        close(fd);
+        return s;
+    }
+}
+
+
+std::shared_ptr<Segment> Registry::_publish( const std::string& seg, size_t bytes, uint64_t version,
+                                             size_t rows, size_t ncols, size_t stride, uint64_t hash,
+                                             const std::string& meta, bool persist,
+                                             std::function<void(char*)> writer )
+{
+    int fd = shm_open( seg.c_str(), O_RDWR, 0 );
+    if( fd < 0 )
+        throw ShmStoreException(1);
+    
+    if( ftruncate(fd, static_cast<off_t>(header_bytes() + bytes)) != 0 ){
+        close(fd);
+        throw ShmStoreException(1);
+    }
+    
+    void* hp = mmap( NULL, header_bytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    void* dp = bytes ? mmap( NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, static_cast<off_t>(header_bytes()) ) : NULL;
+    close(fd);
+    
+    if( hp == MAP_FAILED || dp == MAP_FAILED ){
+        if( hp != MAP_FAILED ) munmap(hp, header_bytes());
+        if( dp && dp != MAP_FAILED ) munmap(dp, bytes);
+        throw ShmStoreException(1);
+    }
+    
+    std::shared_ptr<Segment> s( new Segment(), release );
+    s->name = seg;
+    s->header = static_cast<SegmentHeader*>(hp);
+    s->data = static_cast<const char*>(dp);
+    s->data_bytes = bytes;
+    
+    SegmentHeader* h = s->header;
+    h->magic = MAGIC;
+    h->format = FORMAT;
+    h->ncols = static_cast<uint32_t>(ncols);
+    h->version = version;
+    h->rows = rows;
+    h->stride = stride;
+    h->type_hash = hash;
+    h->persist = persist;
+    std::strncpy( h->meta, meta.c_str(), sizeof(h->meta)-1 );
+    h->refcount.store(1);
+    
+    if( dp ){
+        df::advise_hugepages(dp, bytes);
+        writer( static_cast<char*>(dp) );
+        mprotect( dp, bytes, PROT_READ );   // publisher sees the same read-only view as everyone else
+    }
+    
+    h->state.store(READY);  // release: payload is visible before the ready flag
+    return s;
+}
@@ -0,0 +1,241 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * shmstore.hpp
+ *
+ * Design Overview:
+ *
+ * Shared-memory dataset registry for running many backtest processes on
+ * one host off a single copy of the data. The first process to ask for a
+ * dataset loads it and publishes it into a named POSIX shared memory
+ * segment; every other process maps the same segment read-only and gets
+ * a DataFrame<T> view on it without copying.
+ *
+ * Segments are named "/<prefix>.<name>.v<version>", so a new version of a
+ * dataset can be published while readers of the old one are still
+ * running. The first page of a segment holds a header with a reference
+ * count of attached DataFrames; the segment is unlinked when the last one
+ * goes away (unless published with persist = true).
+ *
+ * Notes:
+ *
+ * Requires linking librt on older glibc. A process that dies without
+ * releasing its DataFrames leaves its references behind; use
+ * Registry::remove to clean up stale segments. A segment whose loader
+ * died before publishing is reclaimed by the next process waiting on it,
+ * which loads the dataset itself (get_or_load) or unlinks the segment
+ * (attach).
+ *
+ */
+
+
+#ifndef backtester_shmstore_hpp
+#define backtester_shmstore_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+#include "datapoint.hpp"
+#include "dataframe.hpp"
+#include "utilities.hpp"
+
+namespace dp = datapoint;
+namespace df = dataframe;
+
+namespace shmstore {
+    
+    // EXCEPTIONS
+    
+    class ShmStoreException: public std::exception {
+        
+    public:
+        ShmStoreException(unsigned short code);
+        ~ShmStoreException() throw(){};
+        
+        virtual const char* what() const throw() {
+            return _msg.c_str();
+        }
+        
+    private:
+        std::string _msg;
+        static const std::string base_msg;
+        static const std::map<int,std::string> messages;
+    };
+    
+    
+    // SEGMENT LAYOUT
+    
+    enum SegmentState { LOADING = 0, READY = 1, FAILED = 2 };
+    
+    struct SegmentHeader {              // first page of every segment, mapped read-write
+        uint64_t magic;
+        uint32_t format;                // header layout version
+        uint32_t ncols;
+        uint64_t version;               // dataset version chosen by the publisher
+        uint64_t rows;
+        uint64_t stride;                // elements per column incl. padding
+        uint64_t type_hash;             // hash of the datapoint column names
+        std::atomic<uint32_t> state;    // SegmentState
+        std::atomic<int32_t> refcount;  // attached views; -1 once unlinked
+        uint32_t persist;
+        std::atomic<int32_t> loader;    // pid of the process filling the segment
+        char meta[128];
+    };
+    
+    // a mapped segment; released (unmapped and possibly unlinked) by its holder
+    struct Segment {
+        std::string name;
+        SegmentHeader* header;
+        const char* data;               // read-only payload mapping
+        size_t data_bytes;
+    };
+    
+    uint64_t type_hash( const std::vector<std::string>& names );
+    
+    
+    // -----------------------------------------------------------------
+    // REGISTRY
+    // -----------------------------------------------------------------
+    
+    class Registry: private utilities::Uncopyable {
+        
+    public:
+        
+        explicit Registry( const std::string& prefix = "tsdb", unsigned timeout_sec = 600 )
+        :   _prefix(prefix),
+            _timeout(timeout_sec)
+        {};
+        
+        // returns the shared dataset, running loader if no process has published it yet;
+        // blocks while another process is loading (throws after timeout)
+        template<typename T> df::DataFrame<T> get_or_load( const std::string& name, uint64_t version,
+                                                           std::function< df::DataFrame<T>() > loader )
+        {
+            const std::string seg = segment_name(name, version);
+            const uint64_t hash = type_hash( dp::dp_names<T>() );
+            
+            std::shared_ptr<Segment> s = _try_attach(seg, hash, true);
+            if( s )
+                return _view<T>(s);
+            
+            // we created the (empty) segment and are responsible for filling it
+            try {
+                return _fill<T>( seg, version, loader(), false );
+            }
+            catch( ... ){
+                _abandon(seg);
+                throw;
+            }
+        }
+        
+        // attaches to an already published dataset; throws if absent
+        template<typename T> df::DataFrame<T> attach( const std::string& name, uint64_t version )
+        {
+            std::shared_ptr<Segment> s = _try_attach( segment_name(name, version), type_hash( dp::dp_names<T>() ), false );
+            if( !s )
+                throw ShmStoreException(2);
+            return _view<T>(s);
+        }
+        
+        // publishes frame under name/version; with persist the segment outlives its last reader
+        template<typename T> df::DataFrame<T> publish( const std::string& name, uint64_t version,
+                                                       const df::DataFrame<T>& frame, bool persist = false )
+        {
+            const std::string seg = segment_name(name, version);
+            if( !_create(seg) )
+                throw ShmStoreException(3);
+            try {
+                return _fill<T>( seg, version, frame, persist );
+            }
+            catch( ... ){
+                _abandon(seg);
+                throw;
+            }
+        }
+        
+        // unlinks a segment regardless of references; mapped views stay valid
+        void remove( const std::string& name, uint64_t version );
+        
+        std::string segment_name( const std::string& name, uint64_t version ) const {
+            return "/" + _prefix + "." + name + ".v" + std::to_string(version);
+        }
+        
+    private:
+        
+        template<typename T> df::DataFrame<T> _fill( const std::string& seg, uint64_t version,
+                                                     const df::DataFrame<T>& frame, bool persist )
+        {
+            const size_t rows = frame.size(), ncols = frame.ncols();
+            const size_t stride = df::padded_stride(rows);
+            
+            std::shared_ptr<Segment> s = _publish( seg, df::block_size(rows, ncols), version, rows, ncols,
+                                                   stride, type_hash( frame.column_names() ), frame.meta(), persist,
+                [&]( char* dst ){
+                    time_t* idx = reinterpret_cast<time_t*>(dst);
+                    double* cols = reinterpret_cast<double*>(idx + stride);
+                    std::copy( frame.index(), frame.index() + rows, idx );
+                    for( size_t j = 0; j < ncols; ++j )
+                        std::copy( frame.column(j), frame.column(j) + rows, cols + j*stride );
+                });
+            return _view<T>(s);
+        }
+        
+        template<typename T> df::DataFrame<T> _view( std::shared_ptr<Segment> s )
+        {
+            const size_t stride = s->header->stride;
+            const time_t* idx = reinterpret_cast<const time_t*>(s->data);
+            const double* cols = reinterpret_cast<const double*>(idx + stride);
+            
+            std::vector<const double*> columns;
+            for( size_t j = 0; j < s->header->ncols; ++j )
+                columns.push_back( cols + j*stride );
+            
+            return df::DataFrame<T>::adopt( s->header->rows, s, idx, columns, std::string(s->header->meta) );
+        }
+        
+        bool _create( const std::string& seg );                                         // O_EXCL create, false if exists
+        bool _reclaim( SegmentHeader* h );                                              // takes over from a dead loader
+        void _abandon( const std::string& seg );                                        // mark failed and unlink
+        std::shared_ptr<Segment> _try_attach( const std::string& seg, uint64_t hash, bool create );
+        std::shared_ptr<Segment> _publish( const std::string& seg, size_t bytes, uint64_t version,
+                                           size_t rows, size_t ncols, size_t stride, uint64_t hash,
+                                           const std::string& meta, bool persist,
+                                           std::function<void(char*)> writer );
+        
+        const std::string _prefix;
+        const unsigned _timeout;
+    };
+    
+} // namespace shmstore
+
+
+#endif
@@ -0,0 +1,434 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "sweep.hpp"
+#include "numa.hpp"
+#include "macros.hpp"
+
+using namespace sweep;
+
+// EXCEPTIONS
+
+SweepException::SweepException(const std::string& message):_msg(_spec + message){};
+SweepException::~SweepException() throw(){};
+
+const char* SweepException::what() const throw() {return _msg.c_str(); }
+const std::string SweepException::_spec = "Sweep Exception: ";
+
+
+// WIRE PROTOCOL
+
+namespace {
+    
+    enum MessageType { HELLO = 1, LEASE, RESULT, HEARTBEAT, LEASE_DONE, STOP };
+    
+    struct FrameHeader {
+        uint32_t type;
+        uint32_t length;        // payload bytes following the header
+    };
+    
+    struct LeaseMsg {
+        uint64_t lease;
+        uint64_t begin, end;    // grid points [begin, end)
+    };
+    
+    struct ResultMsg {
+        uint64_t lease;
+        uint64_t point;
+        Metrics metrics;
+    };
+    
+    typedef std::chrono::steady_clock Clock;
+    
+    bool send_frame( int fd, uint32_t type, const void* payload, uint32_t length ){
+        
+        char buf[sizeof(FrameHeader) + sizeof(ResultMsg)];
+        FrameHeader h = { type, length };
+        std::memcpy(buf, &h, sizeof(h));
+        if( length )
+            std::memcpy(buf + sizeof(h), payload, length);
+        
+        const char* p = buf;
+        size_t left = sizeof(h) + length;
+        while( left ){
+            ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+            if( n < 0 && errno == EINTR )
+                continue;
+            if( n <= 0 )
+                return false;
+            p += n; left -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+    
+    bool read_full( int fd, void* dst, size_t len ){
+        char* p = static_cast<char*>(dst);
+        while( len ){
+            ssize_t n = read(fd, p, len);
+            if( n < 0 && errno == EINTR )
+                continue;
+            if( n <= 0 )
+                return false;
+            p += n; len -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+    
+    sockaddr_un make_address( const std::string& path ){
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if( path.size() >= sizeof(addr.sun_path) )
+            throw SweepException("Socket path too long.");
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+        return addr;
+    }
+    
+    
+    // COORDINATOR STATE
+    
+    struct Lease {
+        size_t begin, end;
+        unsigned retries;
+        bool done;
+        bool assigned;
+    };
+    
+    struct Connection {
+        int fd;
+        pid_t pid;
+        long lease;                 // assigned lease or -1
+        uint64_t lease_start;       // profiler ticks when the lease was sent
+        std::string buffer;         // unparsed bytes
+        Clock::time_point last_seen;
+        bool dead;
+    };
+}
+
+
+// WORKER
+
+int sweep::run_worker( const std::string& socket_path, const Grid& grid, Job job, unsigned heartbeat_ms )
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = make_address(socket_path);
+    
+    if( fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 )
+        return 2;
+    
+    std::mutex send_mutex;
+    std::atomic<bool> stop(false);
+    
+    int32_t pid = static_cast<int32_t>(getpid());
+    if( !send_frame(fd, HELLO, &pid, sizeof(pid)) )
+        return 2;
+    
+    std::thread heartbeat( [&](){
+        while( !stop.load() ){
+            std::this_thread::sleep_for( std::chrono::milliseconds(heartbeat_ms) );
+            std::lock_guard<std::mutex> lock(send_mutex);
+            if( !stop.load() && !send_frame(fd, HEARTBEAT, NULL, 0) )
+                break;
+        }
+    });
+    
+    int status = 0;
+    FrameHeader h;
+    
+    while( read_full(fd, &h, sizeof(h)) ){
+        
+        if( h.type == STOP )
+            break;
+        
+        LeaseMsg lease;
+        if( h.type != LEASE || h.length != sizeof(lease) || !read_full(fd, &lease, sizeof(lease)) ){
+            status = 3;
+            break;
+        }
+        
+        for( uint64_t i = lease.begin; i < lease.end; ++i ){
+            ResultMsg r;
+            r.lease = lease.lease;
+            r.point = i;
+            r.metrics = job( grid.at(static_cast<size_t>(i)) );  // exceptions terminate the worker, lease is retried
+            std::lock_guard<std::mutex> lock(send_mutex);
+            send_frame(fd, RESULT, &r, sizeof(r));
+        }
+        
+        std::lock_guard<std::mutex> lock(send_mutex);
+        send_frame(fd, LEASE_DONE, &lease.lease, sizeof(lease.lease));
+    }
+    
+    stop.store(true);
+    heartbeat.join();
+    close(fd);
+    return status;
+}
+
+
+// COORDINATOR
+
+std::vector<Metrics> Coordinator::run()
+{
+    PROFILE_SCOPE("sweep.run");
+    
+    const size_t npoints = _grid.size();
+    std::vector<Metrics> results(npoints);
+    std::vector<char> have(npoints, 0);
+    _total = Metrics();
+    
+    if( !npoints )
+        return results;
+    
+    const unsigned nworkers = _opts.workers ? _opts.workers : std::max(1u, std::thread::hardware_concurrency());
+    const size_t lease_size = _opts.lease_size ? _opts.lease_size : std::max<size_t>(1, npoints / (nworkers * 8));
+    const std::string path = _opts.socket_path.empty()
+        ? "/tmp/tsdb-sweep-" + std::to_string(getpid()) + ".sock" : _opts.socket_path;
+    
+    std::vector<Lease> leases;
+    std::deque<size_t> pending;
+    for( size_t b = 0; b < npoints; b += lease_size ){
+        Lease l = { b, std::min(npoints, b + lease_size), 0, false, false };
+        pending.push_back( leases.size() );
+        leases.push_back(l);
+    }
+    
+    // listen before forking so workers can connect right away
+    unlink( path.c_str() );
+    sockaddr_un addr = make_address(path);
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( lfd < 0 || bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(lfd, 64) != 0 ){
+        if( lfd >= 0 ) close(lfd);
+        throw SweepException("Could not listen on "+path+".");
+    }
+    
+    // no more workers than leases, the rest would only wait to be stopped
+    const unsigned pool = static_cast<unsigned>( std::min<size_t>(nworkers, leases.size()) );
+    
+    std::vector<Connection> conns;
+    std::vector<pid_t> children;
+    unsigned spawned = 0;
+    const unsigned max_spawns = pool + static_cast<unsigned>(leases.size()) * (_opts.max_retries + 1);
+    
+    auto spawn = [&](){
+        pid_t pid = fork();
+        if( pid == 0 ){
+            close(lfd);
+            for( size_t i = 0; i < conns.size(); ++i )
+                close(conns[i].fd);
+            if( _opts.numa_pin )
+                numa::pin_thread_to_node( numa::online_nodes()[spawned % numa::node_count()] );
+            _exit( run_worker(path, _grid, _job, _opts.heartbeat_ms) );
+        }
+        if( pid > 0 ){
+            children.push_back(pid);
+            ++spawned;
+        }
+    };
+    
+    auto shutdown = [&](){
+        // closing the listener resets connections still in its backlog and fails
+        // later connects, so workers never accepted exit as well
+        close(lfd);
+        unlink( path.c_str() );
+        for( size_t i = 0; i < conns.size(); ++i ){
+            send_frame(conns[i].fd, STOP, NULL, 0);
+            close(conns[i].fd);
+        }
+        for( size_t i = 0; i < children.size(); ++i )
+            waitpid(children[i], NULL, 0);
+    };
+    
+    // returns a lost lease to the queue, false once it has used up its retries
+    auto requeue = [&]( long id ){
+        if( id < 0 || leases[id].done )
+            return true;
+        leases[id].assigned = false;
+        if( ++leases[id].retries > _opts.max_retries )
+            return false;
+        pending.push_front( static_cast<size_t>(id) );
+        return true;
+    };
+    
+    for( unsigned i = 0; i < pool; ++i )
+        spawn();
+    
+    size_t done = 0;
+    std::string failure;
+    
+    while( done < leases.size() && failure.empty() ){
+        
+        // hand out work to idle workers
+        for( size_t i = 0; i < conns.size() && !pending.empty(); ++i ){
+            if( conns[i].dead || conns[i].lease >= 0 || conns[i].pid == 0 )
+                continue;
+            const size_t id = pending.front();
+            pending.pop_front();
+            LeaseMsg m = { id, leases[id].begin, leases[id].end };
+            if( send_frame(conns[i].fd, LEASE, &m, sizeof(m)) ){
+                conns[i].lease = static_cast<long>(id);
+                conns[i].lease_start = PROFILE_TICKS();
+                leases[id].assigned = true;
+            }
+            else {
+                pending.push_front(id);
+                conns[i].dead = true;
+            }
+        }
+        
+        std::vector<pollfd> fds(1);
+        fds[0].fd = lfd;
+        fds[0].events = POLLIN;
+        for( size_t i = 0; i < conns.size(); ++i ){
+            pollfd p = { conns[i].fd, POLLIN, 0 };
+            fds.push_back(p);
+        }
+        
+        if( poll(&fds[0], fds.size(), static_cast<int>(_opts.heartbeat_ms)) < 0 && errno != EINTR )
+            failure = "poll failed.";
+        
+        const Clock::time_point now = Clock::now();
+        
+        if( fds[0].revents & POLLIN ){
+            int cfd = accept(lfd, NULL, NULL);
+            if( cfd >= 0 ){
+                Connection c;
+                c.fd = cfd; c.pid = 0; c.lease = -1; c.lease_start = 0; c.last_seen = now; c.dead = false;
+                conns.push_back(c);
+            }
+        }
+        
+        for( size_t i = 1; i < fds.size(); ++i ){
+            
+            Connection& c = conns[i-1];
+            
+            if( fds[i].revents & (POLLIN | POLLHUP | POLLERR) ){
+                char buf[4096];
+                ssize_t n = read(c.fd, buf, sizeof(buf));
+                if( n <= 0 ){
+                    c.dead = true;
+                    continue;
+                }
+                c.buffer.append(buf, static_cast<size_t>(n));
+                c.last_seen = now;
+            }
+            
+            // parse complete frames
+            while( c.buffer.size() >= sizeof(FrameHeader) ){
+                
+                FrameHeader h;
+                std::memcpy(&h, c.buffer.data(), sizeof(h));
+                if( c.buffer.size() < sizeof(h) + h.length )
+                    break;
+                const char* payload = c.buffer.data() + sizeof(h);
+                
+                if( h.type == HELLO && h.length == sizeof(int32_t) ){
+                    int32_t pid;
+                    std::memcpy(&pid, payload, sizeof(pid));
+                    c.pid = pid;
+                }
+                else if( h.type == RESULT && h.length == sizeof(ResultMsg) ){
+                    ResultMsg r;
+                    std::memcpy(&r, payload, sizeof(r));
+                    if( r.point < npoints && !have[r.point] ){  // duplicates from retried leases are dropped
+                        results[r.point] = r.metrics;
+                        have[r.point] = 1;
+                    }
+                }
+                else if( h.type == LEASE_DONE && h.length == sizeof(uint64_t) ){
+                    uint64_t id;
+                    std::memcpy(&id, payload, sizeof(id));
+                    if( id < leases.size() && !leases[id].done ){
+                        leases[id].done = true;
+                        ++done;
+                    }
+                    PROFILE_SPAN("sweep.lease", c.lease_start, static_cast<uint32_t>(c.pid), static_cast<int64_t>(id));
+                    c.lease = -1;
+                }
+                c.buffer.erase(0, sizeof(h) + h.length);
+            }
+            
+            if( now - c.last_seen > std::chrono::milliseconds(_opts.timeout_ms) ){
+                if( c.pid > 0 )
+                    kill(c.pid, SIGKILL);
+                c.dead = true;
+            }
+        }
+        
+        // drop dead workers and retry their leases
+        for( size_t i = 0; i < conns.size(); ){
+            if( !conns[i].dead ){
+                ++i;
+                continue;
+            }
+            if( conns[i].lease >= 0 )
+                PROFILE_SPAN("sweep.lost", conns[i].lease_start, static_cast<uint32_t>(conns[i].pid), conns[i].lease);
+            if( !requeue(conns[i].lease) )
+                failure = "lease exceeded retry limit.";
+            close(conns[i].fd);
+            conns.erase(conns.begin() + i);
+        }
+        
+        // reap exited workers, only our own, and keep the pool at strength
+        for( size_t i = 0; i < children.size(); ){
+            if( waitpid(children[i], NULL, WNOHANG) == children[i] )
+                children.erase( children.begin() + i );
+            else
+                ++i;
+        }
+        
+        while( children.size() < pool && done + children.size() < leases.size() && spawned < max_spawns )
+            spawn();
+        
+        if( children.empty() && done < leases.size() && spawned >= max_spawns )
+            failure = "workers keep failing.";
+    }
+    
+    shutdown();
+    
+    if( !failure.empty() )
+        throw SweepException(failure);
+    
+    for( size_t i = 0; i < npoints; ++i )
+        _total.merge(results[i]);
+    
+    return results;
+}
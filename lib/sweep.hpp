@@ -0,0 +1,261 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * sweep.hpp
+ *
+ * Design Overview:
+ *
+ * Parameter sweeps over a cartesian Grid of strategy parameters, run by a
+ * Coordinator that farms out work to separate worker processes. Keeping
+ * each job in its own process isolates crashes and lets a sweep use more
+ * memory than a single process could.
+ *
+ * The coordinator splits the grid into leases (contiguous ranges of grid
+ * points) and hands them to workers over a Unix domain socket. Workers
+ * stream back one Metrics accumulator per grid point and send heartbeats
+ * while they work. A lease whose worker dies or goes silent is put back
+ * on the queue and retried, up to a limit; dead workers are replaced.
+ *
+ * Messages are length-prefixed binary frames on a stream socket, so the
+ * same protocol can run over TCP later. Payloads are sent in host byte
+ * order.
+ *
+ */
+
+
+#ifndef backtester_sweep_hpp
+#define backtester_sweep_hpp
+
+//STL
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <stdint.h>
+
+#include "utilities.hpp"
+
+namespace sweep {
+    
+    // EXCEPTIONS
+    
+    class SweepException: public std::exception {
+        
+    public:
+        SweepException(const std::string& message);
+        ~SweepException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    // METRICS ACCUMULATOR
+    // mergeable summary of a stream of per-period or per-trade returns
+    
+    struct Metrics {
+        
+        Metrics()
+        :   count(0), wins(0), sum(0), sumsq(0),
+            min(std::numeric_limits<double>::infinity()),
+            max(-std::numeric_limits<double>::infinity())
+        {};
+        
+        void add( double r ){
+            ++count;
+            wins += ( r > 0 );
+            sum += r;
+            sumsq += r*r;
+            min = std::min(min, r);
+            max = std::max(max, r);
+        }
+        
+        Metrics& merge( const Metrics& m ){
+            count += m.count;
+            wins += m.wins;
+            sum += m.sum;
+            sumsq += m.sumsq;
+            min = std::min(min, m.min);
+            max = std::max(max, m.max);
+            return *this;
+        }
+        
+        double mean() const {
+            return count ? sum / count : 0.0;
+        }
+        
+        double stdev() const {
+            return count > 1 ? std::sqrt( std::max(0.0, (sumsq - sum*sum/count) / (count-1)) ) : 0.0;
+        }
+        
+        double sharpe() const { // per period, not annualized
+            const double s = stdev();
+            return s > 0 ? mean() / s : 0.0;
+        }
+        
+        double hit_rate() const {
+            return count ? static_cast<double>(wins) / count : 0.0;
+        }
+        
+        uint64_t count;
+        uint64_t wins;
+        double sum, sumsq, min, max;
+    };
+    
+    
+    // PARAMETER GRID
+    
+    typedef std::vector<double> Params;
+    
+    class Grid {
+        
+    public:
+        
+        Grid& add( const std::string& name, const std::vector<double>& values ){
+            if( values.empty() )
+                throw SweepException("Empty value list for parameter "+name+".");
+            _names.push_back(name);
+            _values.push_back(values);
+            return *this;
+        }
+        
+        // from, from+step, ... up to to; each value is from + i*step, so steps like 0.1 do not drift
+        Grid& add( const std::string& name, double from, double to, double step ){
+            if( !(step > 0) || !std::isfinite(step) || !std::isfinite(from) || !std::isfinite(to) )
+                throw SweepException("Invalid range for parameter "+name+".");
+            const double span = (to - from) / step + 1e-9;
+            if( span >= 1e8 )
+                throw SweepException("Too many values for parameter "+name+".");
+            std::vector<double> values;
+            if( span >= 0 ){
+                const size_t n = static_cast<size_t>( std::floor(span) ) + 1;
+                values.reserve(n);
+                for( size_t i = 0; i < n; ++i )
+                    values.push_back( from + i*step );
+            }
+            return add(name, values);
+        }
+        
+        size_t size() const {
+            if( _values.empty() )
+                return 0;
+            size_t n = 1;
+            for( size_t i = 0; i < _values.size(); ++i )
+                n *= _values[i].size();
+            return n;
+        }
+        
+        // parameter vector of grid point i; last parameter varies fastest
+        Params at( size_t i ) const {
+            Params p(_values.size());
+            for( size_t k = _values.size(); k-- > 0; ){
+                p[k] = _values[k][ i % _values[k].size() ];
+                i /= _values[k].size();
+            }
+            return p;
+        }
+        
+        const std::vector<std::string>& names() const {
+            return _names;
+        }
+        
+    private:
+        std::vector<std::string> _names;
+        std::vector< std::vector<double> > _values;
+    };
+    
+    
+    typedef std::function< Metrics(const Params&) > Job;
+    
+    
+    // -----------------------------------------------------------------
+    // COORDINATOR / WORKER
+    // -----------------------------------------------------------------
+    
+    struct Options {
+        
+        Options()
+        :   workers(0),
+            lease_size(0),
+            heartbeat_ms(500),
+            timeout_ms(5000),
+            max_retries(3),
+            socket_path(),
+            numa_pin(false)
+        {};
+        
+        unsigned workers;           // worker processes, 0 = one per core
+        size_t lease_size;          // grid points per lease, 0 = chosen from grid size
+        unsigned heartbeat_ms;      // worker heartbeat interval
+        unsigned timeout_ms;        // silence after which a worker is considered dead
+        unsigned max_retries;       // reissues per lease before the sweep fails
+        std::string socket_path;    // empty = private path under /tmp
+        bool numa_pin;              // pin worker i to the (i % node_count())-th online NUMA node, see numa.hpp
+    };
+    
+    
+    class Coordinator: private utilities::Uncopyable {
+        
+    public:
+        
+        Coordinator( const Grid& grid, Job job, const Options& opts = Options() )
+        :   _grid(grid),
+            _job(job),
+            _opts(opts)
+        {};
+        
+        // forks the workers, runs the sweep and returns one accumulator per grid point
+        // throws if a lease exhausts its retries
+        std::vector<Metrics> run();
+        
+        // merged accumulator over all grid points of the last run
+        const Metrics& total() const {
+            return _total;
+        }
+        
+    private:
+        
+        const Grid _grid;
+        Job _job;
+        const Options _opts;
+        Metrics _total;
+    };
+    
+    
+    // connects to a coordinator and processes leases until told to stop;
+    // used by forked workers, can also be started separately
+    int run_worker( const std::string& socket_path, const Grid& grid, Job job, unsigned heartbeat_ms );
+    
+} // namespace sweep
+
+
+#endif
@@ -58,6 +58,7 @@
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/algorithm/copy.hpp>
 #include <boost/iterator/transform_iterator.hpp>
+#include <boost/optional.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 //STL
@@ -66,8 +67,12 @@
 #include <map>
 #include <stdexcept> 
 #include <type_traits>
+#include <memory>
 
 #include "datapoint.hpp"
+#include "calendar.hpp"
+#include "footprint.hpp"
+#include "macros.hpp"
 
 namespace bpt = boost::posix_time;
 namespace dp  = datapoint;
@@ -94,7 +99,7 @@ namespace timeseries {
     // TIME SERIES TEMPLATE CLASS
     // -----------------------------------------------------------------
     
-    template <typename T> class TimeSeries {
+    template <typename T> class TimeSeries: public footprint::Tracked {
         
         BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
             
@@ -111,31 +116,41 @@ namespace timeseries {
         :   _meta(meta),
             _data(),
             _isLoaded(false),
+            _calendar(),
             values(*this),
             timestamps(*this)
-        {};
+        {
+            track();
+        };
        
         TimeSeries( const TimeSeries& ts ) // copy ctor
         :   _meta( ts._meta ),
             _data( ts._data ),
             _isLoaded( ts._isLoaded),
+            _calendar( ts._calendar ),
             values(*this),
             timestamps(*this)
-        {};
+        {
+            track();
+        };
         
         
         TimeSeries( TimeSeries&& ts ) // move ctor
         :   _meta( std::move(ts._meta) ),
             _data( std::move(ts._data) ),
             _isLoaded( ts._isLoaded ),
+            _calendar( std::move(ts._calendar) ),
             values( *this ),
             timestamps( *this )
         {
             ts._isLoaded = false;
             // no need to move the memberspace refs
+            track();
         };
         
-        ~TimeSeries() = default;
+        ~TimeSeries(){
+            untrack();
+        };
         
         
         // ASSIGNMENT
@@ -151,6 +166,7 @@ namespace timeseries {
                 this->_data = rhs._data;
                 _meta = rhs._meta;
                 _isLoaded = rhs._isLoaded;
+                _calendar = rhs._calendar;
             }
             return *this;
         };
@@ -162,6 +178,7 @@ namespace timeseries {
                 _meta = std::move(rhs._meta);
                 _data = std::move(rhs._data);
                 _isLoaded = rhs._isLoaded;
+                _calendar = std::move(rhs._calendar);
                 rhs._isLoaded = false;
             }
             return *this;
@@ -175,20 +192,27 @@ namespace timeseries {
             swap( ts1._isLoaded, ts2._isLoaded );
             ts1._meta.swap( ts2._meta );
             ts1._data.swap( ts2._data );
+            ts1._calendar.swap( ts2._calendar );
         };
         
         
         // MUTATORS
         
         bool insert( const typename TimeMap::value_type& val ) {
+            PROFILE_COUNT("ts.insert", 1);
+            _invalidate_calendar();
             return _data.insert(val).second;
         }
 
         bool insert( typename TimeMap::value_type&& val ) { // move insertion
+            PROFILE_COUNT("ts.insert", 1);
+            _invalidate_calendar();
             return _data.insert(std::move(val)).second;
         }
         
         bool insert( time_t&& t, typename TimeMap::mapped_type&& mval ) { //inplace pair construction & move
+            PROFILE_COUNT("ts.insert", 1);
+            _invalidate_calendar();
             return _data.emplace(std::move(t),std::move(mval)).second;
         }
         
@@ -216,12 +240,7 @@ namespace timeseries {
         };
 
         const_iterator on(time_t tm) const { //get iterator by timestamp; returns end() if timestamp not found
-             try {
-                return _data.at(tm);
-            }
-            catch( const std::out_of_range &e ){
-                return cend();
-            }
+            return _data.find(tm);
         };
 
         
@@ -231,6 +250,35 @@ namespace timeseries {
             return _data.at( k );
         }
         
+        // NON-THROWING ACCESSORS
+        // for strategies probing sparse data: absence is a result, not an exception
+        
+        const T* find( time_t tm ) const { // NULL if timestamp not found
+            const_iterator it = _data.find(tm);
+            return it == _data.end() ? NULL : &it->second;
+        }
+        
+        T* find( time_t tm ) {
+            iterator it = _data.find(tm);
+            return it == _data.end() ? NULL : &it->second;
+        }
+        
+        boost::optional<const T&> get( time_t tm ) const { // empty if timestamp not found
+            const T* p = find(tm);
+            return p ? boost::optional<const T&>(*p) : boost::none;
+        }
+        
+        const T* as_of( time_t tm ) const { // last datapoint at or before tm, NULL if none
+            const_iterator it = _data.upper_bound(tm);
+            return it == _data.begin() ? NULL : &(--it)->second;
+        }
+        
+        const T& unchecked( time_t tm ) const { // timestamp must exist; checked only in DEBUG builds
+            const_iterator it = _data.find(tm);
+            ASSERT( it != _data.end() );
+            return it->second;
+        }
+        
         bpt::ptime first() const {
             return bpt::from_time_t( _data.begin()->first );
         }
@@ -251,6 +299,21 @@ namespace timeseries {
         }
 
 
+        // calendar fields of all timestamps, computed on first use and
+        // dropped whenever timestamps are inserted or removed
+        const ::calendar::Columns& calendar() const {
+            static const ::calendar::Columns none;
+            if( !_calendar )            // never inserted into or moved from, and so empty
+                return none;
+            return _calendar->get( [this](){
+                std::vector<time_t> ts;
+                ts.reserve( _data.size() );
+                boost::copy(_data | boost::adaptors::map_keys, std::back_inserter(ts));
+                return ::calendar::decompose(ts.empty() ? NULL : &ts[0], ts.size());
+            });
+        }
+        
+        
         // VALUES MEMBERSPACE
         
         struct Values {
@@ -354,12 +417,13 @@ namespace timeseries {
         
         void clear() {
             _data.clear();
+            _invalidate_calendar();
         }
 
         
         // META AND COLUMN INFORMATION
         
-        std::vector<std::string> column_names() const {
+        const std::vector<std::string>& column_names() const {
             return dp::dp_names<T>();
         }
         
@@ -382,6 +446,27 @@ namespace timeseries {
             std::cout << std::endl;
             std::cout << "First timestamp: " << first() << std::endl;
             std::cout << "Last timestamp: " << last() << std::endl;
+            std::cout << "Memory: " << footprint::describe( memory() ) << std::endl;
+        }
+        
+        // bytes held by the series; map nodes are estimated from the node layout
+        footprint::Usage memory() const {
+            
+            typedef typename TimeMap::value_type Node;
+            const size_t node = footprint::heap_bytes( 4*sizeof(void*) + sizeof(Node) ); // rb-tree links + value
+            const size_t fields = dp::field_count<T>::value * sizeof(double);
+            
+            footprint::Usage u;
+            u.payload = _data.size() * fields;
+            u.index = _data.size() * sizeof(time_t);
+            u.overhead = _data.size() * (node - fields - sizeof(time_t)) + sizeof(*this) + _meta.capacity();
+            if( _calendar )
+                u.caches = _calendar->memory();
+            return u;
+        }
+        
+        std::string memory_label() const {
+            return "TimeSeries " + _meta;
         }
                    
     // DATA MEMBERS
@@ -391,6 +476,13 @@ namespace timeseries {
         TimeMap _data;                  // internal data container
         std::string _meta;              // string with meta information
         bool _isLoaded;                 // load flag
+        std::shared_ptr< ::calendar::Cache > _calendar;  // cached calendar columns, shared by copies
+        
+        // a fresh cache unless ours is unused and unshared; cheap enough for every insert
+        void _invalidate_calendar(){
+            if( !_calendar || _calendar.use_count() > 1 || _calendar->filled.load(std::memory_order_relaxed) )
+                _calendar = std::make_shared< ::calendar::Cache >();
+        }
     
         
     
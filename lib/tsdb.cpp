@@ -26,10 +26,24 @@
  */
 
 
+#include <limits>
+
 #include "tsdb.hpp"
 
 using namespace tsdb;
 
+namespace {
+    
+    // DATETIME/TIMESTAMP values and DATE values ("YYYY-MM-DD", taken as midnight)
+    time_t sql_time( const std::string& s )
+    {
+        time_t t;
+        if( utilities::parse_date(s.data(), s.size(), t) )
+            return t;
+        return utilities::str_to_time_t(s);
+    }
+}
+
 // STATICS
 
 const std::string Interface::_database = DATABASE;
@@ -44,7 +58,8 @@ const std::map<int,std::string> TSDBInterfaceException::messages {
     {4, "Invalid date range request."},
     {5, "Column mismatch."},
     {6, "Failed to set session time zone."},
-    {7, "MySQL server error."}};
+    {7, "MySQL server error."},
+    {8, "Malformed value in TSDB table."}};
 
     
 // CONSTRUCTORS, DESTRUCTORS
@@ -254,3 +269,167 @@ void Interface::print_metadata() //nothrow
 }
 
 
+// LOAD
+
+sql::PreparedStatement* Interface::_prepare_select(const std::string& cols,
+                                                   const std::string& table,
+                                                   bpt::ptime start,
+                                                   bpt::ptime end,
+                                                   bool ordered)
+{
+    if( start > end )
+        throw TSDBInterfaceException(4);
+    
+    std::string query = "SELECT "+cols+" FROM "+table;
+    const std::string order = ordered ? " ORDER BY date_time" : "";
+    unique_ptr<sql::PreparedStatement> pstmt;
+    
+    if( !start.is_not_a_date_time() && !end.is_not_a_date_time() )
+    {
+        query += " WHERE date_time BETWEEN (?) and (?)"+order+";";
+        pstmt.reset( _con->prepareStatement(query) );
+        pstmt->setDateTime(1, utilities::bpt_to_str(start));
+        pstmt->setDateTime(2, utilities::bpt_to_str(end));
+    }
+    else if( !start.is_not_a_date_time() && end.is_not_a_date_time() )
+    {
+        query += " WHERE date_time >= (?)"+order+";";
+        pstmt.reset( _con->prepareStatement(query) );
+        pstmt->setDateTime(1, utilities::bpt_to_str(start));
+    }
+    else if( start.is_not_a_date_time() && !end.is_not_a_date_time() )
+    {
+        query += " WHERE date_time <= (?)"+order+";";
+        pstmt.reset( _con->prepareStatement(query) );
+        pstmt->setDateTime(1, utilities::bpt_to_str(end));
+    }
+    else
+        pstmt.reset( _con->prepareStatement(query+order) );
+    
+    return pstmt.release();
+}
+
+
+void Interface::load(df::DynFrame& frame, const std::string& table, bpt::ptime start, bpt::ptime end, bool print_meta)
+{
+    PROFILE_SCOPE("tsdb.load");
+    
+    if( !isConnected() )
+        connect();
+    
+    if( !has_table(table) )
+        throw TSDBInterfaceException(2);
+    
+    try{
+        
+        unique_ptr<sql::PreparedStatement> pstmt( _prepare_select("*", table, start, end, true) );
+        std::unique_ptr<sql::ResultSet> rset;
+        {
+            PROFILE_SCOPE("tsdb.query");
+            rset.reset( pstmt->executeQuery() );
+        }
+        sql::ResultSetMetaData* meta = rset->getMetaData();
+        
+        if( print_meta )
+            _print_loading_MetaData( meta );
+        
+        // schema from the result metadata
+        const unsigned num_cols = meta->getColumnCount();
+        unsigned time_col = 0;
+        std::vector<unsigned> source;
+        std::vector<std::string> names;
+        std::vector<df::ColumnType> types;
+        std::vector<bool> is_time;
+        
+        for( unsigned i = 1; i <= num_cols; ++i ){
+            
+            const std::string label = meta->getColumnLabel(i);
+            if( label == "date_time" ){
+                time_col = i;
+                continue;
+            }
+            
+            df::ColumnType type = df::STRING;
+            bool time = false;
+            switch( meta->getColumnType(i) ){
+                case sql::DataType::BIT:
+                case sql::DataType::TINYINT:
+                case sql::DataType::SMALLINT:
+                case sql::DataType::MEDIUMINT:
+                case sql::DataType::YEAR:
+                    type = df::INT32; break;
+                case sql::DataType::INTEGER:
+                case sql::DataType::BIGINT:
+                    type = df::INT64; break;
+                case sql::DataType::REAL:
+                case sql::DataType::DOUBLE:
+                case sql::DataType::DECIMAL:
+                case sql::DataType::NUMERIC:
+                    type = df::FLOAT64; break;
+                case sql::DataType::TIMESTAMP:
+                case sql::DataType::DATE:
+                    type = df::INT64; time = true; break;
+                default:
+                    break;
+            }
+            source.push_back(i);
+            names.push_back(label);
+            types.push_back(type);
+            is_time.push_back(time);
+        }
+        
+        if( !time_col )
+            throw TSDBInterfaceException(5);
+        
+        df::DynFrame::Builder builder( names, types, table );
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        time_t last = 0;
+        
+        while( rset->next() ){
+            
+            const time_t t = sql_time( rset->getString(time_col) );
+            if( builder.size() && t == last )
+                continue;
+            last = t;
+            
+            builder.add_row(t);
+            for( size_t j = 0; j < source.size(); ++j ){
+                const unsigned i = source[j];
+                switch( types[j] ){
+                    case df::INT32:
+                    case df::INT64:
+                        if( is_time[j] ){
+                            const std::string s = rset->getString(i);
+                            if( !rset->wasNull() )
+                                builder.set( j, static_cast<int64_t>( sql_time(s) ) );
+                        }
+                        else
+                            builder.set( j, static_cast<int64_t>( rset->getInt64(i) ) );
+                        break;
+                    case df::FLOAT64: {
+                        const double v = rset->getDouble(i);
+                        builder.set( j, rset->wasNull() ? nan : v );
+                        break;
+                    }
+                    case df::STRING:
+                        builder.set( j, std::string( rset->getString(i) ) );
+                        break;
+                }
+            }
+        }
+        PROFILE_COUNT("tsdb.rows", builder.size());
+        
+        frame = builder.finish();
+    }
+    catch( sql::SQLException& ex ) {
+        _print_SQLException(ex);
+        throw TSDBInterfaceException(3);
+    }
+    catch( TSDBInterfaceException& ) {
+        throw;
+    }
+    catch( std::exception& ex ) {   // unparseable timestamps and the like
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        throw TSDBInterfaceException(8);
+    }
+}
@@ -58,6 +58,7 @@
 
 // STL & Boost
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <algorithm>
 #include <boost/algorithm/string/join.hpp>
@@ -67,8 +68,12 @@
 // Backtester
 #include "utilities.hpp"
 #include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "dynframe.hpp"
+#include "macros.hpp"
 
 namespace ts  = timeseries;
+namespace df  = dataframe;
 
 #define HOST "tcp://127.0.0.1:3306"
 #define DATABASE "tsdb"
@@ -82,20 +87,19 @@ namespace tsdb {
     class TSDBInterfaceException: public std::exception {
         
     public:
-        TSDBInterfaceException(unsigned short code):error_code(code){};
+        TSDBInterfaceException(unsigned short code)
+        :   error_code(code),
+            _msg( base_msg + ( messages.count(code) ? messages.at(code) : messages.at(0) ) )
+        {};
         ~TSDBInterfaceException() throw(){};
         
         virtual const char* what() const throw() {
-            try {
-                return (base_msg + messages.at(error_code)).c_str();
-            }
-            catch( std::out_of_range& e ){
-                return (base_msg + messages.at(0)).c_str();
-            }
+            return _msg.c_str();
         }
         
     private:
         unsigned short error_code;
+        std::string _msg;
         static const std::string base_msg;
         static const std::map<int,string> messages;
     };
@@ -137,71 +141,133 @@ namespace tsdb {
                                        bpt::ptime end = bpt::ptime(),
                                        bool print_meta = false)         // throws
         {
-            BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
-            
-            if( !isConnected() )
-                connect();
-            
-            if( !has_table(table) )
-                throw TSDBInterfaceException(2);
-            
-            if( !_columns_match_type<T>(table) )
-                throw TSDBInterfaceException(5);
-            
-            if( start > end )
-                throw TSDBInterfaceException(4);
+            PROFILE_SCOPE("tsdb.load");
             
             try{
-
-                std::string cols = boost::algorithm::join(dp::dp_names<T>(), ", ");
-                std::string query = "SELECT date_time, "+cols+" FROM "+table;
-                unique_ptr<sql::PreparedStatement> pstmt(_con->prepareStatement(query));
                 
-                if( !start.is_not_a_date_time() && !end.is_not_a_date_time() )
-                {
-                    query += " WHERE date_time BETWEEN (?) and (?);";
-                    pstmt.reset( _con->prepareStatement(query) );
-                    pstmt->setDateTime(1, utilities::bpt_to_str(start));
-                    pstmt->setDateTime(2, utilities::bpt_to_str(end));
-                }
-                else if( !start.is_not_a_date_time() && end.is_not_a_date_time() )
-                {
-                    query += " WHERE date_time >= (?);";
-                    pstmt.reset( _con->prepareStatement(query) );
-                    pstmt->setDateTime(1, utilities::bpt_to_str(start));
-                }
-                else if( start.is_not_a_date_time() && !end.is_not_a_date_time() )
+                unique_ptr<sql::PreparedStatement> pstmt( _prepare_load<T>(table, start, end, false) );
+                std::unique_ptr<sql::ResultSet> rset;
                 {
-                    query += " WHERE date_time <= (?);";
-                    pstmt.reset( _con->prepareStatement(query) );
-                	pstmt->setDateTime(1, utilities::bpt_to_str(end));
+                    PROFILE_SCOPE("tsdb.query");
+                    rset.reset( pstmt->executeQuery() );
                 }
-              
-                std::unique_ptr<sql::ResultSet> rset( pstmt->executeQuery() );
                 sql::ResultSetMetaData* rset_meta( rset->getMetaData() );
                 
                 if( print_meta )
                     _print_loading_MetaData( rset_meta );
                 
-                int num_cols = rset_meta->getColumnCount();
-                std::vector<double> row;
-                row.reserve( num_cols-1 );
+                // column count is fixed by the query, so rows go through a stack buffer
+                // and the unchecked datapoint constructor
+                const int num_cols = static_cast<int>( dp::field_count<T>::value ) + 1;
+                double row[dp::field_count<T>::value];
                 
                 while( rset->next() ){
                     
                     for( int i =  2; i <= num_cols; ++i) // MySQL Conn doesn't allow accessing entire row at once
-                        row.push_back(rset->getDouble(i));
+                        row[i-2] = rset->getDouble(i);
                     
                     series.insert( utilities::str_to_time_t(rset->getString(1)), T(row) ); //move insert
-                    row.clear();
+                    PROFILE_COUNT("tsdb.rows", 1);
+                }
+            }
+            catch( sql::SQLException& ex ) {
+                _print_SQLException(ex);
+                throw TSDBInterfaceException(3);
+            }
+            
+        } //load
+        
+        // loads straight into columns; rows are buffered in chunks of LOAD_CHUNK, so the
+        // number of allocations grows with the number of chunks, not rows (apart from
+        // the strings the connector allocates per row); duplicate timestamps keep the first row
+        template<typename T> void load(df::DataFrame<T>& frame,
+                                       const std::string& table,
+                                       bpt::ptime start = bpt::ptime(),
+                                       bpt::ptime end = bpt::ptime(),
+                                       bool print_meta = false)         // throws
+        {
+            PROFILE_SCOPE("tsdb.load");
+            
+            const size_t ncols = dp::field_count<T>::value;
+            std::vector< std::shared_ptr<void> > chunks;
+            size_t rows = 0;
+            
+            try{
+                
+                unique_ptr<sql::PreparedStatement> pstmt( _prepare_load<T>(table, start, end, true) );
+                std::unique_ptr<sql::ResultSet> rset;
+                {
+                    PROFILE_SCOPE("tsdb.query");
+                    rset.reset( pstmt->executeQuery() );
                 }
+                
+                if( print_meta )
+                    _print_loading_MetaData( rset->getMetaData() );
+                
+                const size_t stride = df::padded_stride(LOAD_CHUNK);
+                time_t* idx = NULL;
+                double* cols = NULL;
+                size_t k = LOAD_CHUNK;
+                
+                while( rset->next() ){
+                    
+                    const time_t t = utilities::str_to_time_t( rset->getString(1) );
+                    if( rows && t == idx[k-1] )    // ordered, so duplicates are adjacent
+                        continue;
+                    
+                    if( k == LOAD_CHUNK ){
+                        chunks.push_back( df::allocate_block( df::block_size(LOAD_CHUNK, ncols) ) );
+                        idx = static_cast<time_t*>( chunks.back().get() );
+                        cols = reinterpret_cast<double*>( idx + stride );
+                        k = 0;
+                    }
+                    
+                    idx[k] = t;
+                    for( size_t j = 0; j < ncols; ++j )
+                        cols[j*stride + k] = rset->getDouble( static_cast<int>(j) + 2 );
+                    ++k; ++rows;
+                }
+                PROFILE_COUNT("tsdb.rows", rows);
             }
             catch( sql::SQLException& ex ) {
                 _print_SQLException(ex);
                 throw TSDBInterfaceException(3);
             }
             
+            // one final block, chunks released as they are copied
+            const size_t cstride = df::padded_stride(LOAD_CHUNK);
+            const size_t stride = df::padded_stride(rows);
+            std::shared_ptr<void> block = df::allocate_block( df::block_size(rows, ncols) );
+            time_t* idx = static_cast<time_t*>( block.get() );
+            double* cols = reinterpret_cast<double*>( idx + stride );
+            std::vector<const double*> columns;
+            for( size_t j = 0; j < ncols; ++j )
+                columns.push_back( cols + j*stride );
+            
+            for( size_t c = 0; c < chunks.size(); ++c ){
+                const size_t r0 = c * LOAD_CHUNK;
+                const size_t n = std::min(LOAD_CHUNK, rows - r0);
+                const time_t* cidx = static_cast<const time_t*>( chunks[c].get() );
+                const double* ccols = reinterpret_cast<const double*>( cidx + cstride );
+                std::memcpy( idx + r0, cidx, n * sizeof(time_t) );
+                for( size_t j = 0; j < ncols; ++j )
+                    std::memcpy( cols + j*stride + r0, ccols + j*cstride, n * sizeof(double) );
+                chunks[c].reset();
+            }
+            
+            frame = df::DataFrame<T>::adopt( rows, block, idx, columns, table );
+            
         } //load
+        
+        // loads every column of any table with a date_time column; the schema comes from
+        // the result metadata: integer types become INT32/INT64 columns, floating point and
+        // decimal types FLOAT64 (NULL as NaN), other date/time types INT64 unix time and
+        // everything else STRING; duplicate timestamps keep the first row
+        void load(df::DynFrame& frame,
+                  const std::string& table,
+                  bpt::ptime start = bpt::ptime(),
+                  bpt::ptime end = bpt::ptime(),
+                  bool print_meta = false);     // throws
              
     private:
         
@@ -217,20 +283,47 @@ namespace tsdb {
         
         // HELPERS
         
+        static const size_t LOAD_CHUNK = 1 << 16;   // rows per buffer of DataFrame loads
+        
+        // checks table and range and prepares the SELECT of date_time and the columns of T
+        template<typename T> sql::PreparedStatement* _prepare_load(const std::string& table,
+                                                                   bpt::ptime start,
+                                                                   bpt::ptime end,
+                                                                   bool ordered)
+        {
+            BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
+            
+            if( !isConnected() )
+                connect();
+            
+            if( !has_table(table) )
+                throw TSDBInterfaceException(2);
+            
+            if( !_columns_match_type<T>(table) )
+                throw TSDBInterfaceException(5);
+            
+            return _prepare_select("date_time, "+dp::dp_columns<T>(), table, start, end, ordered);
+        }
+        
+        // prepares SELECT cols FROM table with the date_time range of start/end; throws
+        sql::PreparedStatement* _prepare_select(const std::string& cols,
+                                                const std::string& table,
+                                                bpt::ptime start,
+                                                bpt::ptime end,
+                                                bool ordered);
+        
         // tests if the columns of TSDB 'table' match the datapoint type T
         // returns false if 'table' does not have the columns necessary for required datatype
         template<typename T> bool _columns_match_type(const std::string& table)
         {
             BOOST_STATIC_ASSERT((boost::is_base_of< dp::DataPoint, T>::value));
             
-            std::vector<std::string> columns = get_column_names( table );
-            std::vector<std::string> t_columns = dp::dp_names<T>();
-            
-            std::sort(columns.begin(),columns.end());
-            std::sort(t_columns.begin(),t_columns.end());
+            const std::vector<std::string> columns = get_column_names( table );
+            const std::vector<std::string>& t_columns = dp::dp_names<T>();
             
-            if( !includes(columns.begin(), columns.end(), t_columns.begin(), t_columns.end() ) )
-                return false;
+            for( size_t j = 0; j < t_columns.size(); ++j )
+                if( std::find(columns.begin(), columns.end(), t_columns[j]) == columns.end() )
+                    return false;
             
             return true;
         }
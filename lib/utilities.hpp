@@ -41,6 +41,10 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
 
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
 namespace bpt = boost::posix_time;
 namespace btg = boost::gregorian;
 using namespace std;
@@ -86,16 +90,241 @@ namespace utilities {
     }
     
     
+    // integer calendar arithmetic on days since 1970-01-01 (proleptic gregorian),
+    // avoids constructing bpt::ptime objects in tight loops
+    
+    inline long days_from_civil(int y, unsigned m, unsigned d)
+    {
+        y -= m <= 2;
+        const long era = (y >= 0 ? y : y - 399) / 400;
+        const unsigned long yoe = static_cast<unsigned long>(y - era * 400);        // [0, 399]
+        const unsigned long doy = (153*(m > 2 ? m-3 : m+9) + 2)/5 + d - 1;          // [0, 365]
+        const unsigned long doe = yoe * 365 + yoe/4 - yoe/100 + doy;                // [0, 146096]
+        return era * 146097 + static_cast<long>(doe) - 719468;
+    }
+    
+    inline unsigned days_in_month(int y, unsigned m)
+    {
+        static const unsigned char dim[] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
+        const bool leap = ( y % 4 == 0 && y % 100 != 0 ) || y % 400 == 0;
+        return dim[m-1] + ( m == 2 && leap );
+    }
+    
+    
+    // FAST TIMESTAMP PARSING
+    
+    // parses exactly "YYYY-MM-DD HH:MM:SS" (or 'T' separated) with an optional
+    // ".ffffff" fraction, which is truncated like bpt_to_time_t does; returns
+    // false for anything else without throwing
+    
+    inline bool parse_datetime(const char* p, size_t len, time_t& out)
+    {
+        if( len < 19 || ( len > 19 && ( p[19] != '.' || len == 20 ) ) )
+            return false;
+        
+        // digits and separators checked together, no early exits
+        unsigned bad = (p[4] ^ '-') | (p[7] ^ '-') | (p[13] ^ ':') | (p[16] ^ ':');
+        bad |= static_cast<unsigned>( p[10] != ' ' && p[10] != 'T' );
+        
+        static const unsigned char pos[] = { 0,1,2,3, 5,6, 8,9, 11,12, 14,15, 17,18 };
+        unsigned dg[14];
+        for( unsigned i = 0; i < 14; ++i ){
+            dg[i] = static_cast<unsigned>( static_cast<unsigned char>(p[pos[i]]) - '0' );
+            bad |= ( dg[i] > 9 );
+        }
+        
+        bool frac = false;
+        for( size_t i = 20; i < len; ++i ){
+            const unsigned d = static_cast<unsigned>( static_cast<unsigned char>(p[i]) - '0' );
+            bad |= ( d > 9 );
+            frac |= ( d != 0 );
+        }
+        
+        if( bad )
+            return false;
+        
+        const int y = static_cast<int>( dg[0]*1000 + dg[1]*100 + dg[2]*10 + dg[3] );
+        const unsigned mo = dg[4]*10 + dg[5], d = dg[6]*10 + dg[7];
+        const unsigned h = dg[8]*10 + dg[9], mi = dg[10]*10 + dg[11], sec = dg[12]*10 + dg[13];
+        
+        if( mo - 1 > 11 || d - 1 >= days_in_month(y, mo) || h > 23 || mi > 59 || sec > 59 )
+            return false;
+        
+        time_t t = static_cast<time_t>( days_from_civil(y, mo, d) ) * 86400 + h*3600 + mi*60 + sec;
+        out = ( t < 0 && frac ) ? t + 1 : t;   // truncate towards zero
+        return true;
+    }
+    
+    // parses exactly "YYYY-MM-DD", e.g. a DATE column, as midnight of that day;
+    // returns false for anything else without throwing
+    
+    inline bool parse_date(const char* p, size_t len, time_t& out)
+    {
+        if( len != 10 || p[4] != '-' || p[7] != '-' )
+            return false;
+        
+        static const unsigned char pos[] = { 0,1,2,3, 5,6, 8,9 };
+        unsigned dg[8];
+        for( unsigned i = 0; i < 8; ++i ){
+            dg[i] = static_cast<unsigned>( static_cast<unsigned char>(p[pos[i]]) - '0' );
+            if( dg[i] > 9 )
+                return false;
+        }
+        
+        const int y = static_cast<int>( dg[0]*1000 + dg[1]*100 + dg[2]*10 + dg[3] );
+        const unsigned mo = dg[4]*10 + dg[5], d = dg[6]*10 + dg[7];
+        
+        if( mo - 1 > 11 || d - 1 >= days_in_month(y, mo) )
+            return false;
+        
+        out = static_cast<time_t>( days_from_civil(y, mo, d) ) * 86400;
+        return true;
+    }
+    
+    // batch variant for n fixed-width "YYYY-MM-DD HH:MM:SS" records stride bytes
+    // apart, e.g. a CHAR(19) column; decodes the date and hour/minute digits with
+    // SSSE3 where available; returns the index of the first record that failed to
+    // parse (n if none), which the caller can hand to str_to_time_t
+    
+    inline size_t parse_datetime_batch(const char* base, size_t stride, size_t n, time_t* out)
+    {
+#ifdef __SSSE3__
+        const __m128i zero = _mm_set1_epi8('0');
+        const __m128i nine = _mm_set1_epi8(9);
+        // gathers the 12 date/hour/minute digits into adjacent pairs, zeroes the rest
+        const __m128i gather = _mm_setr_epi8(0,1,2,3,5,6,8,9,11,12,14,15,-1,-1,-1,-1);
+        const __m128i weights = _mm_setr_epi8(10,1,10,1,10,1,10,1,10,1,10,1,0,0,0,0);
+        const __m128i seps = _mm_setr_epi8(0,0,0,0,'-',0,0,'-',0,0,' ',0,0,':',0,0);
+        const __m128i sepmask = _mm_setr_epi8(0,0,0,0,-1,0,0,-1,0,0,-1,0,0,-1,0,0);
+        
+        for( size_t i = 0; i < n; ++i ){
+            
+            const char* p = base + i*stride;
+            const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p) );
+            const __m128i dv = _mm_shuffle_epi8( _mm_sub_epi8(v, zero), gather );
+            
+            // digits must be <= 9 unsigned, separators must match ('T' handled by scalar path)
+            const int digits_ok = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_min_epu8(dv, nine), dv ) ) == 0xFFFF;
+            const int seps_ok = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_and_si128(v, sepmask), seps ) ) == 0xFFFF;
+            const unsigned s1 = static_cast<unsigned>(p[17] - '0'), s0 = static_cast<unsigned>(p[18] - '0');
+            
+            if( !digits_ok || !seps_ok || p[16] != ':' || s1 > 9 || s0 > 9 ){
+                if( !parse_datetime(p, 19, out[i]) )
+                    return i;
+                continue;
+            }
+            
+            const __m128i pairs = _mm_maddubs_epi16(dv, weights);   // YY YY MM DD HH MI 0 0
+            const int y = _mm_extract_epi16(pairs, 0) * 100 + _mm_extract_epi16(pairs, 1);
+            const unsigned mo = static_cast<unsigned>( _mm_extract_epi16(pairs, 2) );
+            const unsigned d = static_cast<unsigned>( _mm_extract_epi16(pairs, 3) );
+            const unsigned h = static_cast<unsigned>( _mm_extract_epi16(pairs, 4) );
+            const unsigned mi = static_cast<unsigned>( _mm_extract_epi16(pairs, 5) );
+            const unsigned sec = s1*10 + s0;
+            
+            if( mo - 1 > 11 || d - 1 >= days_in_month(y, mo) || h > 23 || mi > 59 || sec > 59 )
+                return i;
+            
+            out[i] = static_cast<time_t>( days_from_civil(y, mo, d) ) * 86400 + h*3600 + mi*60 + sec;
+        }
+        return n;
+#else
+        for( size_t i = 0; i < n; ++i )
+            if( !parse_datetime(base + i*stride, 19, out[i]) )
+                return i;
+        return n;
+#endif
+    }
+    
+    
     // converts a string to a unix timestamp
     // throws if string cannot be converted to boost::ptime object
+    // the common "YYYY-MM-DD HH:MM:SS[.f]" format takes the fast path above,
+    // only other formats go through boost::posix_time::time_from_string
 
     inline time_t str_to_time_t(const string& str)
     {
+        time_t t;
+        if( parse_datetime(str.data(), str.size(), t) )
+            return t;
+        
         bpt::ptime pt( bpt::time_from_string(str) );
         return bpt_to_time_t(pt);
     }
     
     // for the reverse conversion use bpt::from_time_t() returning a bpt::ptime
+    
+    
+    struct CivilDate {
+        int year;
+        unsigned month;     // [1,12]
+        unsigned day;       // [1,31]
+    };
+    
+    inline CivilDate civil_from_days(long z)
+    {
+        z += 719468;
+        const long era = (z >= 0 ? z : z - 146096) / 146097;
+        const unsigned long doe = static_cast<unsigned long>(z - era * 146097);      // [0, 146096]
+        const unsigned long yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;  // [0, 399]
+        const unsigned long doy = doe - (365*yoe + yoe/4 - yoe/100);                // [0, 365]
+        const unsigned long mp = (5*doy + 2)/153;                                   // [0, 11]
+        
+        CivilDate d;
+        d.day = static_cast<unsigned>(doy - (153*mp+2)/5 + 1);
+        d.month = static_cast<unsigned>(mp < 10 ? mp+3 : mp-9);
+        d.year = static_cast<int>(yoe + era * 400 + (d.month <= 2));
+        return d;
+    }
+    
+    // days since epoch and seconds into the day, correct for negative timestamps
+    inline long days_from_time_t(time_t t)
+    {
+        return static_cast<long>( t >= 0 ? t / 86400 : (t - 86399) / 86400 );
+    }
+    
+    inline long seconds_of_day(time_t t)
+    {
+        return static_cast<long>( t - static_cast<time_t>(days_from_time_t(t)) * 86400 );
+    }
+    
+    // 0 = Sunday, ..., 6 = Saturday (same convention as boost::gregorian)
+    inline unsigned weekday_from_days(long z)
+    {
+        return static_cast<unsigned>( z >= -4 ? (z+4) % 7 : (z+5) % 7 + 6 );
+    }
+    
+    
+    // FAST TIMESTAMP FORMATTING
+    
+    // writes "YYYY-MM-DD HH:MM:SS" (19 chars, no terminator), same text as
+    // bpt_to_str for whole seconds without going through bpt::ptime; years 0-9999
+    
+    inline size_t format_datetime(time_t t, char* out)
+    {
+        static const char pairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        
+        const long days = days_from_time_t(t);
+        const long sod = seconds_of_day(t);
+        const CivilDate d = civil_from_days(days);
+        
+        const unsigned y = static_cast<unsigned>(d.year);
+        const unsigned v[] = { y / 100, y % 100, d.month, d.day,
+                               static_cast<unsigned>(sod / 3600), static_cast<unsigned>(sod / 60 % 60), static_cast<unsigned>(sod % 60) };
+        static const unsigned char at[] = { 0, 2, 5, 8, 11, 14, 17 };
+        
+        for( unsigned i = 0; i < 7; ++i ){
+            out[at[i]] = pairs[2*v[i]];
+            out[at[i]+1] = pairs[2*v[i]+1];
+        }
+        out[4] = out[7] = '-';
+        out[10] = ' ';
+        out[13] = out[16] = ':';
+        return 19;
+    }
 
 }
 
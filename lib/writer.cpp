@@ -0,0 +1,266 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+
+#include "writer.hpp"
+
+using namespace writer;
+
+// EXCEPTIONS
+
+WriterException::WriterException(const std::string& message):_msg(_spec + message){};
+WriterException::~WriterException() throw(){};
+
+const char* WriterException::what() const throw() {return _msg.c_str(); }
+const std::string WriterException::_spec = "Writer Exception: ";
+
+
+// NUMBER FORMATTING
+
+namespace {
+    
+    const char PAIRS[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    
+    const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+}
+
+
+size_t writer::format_uint( uint64_t v, char* out )
+{
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    
+    while( v >= 100 ){
+        const unsigned r = static_cast<unsigned>(v % 100);
+        v /= 100;
+        *--p = PAIRS[2*r+1];
+        *--p = PAIRS[2*r];
+    }
+    if( v >= 10 ){
+        *--p = PAIRS[2*v+1];
+        *--p = PAIRS[2*v];
+    }
+    else
+        *--p = static_cast<char>('0' + v);
+    
+    const size_t n = static_cast<size_t>(tmp + sizeof(tmp) - p);
+    std::memcpy(out, p, n);
+    return n;
+}
+
+
+size_t writer::format_int( int64_t v, char* out )
+{
+    if( v >= 0 )
+        return format_uint(static_cast<uint64_t>(v), out);
+    *out = '-';
+    return 1 + format_uint(0 - static_cast<uint64_t>(v), out + 1);
+}
+
+
+size_t writer::format_double( double v, char* out )
+{
+    if( std::isnan(v) )     // empty field, which the CSV reader reads back as NaN
+        return 0;
+    
+    // shortest number of decimals d <= 9 for which round(v*10^d)/10^d == v; the
+    // division is correctly rounded, so strtod on the printed text returns v
+    const double a = std::fabs(v);
+    if( a < 1e15 ){
+        for( unsigned d = 0; d <= 9; ++d ){
+            const double r = std::nearbyint(a * POW10[d]);
+            if( r >= 9007199254740992.0 )   // 2^53
+                break;
+            if( r / POW10[d] != a )
+                continue;
+            
+            char digits[20];
+            size_t n = format_uint(static_cast<uint64_t>(r), digits);
+            char* p = out;
+            if( std::signbit(v) && r != 0 )
+                *p++ = '-';
+            if( d == 0 ){
+                std::memcpy(p, digits, n);
+                return static_cast<size_t>(p - out) + n;
+            }
+            if( n <= d ){   // leading zeros of the fraction
+                *p++ = '0';
+                *p++ = '.';
+                for( size_t z = n; z < d; ++z )
+                    *p++ = '0';
+                std::memcpy(p, digits, n);
+                return static_cast<size_t>(p - out) + n;
+            }
+            std::memcpy(p, digits, n - d);
+            p += n - d;
+            *p++ = '.';
+            std::memcpy(p, digits + n - d, d);
+            return static_cast<size_t>(p - out) + d;
+        }
+    }
+    
+    // general case: fewest significant digits that round-trip
+    char buf[40];
+    int n = 0;
+    for( int prec = 15; prec <= 17; ++prec ){
+        n = std::snprintf(buf, sizeof(buf), "%.*g", prec, v);
+        if( prec == 17 || std::strtod(buf, NULL) == v )
+            break;
+    }
+    std::memcpy(out, buf, static_cast<size_t>(n));
+    return static_cast<size_t>(n);
+}
+
+
+// CHUNKED OUTPUT
+
+namespace {
+    
+    void write_all( int fd, const char* p, size_t n, const std::string& path ){
+        while( n ){
+            ssize_t w = ::write(fd, p, n);
+            if( w < 0 && errno == EINTR )
+                continue;
+            if( w <= 0 )
+                throw WriterException("Write to "+path+" failed.");
+            p += w; n -= static_cast<size_t>(w);
+        }
+    }
+}
+
+
+void writer::write_chunked( const std::string& path, const std::string& header, size_t rows, const Options& opts,
+                            std::function< void(size_t, size_t, Buffer&) > format )
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if( fd < 0 )
+        throw WriterException("Could not open "+path+".");
+    
+    try {
+        
+        if( opts.header ){
+            const std::string h = header + "\n";
+            write_all(fd, h.data(), h.size(), path);
+        }
+        
+        const size_t chunk = std::max<size_t>(1, opts.chunk_rows);
+        const size_t nchunks = ( rows + chunk - 1 ) / chunk;
+        const size_t nthreads = std::max<size_t>(1, std::min<size_t>(nchunks,
+                                    opts.threads ? opts.threads : std::thread::hardware_concurrency()));
+        
+        // rounds of nthreads chunks: format in parallel, then write in order;
+        // the next round is formatted while the previous one is written
+        std::vector<Buffer> front(nthreads), back(nthreads);
+        
+        auto format_round = [&]( size_t first, std::vector<Buffer>& bufs ){
+            std::vector<std::thread> pool;
+            for( size_t k = 0; k < nthreads && first + k < nchunks; ++k ){
+                pool.push_back( std::thread( [&, k](){
+                    const size_t c = first + k;
+                    bufs[k].clear();
+                    format( c * chunk, std::min(rows, (c+1) * chunk), bufs[k] );
+                }));
+            }
+            for( size_t k = 0; k < pool.size(); ++k )
+                pool[k].join();
+        };
+        
+        if( nchunks )
+            format_round(0, front);
+        
+        for( size_t first = 0; first < nchunks; first += nthreads ){
+            
+            std::thread next;
+            if( first + nthreads < nchunks )
+                next = std::thread( [&](){ format_round(first + nthreads, back); } );
+            
+            try {
+                for( size_t k = 0; k < nthreads && first + k < nchunks; ++k )
+                    write_all(fd, front[k].data(), front[k].size(), path);
+            }
+            catch( ... ){
+                if( next.joinable() )   // a joinable thread must not be destroyed
+                    next.join();
+                throw;
+            }
+            
+            if( next.joinable() )
+                next.join();
+            front.swap(back);
+        }
+    }
+    catch( ... ){
+        ::close(fd);
+        throw;
+    }
+    
+    if( ::close(fd) != 0 )
+        throw WriterException("Could not close "+path+".");
+}
+
+
+// RESULTS EXPORT
+
+void writer::write_csv( const std::string& path, const sweep::Grid& grid, const std::vector<sweep::Metrics>& results,
+                        const Options& opts )
+{
+    const char d = opts.delimiter;
+    std::string header;
+    for( size_t k = 0; k < grid.names().size(); ++k )
+        header += grid.names()[k] + d;
+    header += std::string("count") + d + "mean" + d + "stdev" + d + "sharpe" + d + "hit_rate" + d + "min" + d + "max";
+    
+    write_chunked( path, header, results.size(), opts, [&]( size_t r0, size_t r1, Buffer& buf ){
+        for( size_t i = r0; i < r1; ++i ){
+            const sweep::Params p = grid.at(i);
+            for( size_t k = 0; k < p.size(); ++k ){
+                buf.number(p[k]);
+                buf.put(d);
+            }
+            const sweep::Metrics& m = results[i];
+            buf.commit( format_uint(m.count, buf.reserve(20)) );
+            const double v[] = { m.mean(), m.stdev(), m.sharpe(), m.hit_rate(),
+                                 m.count ? m.min : NAN, m.count ? m.max : NAN };
+            for( size_t k = 0; k < 6; ++k ){
+                buf.put(d);
+                buf.number(v[k]);
+            }
+            buf.put('\n');
+        }
+    });
+}
@@ -0,0 +1,229 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * writer.hpp
+ *
+ * Design Overview:
+ *
+ * Buffered bulk export of series and backtest results to CSV. Rows are
+ * split into chunks that are formatted in parallel into large private
+ * buffers and then written to the file strictly in order, so that dumping
+ * large result sets is bound by the disk rather than by formatting.
+ *
+ * Formatting avoids iostreams and bpt::ptime: integers use a two-digits-
+ * at-a-time table, timestamps go through utilities::format_datetime, and
+ * doubles are written in the shortest decimal form that parses back to
+ * the same value (exact fast path for up to 9 decimals, printf only for
+ * the rest).
+ *
+ * For the native binary format see native.hpp.
+ *
+ */
+
+
+#ifndef backtester_writer_hpp
+#define backtester_writer_hpp
+
+//STL
+#include <string>
+#include <vector>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <stdint.h>
+
+#include "datapoint.hpp"
+#include "timeseries.hpp"
+#include "dataframe.hpp"
+#include "sweep.hpp"
+#include "utilities.hpp"
+
+namespace dp = datapoint;
+namespace ts = timeseries;
+namespace df = dataframe;
+
+namespace writer {
+    
+    // EXCEPTIONS
+    
+    class WriterException: public std::exception {
+        
+    public:
+        WriterException(const std::string& message);
+        ~WriterException() throw();
+        
+        virtual const char* what() const throw();
+        
+    private:
+        const std::string _msg;
+        static const std::string _spec;
+    };
+    
+    
+    // NUMBER FORMATTING
+    // write to out without terminator and return the number of chars written
+    
+    size_t format_uint( uint64_t v, char* out );            // at most 20 chars
+    size_t format_int( int64_t v, char* out );              // at most 20 chars
+    size_t format_double( double v, char* out );            // at most 32 chars
+    
+    
+    // OUTPUT BUFFER
+    
+    class Buffer {
+        
+    public:
+        
+        Buffer(): _data(), _size(0) {};
+        
+        // returns space for at least n more chars; call commit with the number used
+        char* reserve( size_t n ){
+            if( _data.size() - _size < n )
+                _data.resize( std::max(_data.size() * 2, _size + n) );
+            return &_data[0] + _size;
+        }
+        
+        void commit( size_t n ){
+            _size += n;
+        }
+        
+        void append( const char* s, size_t n ){
+            std::memcpy( reserve(n), s, n );
+            commit(n);
+        }
+        
+        void put( char c ){
+            *reserve(1) = c;
+            commit(1);
+        }
+        
+        void datetime( time_t t ){
+            commit( utilities::format_datetime(t, reserve(19)) );
+        }
+        
+        void number( double v ){
+            commit( format_double(v, reserve(32)) );
+        }
+        
+        const char* data() const { return _data.data(); }
+        size_t size() const { return _size; }
+        void clear() { _size = 0; }
+        
+    private:
+        std::vector<char> _data;
+        size_t _size;
+    };
+    
+    
+    struct Options {
+        
+        Options()
+        :   delimiter(','),
+            header(true),
+            threads(0),
+            chunk_rows(1 << 16)
+        {};
+        
+        char delimiter;
+        bool header;            // write column names
+        unsigned threads;       // 0 = one per core
+        size_t chunk_rows;      // rows formatted per task
+    };
+    
+    
+    // formats rows [0,rows) in chunks on opts.threads threads via format(r0, r1, buf)
+    // and writes header plus chunks to path in row order; throws on I/O errors
+    void write_chunked( const std::string& path, const std::string& header, size_t rows, const Options& opts,
+                        std::function< void(size_t, size_t, Buffer&) > format );
+    
+    
+    // -----------------------------------------------------------------
+    // CSV EXPORT
+    // -----------------------------------------------------------------
+    
+    template<typename T> void write_csv( const std::string& path, const df::DataFrame<T>& frame,
+                                         const Options& opts = Options() )
+    {
+        const std::vector<std::string> cols = frame.column_names();
+        std::string header = "date_time";
+        for( size_t j = 0; j < cols.size(); ++j )
+            header += opts.delimiter + cols[j];
+        
+        write_chunked( path, header, frame.size(), opts, [&]( size_t r0, size_t r1, Buffer& buf ){
+            for( size_t i = r0; i < r1; ++i ){
+                buf.datetime( frame.timestamp(i) );
+                for( size_t j = 0; j < cols.size(); ++j ){
+                    buf.put( opts.delimiter );
+                    buf.number( frame.column(j)[i] );
+                }
+                buf.put('\n');
+            }
+        });
+    }
+    
+    template<typename T> void write_csv( const std::string& path, const ts::TimeSeries<T>& series,
+                                         const Options& opts = Options() )
+    {
+        typedef typename ts::TimeSeries<T>::const_iterator Iter;
+        
+        // chunk start positions, so chunks can be formatted independently;
+        // same chunking as write_chunked
+        const size_t chunk = std::max<size_t>(1, opts.chunk_rows);
+        std::vector<Iter> starts;
+        size_t i = 0;
+        for( Iter it = series.cbegin(); it != series.cend(); ++it, ++i )
+            if( i % chunk == 0 )
+                starts.push_back(it);
+        
+        const std::vector<std::string> cols = series.column_names();
+        std::string header = "date_time";
+        for( size_t j = 0; j < cols.size(); ++j )
+            header += opts.delimiter + cols[j];
+        
+        write_chunked( path, header, series.size(), opts, [&]( size_t r0, size_t r1, Buffer& buf ){
+            double fields[dp::field_count<T>::value];
+            Iter it = starts[r0 / chunk];
+            for( size_t r = r0; r < r1; ++r, ++it ){
+                buf.datetime( it->first );
+                dp::dp_values<T>(it->second, fields);
+                for( size_t j = 0; j < cols.size(); ++j ){
+                    buf.put( opts.delimiter );
+                    buf.number( fields[j] );
+                }
+                buf.put('\n');
+            }
+        });
+    }
+    
+    // one row per grid point: parameters followed by the metrics of its run
+    void write_csv( const std::string& path, const sweep::Grid& grid, const std::vector<sweep::Metrics>& results,
+                    const Options& opts = Options() );
+    
+} // namespace writer
+
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * TSDB-Backtester - C/C++ framework for algorithmic trading strategy backtests
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2013 Andreas Fragner
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ------------------------------------------------------------------------------
+ *
+ * breakout.hpp
+ *
+ * Design Overview:
+ *
+ * Breakout-pullback entry written as a coroutine strategy: wait for the
+ * close to break above the high of the preceding lookback bars, then, from
+ * the next bar on, wait for a pullback to the breakout level, enter long
+ * and hold for a fixed number of bars. Per-trade returns are collected in
+ * a sweep::Metrics accumulator.
+ *
+ * The lookback high rolls forward while the strategy waits for a
+ * breakout. It is the front of a monotonic queue of (bar, high) kept in a
+ * ring sized at construction, so running the strategy does not allocate.
+ *
+ */
+
+
+#ifndef backtester_breakout_hpp
+#define backtester_breakout_hpp
+
+#include <algorithm>
+#include <vector>
+
+#include "../lib/engine.hpp"
+#include "../lib/sweep.hpp"
+
+namespace strategies {
+    
+    template<typename T> class Breakout: public engine::CoStrategy< T, Breakout<T> > {
+        
+    public:
+        
+        // a lookback of 0 is taken as 1
+        Breakout( unsigned lookback, unsigned hold )
+        :   _lookback( std::max(1u, lookback) ), _hold(hold), _high(), _bars(0), _front(0), _size(0),
+            _level(0), _entry(0), _held(0), _metrics()
+        {
+            _high.resize(_lookback);
+        };
+        
+        void run() {
+            STRATEGY_BODY {
+                for( ;; ){
+                    // breakout: close above the high of the preceding lookback bars
+                    _bars = _size = 0;
+                    while( !( _bars >= _lookback && this->bar().close > _window_high() ) ){
+                        _push( this->bar().high );
+                        AWAIT_NEXT_BAR;
+                    }
+                    _level = _window_high();
+                    
+                    // pullback to the breakout level on a later bar, then enter
+                    AWAIT_NEXT_BAR;
+                    AWAIT_UNTIL( this->bar().low <= _level );
+                    _entry = this->bar().close;
+                    
+                    for( _held = 0; _held < _hold; ++_held ){
+                        AWAIT_NEXT_BAR;
+                    }
+                    _metrics.add( this->bar().close / _entry - 1.0 );
+                }
+            }
+        }
+        
+        const sweep::Metrics& metrics() const {
+            return _metrics;
+        }
+        
+    private:
+        
+        struct High {
+            unsigned long bar;
+            double value;
+        };
+        
+        // appends the high of the current bar; queue values decrease from the front,
+        // and the front leaves once it is lookback bars old
+        void _push( double high ){
+            while( _size && _high[ (_front + _size - 1) % _lookback ].value <= high )
+                --_size;
+            if( _size && _high[_front].bar + _lookback <= _bars ){
+                _front = (_front + 1) % _lookback;
+                --_size;
+            }
+            High h = { _bars++, high };
+            _high[ (_front + _size++) % _lookback ] = h;
+        }
+        
+        // highest high of the last lookback pushed bars
+        double _window_high() const {
+            return _high[_front].value;
+        }
+        
+        unsigned _lookback, _hold;
+        std::vector<High> _high;        // ring of the monotonic queue, lookback entries
+        unsigned long _bars;            // bars pushed since the window was cleared
+        size_t _front, _size;
+        double _level, _entry;
+        unsigned _held;
+        sweep::Metrics _metrics;
+    };
+    
+} // namespace strategies
+
+#endif